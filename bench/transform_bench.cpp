@@ -0,0 +1,107 @@
+//Times Transform_hierarchy::update against a plain GLM version of the same pass, with every node dirty.
+//Build from this directory with optimisations on, for example
+//g++ -O2 -std=c++17 -I../src -I../Dependencies/Include transform_bench.cpp ../src/transform_hierarchy.cpp ../src/transform_kernels.cpp
+//Usage: transform_bench [nodes] [runs]
+#define GLM_FORCE_RADIANS
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "transform_hierarchy.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace
+{
+	struct Reference_node
+	{
+		glm::vec3 translation;
+		glm::quat rotation;
+		glm::vec3 scale;
+		uint32_t parent;
+		glm::mat4 world;
+	};
+
+	//What the update did before the batched kernels, nodes are stored parents first
+	void reference_update(std::vector<Reference_node>& nodes)
+	{
+		for (auto& node : nodes)
+		{
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), node.translation) * glm::mat4_cast(node.rotation) * glm::scale(glm::mat4(1.0f), node.scale);
+			node.world = node.parent == Transform_hierarchy::NO_PARENT ? local : nodes[node.parent].world * local;
+		}
+	}
+
+	template<typename F>
+	double min_time_ms(const uint32_t runs, F&& run)
+	{
+		double best = 1e30;
+		for (uint32_t i = 0; i < runs; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			run();
+			auto end = std::chrono::steady_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t node_count = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 10000;
+	uint32_t runs = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 3000;
+
+	//Shallow random forest, a quarter of the nodes are roots and the rest hang off an earlier node
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	Transform_hierarchy hierarchy;
+	std::vector<Reference_node> reference(node_count);
+	std::vector<uint32_t> ids(node_count);
+	for (uint32_t i = 0; i < node_count; ++i)
+	{
+		uint32_t parent = i == 0 || rng() % 4 == 0 ? Transform_hierarchy::NO_PARENT : static_cast<uint32_t>(rng() % i);
+		Reference_node& node = reference[i];
+		node.translation = glm::vec3(unit(rng), unit(rng), unit(rng)) * 10.0f;
+		node.rotation = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng)));
+		node.scale = glm::vec3(1.0f + 0.5f * unit(rng));
+		node.parent = parent;
+		ids[i] = hierarchy.add_node(parent == Transform_hierarchy::NO_PARENT ? parent : ids[parent]);
+		hierarchy.set_translation(ids[i], node.translation);
+		hierarchy.set_rotation(ids[i], node.rotation);
+		hierarchy.set_scale(ids[i], node.scale);
+	}
+	hierarchy.update();
+	reference_update(reference);
+
+	float max_error = 0.0f;
+	bool identical = true;
+	for (uint32_t i = 0; i < node_count; ++i)
+	{
+		const glm::mat4& a = hierarchy.get_world_matrix(ids[i]);
+		const glm::mat4& b = reference[i].world;
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+			{
+				identical = identical && a[c][r] == b[c][r];
+				max_error = std::max(max_error, std::abs(a[c][r] - b[c][r]));
+			}
+	}
+
+	//Dirtying every root reaches the whole forest, which is the worst case for the update
+	double hierarchy_ms = min_time_ms(runs, [&]() {
+		for (uint32_t i = 0; i < node_count; ++i)
+			if (reference[i].parent == Transform_hierarchy::NO_PARENT)
+				hierarchy.set_translation(ids[i], reference[i].translation);
+		hierarchy.update();
+	});
+	double reference_ms = min_time_ms(runs, [&]() { reference_update(reference); });
+
+	std::cout << node_count << " nodes, min of " << runs << " runs\n";
+	std::cout << "Transform_hierarchy::update: " << hierarchy_ms << " ms\n";
+	std::cout << "GLM reference:               " << reference_ms << " ms\n";
+	std::cout << "World matrices " << (identical ? "bit-identical" : "differ") << ", max error " << max_error << "\n";
+	return identical || max_error < 1e-3f ? 0 : 1;
+}
@@ -27,7 +27,13 @@ float Engine::last_frame = 0.0f;
 	}
 
 
-	Engine::Engine(const std::string& name, const int width, const int height) : app_name(name), WIDTH(width), HEIGHT(height), camera_index(0)
+	Engine::Engine(const std::string& name, const int width, const int height) : Engine(name, width, height, Engine_settings{})
+	{
+	}
+	Engine::Engine(const std::string& name, const int width, const int height, const Engine_settings& engine_settings) :
+		app_name(name), WIDTH(width), HEIGHT(height), settings(engine_settings), frames_in_flight(std::max(1u, engine_settings.frames_in_flight)), camera_index(0),
+		streamer(engine_settings.stream_cell_size, engine_settings.stream_load_radius, engine_settings.stream_unload_radius, engine_settings.stream_budget, engine_settings.stream_concurrent_loads),
+		resolution(engine_settings.target_gpu_time_ms, engine_settings.min_render_scale, engine_settings.max_render_scale)
 	{
 		//GLFW init
 		glfwInit();
@@ -47,51 +53,70 @@ float Engine::last_frame = 0.0f;
 		//create_physical_device();
 		//create_device();
 		vulkan_device = std::make_shared<VulkanDevice>(instance, surface, enable_validation_layers, validation_layers, graphics_queue, present_queue);
-		create_swap_chain();
-		cameras.emplace_back(Free_camera(aspect_ratio));
-		active_camera = &cameras.front();
+		resource_pool = std::make_shared<Resource_pool>(vulkan_device, settings.recycle_pool_size);
+		//The occlusion tests run between the geometry passes and the HDR chain right before presenting, so both need
+		//compute on the graphics queue
+		if (vulkan_device->graphics_supports_compute())
+		{
+			occlusion = std::make_unique<Occlusion_culler>(vulkan_device, frames_in_flight);
+			hdr = std::make_unique<Hdr_processor>(vulkan_device, vulkan_device->supports_storage_write_without_format());
+			hdr->set_bloom(settings.bloom_threshold, settings.bloom_intensity);
+			hdr->set_exposure(settings.exposure_min_log, settings.exposure_max_log, settings.exposure_adaptation, settings.exposure_compensation);
+		}
+		//Created even with shadows off, the frame descriptor sets always reference the maps
+		VkFormat shadow_format = find_supported_format({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+		shadows = std::make_unique<Shadow_renderer>(vulkan_device, shadow_format, settings.shadow_map_size, settings.shadow_cascades,
+			settings.vertex_layout, settings.shadow_depth_bias, settings.shadow_slope_bias);
+		shadows->set_light_direction(settings.light_direction);
+		//Also referenced by the frame descriptor sets, the lists are only built with compute on the graphics queue
+		clusterer = std::make_unique<Light_clusterer>(vulkan_device, frames_in_flight, settings.cluster_grid, settings.max_lights,
+			settings.light_indices_per_cluster);
+		create_swap_chain(VK_NULL_HANDLE);
+		active_camera = cameras.insert(Free_camera(aspect_ratio));
 		create_image_views();
-		create_render_passes();
+		build_render_graph();
 		create_descriptor_set_layout();
 		create_graphics_pipeline();
+		create_cull_pipeline();
 		create_command_pool();
-		create_colour_resources();
-		create_depth_resources();
-		create_framebuffers();
+		create_post_pipeline();
 
-		models.emplace_back(std::make_unique<Model>(R"(src\models\teapot.obj)", R"(src\tex\tex1.jpg)", 0.4f, 1.0f, -0.3f, swap_chain_images.size(), command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.at(0)->init_model();
-		models.at(0)->scale(0.5f);
-		models.at(0)->switch_animated_rotation();
-		models.emplace_back(std::make_unique<Model>(R"(src\models\sphere.obj)", 2.0f, 2.0f, 0.0f, swap_chain_images.size(), command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.at(1)->init_model();
-		create_semaphores_and_fences();
+		frame_timeline = vulkan_device->create_timeline_semaphore(0);
+		create_frame_resources();
 
 	}
 	Engine::~Engine()
 	{
+		//Workers only touch the CPU side of their models, which are dropped unused
+		for (auto& load : stream_loads)
+			load.prepared.wait();
+		stream_loads.clear();
+		deletion_queue.flush_all();
 		if (enable_validation_layers)
 			destroy_debug_utils_messenger_EXT(instance, messenger, nullptr);
 		clean_swap_chain();
-		for (int i = 0; i < models.size(); ++i)
+		for (const auto& model : models)
 		{
-		vkDestroySampler(vulkan_device->get_device(), models.at(i)->get_texture_sampler(), nullptr);
-		vkDestroyImageView(vulkan_device->get_device(), models.at(i)->get_texture_img_view(), nullptr);
-		vkDestroyImage(vulkan_device->get_device(), models.at(i)->get_texture_img(), nullptr);
-		vkFreeMemory(vulkan_device->get_device(), models.at(i)->get_texture_memory(), nullptr);
-		vkDestroyBuffer(vulkan_device->get_device(), models.at(i)->get_index_buffer(), nullptr);
-		vkFreeMemory(vulkan_device->get_device(), models.at(i)->get_index_buffer_memory(), nullptr);
-		vkDestroyBuffer(vulkan_device->get_device(), models.at(i)->get_vertex_buffer(), nullptr);
-		vkFreeMemory(vulkan_device->get_device(), models.at(i)->get_vertex_buffer_memory(), nullptr);
+		vkDestroySampler(vulkan_device->get_device(), model->get_texture_sampler(), nullptr);
+		vkDestroyImageView(vulkan_device->get_device(), model->get_texture_img_view(), nullptr);
+		vkDestroyDescriptorPool(vulkan_device->get_device(), model->get_descriptor_pool(), nullptr);
 		}
+		destroy_frame_resources();
+		//Mesh buffers and textures, live or waiting for reuse, all belong to the pool
+		resource_pool->destroy_all();
+		vkDestroyPipeline(vulkan_device->get_device(), cull_pipeline, nullptr);
+		vkDestroyPipelineLayout(vulkan_device->get_device(), cull_pipeline_layout, nullptr);
+		vkDestroyDescriptorSetLayout(vulkan_device->get_device(), cull_set_layout, nullptr);
+		occlusion.reset();
+		hdr.reset();
+		shadows.reset();
+		clusterer.reset();
+		vkDestroySemaphore(vulkan_device->get_device(), frame_timeline, nullptr);
 		vkDestroyDescriptorSetLayout(vulkan_device->get_device(), descriptor_set_layout, nullptr);
-		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-		{
-			vkDestroySemaphore(vulkan_device->get_device(), image_available_semaphores.at(i), nullptr);
-			vkDestroySemaphore(vulkan_device->get_device(), rendering_finished_semaphores.at(i), nullptr);
-			vkDestroyFence(vulkan_device->get_device(), in_flight_fences.at(i), nullptr);
-		}
+		vkDestroyDescriptorSetLayout(vulkan_device->get_device(), frame_set_layout, nullptr);
 		vkDestroyCommandPool(vulkan_device->get_device(), command_pool, nullptr);
+		vulkan_device->destroy_upload_objects();
 		vkDestroyDevice(vulkan_device->get_device(), nullptr);
 		vkDestroySurfaceKHR(instance, surface, nullptr);
 		vkDestroyInstance(instance, nullptr);
@@ -100,13 +125,15 @@ float Engine::last_frame = 0.0f;
 	}
 	void Engine::run()
 	{
-		create_command_buffers();
 		info();
 		while (!glfwWindowShouldClose(window))
 		{
+			limit_frame_rate();
 			float current_frame = glfwGetTime();
 			delta_time = current_frame - last_frame;
 			last_frame = current_frame;
+			if (settings.measure_latency)
+				input_time = std::chrono::steady_clock::now();
 			glfwPollEvents();
 			process_input();
 			draw_frame();		
@@ -129,159 +156,536 @@ float Engine::last_frame = 0.0f;
 		recreate_swap_chain();
 
 	}
-	void Engine::change_texture(const int id, const std::string& path)
+	void Engine::change_texture(const Model_handle id, const std::string& path)
+	{
+		//The old texture stays alive until every frame already submitted has finished with it
+		retire_texture(*models.get(id));
+		models.get(id)->assign_texture(path);
+		detach_model(id);
+	}
+	void Engine::change_mesh(const Model_handle id, const std::string& path)
+	{
+		shadows->invalidate();
+		retire_mesh(*models.get(id));
+		models.get(id)->assign_mesh(path);
+		detach_model(id);
+		Entity entity = get_entity(id);
+		scene.get<Material_component>().get(entity).pipeline = models.get(id)->has_vertex_colour() ? 1 : 0;
+		Bounds_component& bounds = scene.get<Bounds_component>().get(entity);
+		bounds.local_centre = models.get(id)->get_bounds_centre();
+		bounds.local_radius = models.get(id)->get_bounds_radius();
+	}
+	void Engine::retire_texture(const Model& model)
+	{
+		//The old texture stays alive until every frame already submitted has finished with it, then the image is recycled
+		VkDevice device = vulkan_device->get_device();
+		std::shared_ptr<Resource_pool> pool = resource_pool;
+		VkDescriptorPool descriptor_pool = model.get_descriptor_pool();
+		VkSampler sampler = model.get_texture_sampler();
+		VkImageView view = model.get_texture_img_view();
+		VkImage img = model.get_texture_img();
+		//A texture dropped before its upload was acquired is never handed to the graphics queue, only the copy is waited for
+		vulkan_device->wait_upload(model.get_upload_value());
+		vulkan_device->cancel_acquires({}, img);
+		deletion_queue.push(frame_number, [=]() {
+			vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+			vkDestroySampler(device, sampler, nullptr);
+			vkDestroyImageView(device, view, nullptr);
+			pool->release_image(img);
+		});
+	}
+	void Engine::retire_mesh(const Model& model)
+	{
+		VkDevice device = vulkan_device->get_device();
+		std::shared_ptr<Resource_pool> pool = resource_pool;
+		VkBuffer vertex_buffer = model.get_vertex_buffer(), position_buffer = model.get_position_buffer(), index_buffer = model.get_index_buffer();
+		VkBuffer meshlet_buffer = model.get_meshlet_buffer(), indirect_buffer = model.get_indirect_buffer();
+		VkDescriptorPool cull_pool = model.get_cull_descriptor_pool();
+		vulkan_device->wait_upload(model.get_upload_value());
+		vulkan_device->cancel_acquires({ vertex_buffer, position_buffer, index_buffer, meshlet_buffer }, VK_NULL_HANDLE);
+		deletion_queue.push(frame_number, [=]() {
+			pool->release_buffer(vertex_buffer);
+			pool->release_buffer(position_buffer);
+			pool->release_buffer(index_buffer);
+			pool->release_buffer(meshlet_buffer);
+			pool->release_buffer(indirect_buffer);
+			vkDestroyDescriptorPool(device, cull_pool, nullptr);
+		});
+	}
+	void Engine::detach_model(const Model_handle id)
+	{
+		//New resources of the model aren't usable before their upload, until then it isn't drawn
+		scene.get<Mesh_component>().remove(get_entity(id));
+		if (std::find(pending_models.begin(), pending_models.end(), id) == pending_models.end())
+			pending_models.push_back(id);
+	}
+	void Engine::attach_uploaded_models()
+	{
+		//Acquires of completed uploads are recorded at the start of this frame, so their models can be drawn in it
+		completed_upload = vulkan_device->collect_uploads();
+		for (auto it = pending_models.begin(); it != pending_models.end();)
+		{
+			if (models.contains(*it) && models.get(*it)->get_upload_value() > completed_upload)
+			{
+				++it;
+				continue;
+			}
+			if (models.contains(*it))
+			{
+				scene.get<Mesh_component>().emplace(get_entity(*it), { *it });
+				shadows->invalidate();
+			}
+			it = pending_models.erase(it);
+		}
+	}
+	void Engine::destroy_model(const Model_handle id)
 	{
-		vkFreeCommandBuffers(vulkan_device->get_device(), command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
-		vkDestroyDescriptorPool(vulkan_device->get_device(), models.at(id)->get_descriptor_pool(), nullptr);
-		vkDestroySampler(vulkan_device->get_device(), models.at(id)->get_texture_sampler(), nullptr);
-		vkDestroyImageView(vulkan_device->get_device(), models.at(id)->get_texture_img_view(), nullptr);
-		vkDestroyImage(vulkan_device->get_device(), models.at(id)->get_texture_img(), nullptr);
-		vkFreeMemory(vulkan_device->get_device(), models.at(id)->get_texture_memory(), nullptr);
-
-		models.at(id)->assign_texture(path);
+		const Model& model = *models.get(id);
+		retire_texture(model);
+		retire_mesh(model);
+		shadows->invalidate();
+		Entity entity = get_entity(id);
+		transforms.remove_node(scene.get<Transform_component>().get(entity).node);
+		scene.destroy(entity);
+		models.remove(id);
+	}
+	void Engine::replace_model(const Model_handle id, const std::string& model_path, const std::string& tex_path)
+	{
+		change_mesh(id, model_path);
+		change_texture(id, tex_path);
+	}
+	bool Engine::is_model_alive(const Model_handle id) const
+	{
+		return models.contains(id);
+	}
+	void Engine::add_streamed_model(const std::string& model_path, const float x, const float y, const float z)
+	{
+		streamer.add_object({ model_path, "", glm::vec3(x, y, z) });
+	}
+	void Engine::add_streamed_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z)
+	{
+		streamer.add_object({ model_path, tex_path, glm::vec3(x, y, z) });
+	}
+	void Engine::set_streaming_radii(const float load_radius, const float unload_radius)
+	{
+		settings.stream_load_radius = load_radius;
+		settings.stream_unload_radius = unload_radius;
+		streamer.set_radii(load_radius, unload_radius);
+	}
+	void Engine::set_streaming_budget(const VkDeviceSize bytes)
+	{
+		settings.stream_budget = bytes;
+		streamer.set_budget(bytes);
+	}
+	VkDeviceSize Engine::get_streamed_memory() const
+	{
+		return streamer.get_resident_bytes();
+	}
+	void Engine::stream_scene()
+	{
+		std::vector<Cell_key> to_unload, to_load;
+		streamer.plan(current_camera().get_position_vector(), to_unload, to_load);
+		for (const auto& key : to_unload)
+			for (const auto& handle : streamer.mark_unloaded(key))
+				if (models.contains(handle))
+					destroy_model(handle);
+		//Finished cells only create their resources here, the uploads don't wait either
+		for (auto it = stream_loads.begin(); it != stream_loads.end();)
+		{
+			if (it->prepared.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+			finish_stream_load(*it);
+			it = stream_loads.erase(it);
+		}
+		//Files are read and meshes processed on worker threads, so a load never stalls the frame on the disk
+		for (const auto& key : to_load)
+		{
+			if (stream_loads.size() >= settings.stream_concurrent_loads)
+				break;
+			if (std::any_of(stream_loads.begin(), stream_loads.end(), [&](const Stream_load& load) { return load.cell == key; }))
+				continue;
+			Stream_load load{ key, {}, {} };
+			for (const auto& object : streamer.get_objects(key))
+			{
+				load.models.push_back(object.texture_path.empty()
+					? std::make_unique<Model>(object.model_path, object.position.x, object.position.y, object.position.z, frames_in_flight,
+						command_pool, graphics_queue, descriptor_set_layout, vulkan_device)
+					: std::make_unique<Model>(object.model_path, object.texture_path, object.position.x, object.position.y, object.position.z,
+						frames_in_flight, command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
+				configure_model(*load.models.back());
+			}
+			std::vector<Model*> prepared_models;
+			for (const auto& model : load.models)
+				prepared_models.push_back(model.get());
+			load.prepared = std::async(std::launch::async, [prepared_models]() {
+				for (auto model : prepared_models)
+					model->prepare();
+			});
+			stream_loads.push_back(std::move(load));
+		}
+	}
+	void Engine::finish_stream_load(Stream_load& load)
+	{
+		//Rethrows what failed on the worker thread
+		load.prepared.get();
+		std::vector<Model_handle> handles;
+		VkDeviceSize bytes = 0;
+		for (auto& model : load.models)
+		{
+			model->create_resources();
+			bytes += model->get_memory_size();
+			handles.push_back(register_model(std::move(model)));
+		}
+		streamer.mark_loaded(load.cell, handles, bytes);
+	}
+	void Engine::set_mip_generation(Mip_generation generation, Mip_filter filter)
+	{
+		settings.mip_generation = generation;
+		settings.mip_filter = filter;
+	}
+	void Engine::set_frames_in_flight(const uint32_t count)
+	{
+		wait_for_frame(frame_number);
+		//Models still loading were created for the old count, they are finished so the loop below resizes them too
+		for (auto& load : stream_loads)
+			finish_stream_load(load);
+		stream_loads.clear();
+		destroy_frame_resources();
+		frames_in_flight = settings.frames_in_flight = std::max(1u, count);
+		current_frame = 0;
+		for (const auto& model : models)
+			model->set_frames_in_flight(frames_in_flight);
+		if (occlusion)
+			occlusion->set_frames_in_flight(frames_in_flight);
+		clusterer->set_frames_in_flight(frames_in_flight);
+		create_frame_resources();
+	}
+	uint64_t Engine::get_submitted_frame() const
+	{
+		return frame_number;
+	}
+	uint64_t Engine::get_completed_frame()
+	{
+		return vulkan_device->get_timeline_value(frame_timeline);
+	}
+	void Engine::wait_for_frame(const uint64_t frame)
+	{
+		vulkan_device->wait_timeline(frame_timeline, std::min(frame, frame_number));
+	}
+	void Engine::set_present_mode(VkPresentModeKHR mode)
+	{
+		settings.present_mode = mode;
+		rebuild_swap_chain();
+	}
+	void Engine::set_frame_limit(const float fps)
+	{
+		settings.target_fps = std::max(0.0f, fps);
+		next_frame_deadline = std::chrono::steady_clock::now();
+	}
+	void Engine::set_latency_measurement(const bool enabled)
+	{
+		settings.measure_latency = enabled;
+		latency = Latency_stats{};
+		last_present_time = std::chrono::steady_clock::time_point{};
+	}
+	Latency_stats Engine::get_latency_stats() const
+	{
+		return latency;
+	}
+	void Engine::set_msaa_samples(const uint32_t samples)
+	{
+		settings.msaa_samples = std::max(1u, samples);
+		recreate_swap_chain();
+	}
+	void Engine::set_anti_aliasing(Anti_aliasing mode)
+	{
+		settings.anti_aliasing = mode;
+		recreate_swap_chain();
+	}
+	void Engine::set_depth_prepass(const bool enabled)
+	{
+		settings.depth_prepass = enabled;
+		recreate_swap_chain();
+	}
+	void Engine::set_occlusion_culling(const bool enabled)
+	{
+		settings.occlusion_culling = enabled;
+		recreate_swap_chain();
+	}
+	void Engine::set_shadows(const bool enabled)
+	{
+		settings.shadows = enabled;
+		//Casters kept changing while shadows were off
+		shadows->invalidate();
+	}
+	void Engine::set_light_direction(const float x, const float y, const float z)
+	{
+		settings.light_direction = glm::vec3(x, y, z);
+		shadows->set_light_direction(settings.light_direction);
+	}
+	Light_handle Engine::create_point_light(const float x, const float y, const float z, const float range, const float r, const float g, const float b, const float intensity)
+	{
+		//Cone cosines below -1 let the spot factor of the shader reach every direction
+		Light_data light{};
+		light.position_range = glm::vec4(x, y, z, range);
+		light.colour_intensity = glm::vec4(r, g, b, intensity);
+		light.direction_outer = glm::vec4(0.0f, -1.0f, 0.0f, -2.0f);
+		light.spot = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);
+		return lights.insert(light);
+	}
+	Light_handle Engine::create_spot_light(const float x, const float y, const float z, const float dir_x, const float dir_y, const float dir_z, const float range,
+		const float inner_angle, const float outer_angle, const float r, const float g, const float b, const float intensity)
+	{
+		float outer = std::cos(glm::radians(outer_angle * 0.5f));
+		float inner = std::max(std::cos(glm::radians(inner_angle * 0.5f)), outer + 0.0001f);
+		Light_data light{};
+		light.position_range = glm::vec4(x, y, z, range);
+		light.colour_intensity = glm::vec4(r, g, b, intensity);
+		light.direction_outer = glm::vec4(glm::normalize(glm::vec3(dir_x, dir_y, dir_z)), outer);
+		light.spot = glm::vec4(inner, 0.0f, 0.0f, 0.0f);
+		return lights.insert(light);
+	}
+	void Engine::set_light_position(const Light_handle id, const float x, const float y, const float z)
+	{
+		Light_data& light = lights.get(id);
+		light.position_range = glm::vec4(x, y, z, light.position_range.w);
+	}
+	void Engine::set_light_colour(const Light_handle id, const float r, const float g, const float b, const float intensity)
+	{
+		lights.get(id).colour_intensity = glm::vec4(r, g, b, intensity);
+	}
+	void Engine::destroy_light(const Light_handle id)
+	{
+		lights.remove(id);
+	}
+	void Engine::set_hdr(const bool enabled)
+	{
+		settings.hdr = enabled;
+		recreate_swap_chain();
+	}
+	void Engine::set_bloom(const float threshold, const float intensity)
+	{
+		settings.bloom_threshold = threshold;
+		settings.bloom_intensity = intensity;
+		if (hdr)
+			hdr->set_bloom(threshold, intensity);
+	}
+	void Engine::set_exposure(const float compensation, const float rate)
+	{
+		settings.exposure_compensation = compensation;
+		settings.exposure_adaptation = rate;
+		if (hdr)
+			hdr->set_exposure(settings.exposure_min_log, settings.exposure_max_log, rate, compensation);
+	}
+	void Engine::set_dynamic_resolution(const bool enabled)
+	{
+		settings.dynamic_resolution = enabled;
+		resolution.reset();
+		recreate_swap_chain();
+	}
+	void Engine::set_render_scale_limits(const float min_scale, const float max_scale)
+	{
+		resolution.set_limits(min_scale, max_scale);
+		settings.min_render_scale = min_scale;
+		settings.max_render_scale = max_scale;
+		recreate_swap_chain();
+	}
+	void Engine::set_target_gpu_time(const float ms)
+	{
+		settings.target_gpu_time_ms = ms;
+		resolution.set_target(ms);
+	}
+	void Engine::set_upscale_filter(Upscale_filter filter, const float sharpness)
+	{
+		settings.upscale_filter = filter;
+		settings.sharpness = std::clamp(sharpness, 0.0f, 1.0f);
+	}
+	float Engine::get_render_scale() const
+	{
+		return settings.dynamic_resolution ? resolution.get_scale() : 1.0f;
+	}
+	float Engine::get_gpu_time() const
+	{
+		return gpu_time_ms;
+	}
+	void Engine::set_lod_selection(const float threshold, const float hysteresis)
+	{
+		settings.lod_error_threshold = std::max(0.0f, threshold);
+		settings.lod_hysteresis = std::min(std::max(hysteresis, 0.0f), 1.0f);
 	}
-	void Engine::switch_animated_rotation(const int id)
+	uint32_t Engine::get_model_lod(const Model_handle id) const
 	{
-		models.at(id)->switch_animated_rotation();
+		return models.get(id)->get_lod();
 	}
-	void Engine::create_camera()
+	void Engine::switch_animated_rotation(const Model_handle id)
 	{
-		Free_camera new_camera(aspect_ratio);
-		cameras.emplace_back(new_camera);
-		active_camera = &cameras.at(camera_index);
+		//The model moves between the static and the dynamic shadow casters
+		shadows->invalidate();
+		Entity entity = get_entity(id);
+		auto& animations = scene.get<Animation_component>();
+		if (!animations.contains(entity))
+		{
+			animations.emplace(entity, { 90.0f });
+			return;
+		}
+		animations.remove(entity);
+		auto& transform = scene.get<Transform_component>().get(entity);
+		transform.world = transforms.get_world_matrix(transform.node);
+	}
+	Camera_handle Engine::create_camera()
+	{
+		return cameras.insert(Free_camera(aspect_ratio));
 	}
-	void Engine::create_camera(const float x, const float y, const float z)
+	Camera_handle Engine::create_camera(const float x, const float y, const float z)
 	{
-		Free_camera new_camera(x, y, z, aspect_ratio);
-		cameras.emplace_back(new_camera);
-		active_camera = &cameras.at(camera_index);
+		return cameras.insert(Free_camera(x, y, z, aspect_ratio));
 	}
-	void Engine::translate_camera(const int id, const float x, const float y, const float z)
+	Camera_handle Engine::get_active_camera() const
 	{
-		cameras.at(id).set_translation_vector(x, y, z);
+		return active_camera;
 	}
-	void Engine::set_camera_position(const int id, const float x, const float y, const float z)
+	void Engine::set_active_camera(const Camera_handle camera)
 	{
-		cameras.at(id).set_position_vector(x, y, z);
+		if (!cameras.contains(camera))
+			throw std::runtime_error("Invalid camera handle!\n");
+		active_camera = camera;
 	}
-	void Engine::rotate_camera(const int id, const float yaw, const float pitch, const float roll)
+	Free_camera& Engine::current_camera()
 	{
-		cameras.at(id).set_rotation(yaw, pitch, roll);
-		cameras.at(id).update();
+		return cameras.get(active_camera);
 	}
-	void Engine::change_fov(const int id, const float fov)
+	void Engine::translate_camera(const Camera_handle id, const float x, const float y, const float z)
 	{
-		cameras.at(id).set_fov(fov);
-		cameras.at(id).update();
+		cameras.get(id).set_translation_vector(x, y, z);
 	}
-	void Engine::create_model(const std::string& model_path)
+	void Engine::set_camera_position(const Camera_handle id, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Model>(model_path, swap_chain_images.size(), 
+		cameras.get(id).set_position_vector(x, y, z);
+	}
+	void Engine::rotate_camera(const Camera_handle id, const float yaw, const float pitch, const float roll)
+	{
+		cameras.get(id).set_rotation(yaw, pitch, roll);
+	}
+	void Engine::change_fov(const Camera_handle id, const float fov)
+	{
+		cameras.get(id).set_fov(fov);
+	}
+	Model_handle Engine::create_model(const std::string& model_path)
+	{
+		return add_model(std::make_unique<Model>(model_path, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_model(const std::string& model_path, const float x, const float y, const float z)
+	Model_handle Engine::create_model(const std::string& model_path, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Model>(model_path, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Model>(model_path, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_model(const std::string& model_path, const std::string& tex_path)
+	Model_handle Engine::create_model(const std::string& model_path, const std::string& tex_path)
 	{
-		models.emplace_back(std::make_unique<Model>(model_path, tex_path, swap_chain_images.size(), 
+		return add_model(std::make_unique<Model>(model_path, tex_path, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z)
+	Model_handle Engine::create_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Model>(model_path, tex_path, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Model>(model_path, tex_path, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_sphere(const float radious)
+	Model_handle Engine::create_sphere(const float radious)
 	{
-		models.emplace_back(std::make_unique<Sphere>(radious, swap_chain_images.size(), 
+		return add_model(std::make_unique<Sphere>(radious, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_sphere(const float radious, const float x, const float y, const float z)
+	Model_handle Engine::create_sphere(const float radious, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Sphere>(radious, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Sphere>(radious, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 
 	}
-	void Engine::create_sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z)
+	Model_handle Engine::create_sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Sphere>(radious, tex_path, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Sphere>(radious, tex_path, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_sphere(const float radious, const std::string& tex_path)
+	Model_handle Engine::create_sphere(const float radious, const std::string& tex_path)
 	{
-		models.emplace_back(std::make_unique<Sphere>(radious, tex_path, swap_chain_images.size(), 
+		return add_model(std::make_unique<Sphere>(radious, tex_path, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_plane(const float width, const float height)
+	Model_handle Engine::create_plane(const float width, const float height)
 	{
-		models.emplace_back(std::make_unique<Plane>(width, height, swap_chain_images.size(), 
+		return add_model(std::make_unique<Plane>(width, height, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_plane(const float width, const float height, const float x, const float y, const float z)
+	Model_handle Engine::create_plane(const float width, const float height, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Plane>(width, height, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Plane>(width, height, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_plane(const float width, const float height, const std::string& tex_path)
+	Model_handle Engine::create_plane(const float width, const float height, const std::string& tex_path)
 	{
-		models.emplace_back(std::make_unique<Plane>(width, height, tex_path, swap_chain_images.size(), 
+		return add_model(std::make_unique<Plane>(width, height, tex_path, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z)
+	Model_handle Engine::create_plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Plane>(width, height, tex_path, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Plane>(width, height, tex_path, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_box(const float width, const float height, const float length)
+	Model_handle Engine::create_box(const float width, const float height, const float length)
 	{
-		models.emplace_back(std::make_unique<Box>(width, height, length, swap_chain_images.size(), 
+		return add_model(std::make_unique<Box>(width, height, length, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_box(const float width, const float height, const float length, const float x, const float y, const float z)
+	Model_handle Engine::create_box(const float width, const float height, const float length, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Box>(width, height, length, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Box>(width, height, length, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_box(const float width, const float height, const float length, const std::string& tex_path)
+	Model_handle Engine::create_box(const float width, const float height, const float length, const std::string& tex_path)
 	{
-		models.emplace_back(std::make_unique<Box>(width, height, length, tex_path, swap_chain_images.size(),
+		return add_model(std::make_unique<Box>(width, height, length, tex_path, frames_in_flight,
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::create_box(const float width, const float height, const float length, const std::string& tex_path, const float x, const float y, const float z)
+	Model_handle Engine::create_box(const float width, const float height, const float length, const std::string& tex_path, const float x, const float y, const float z)
 	{
-		models.emplace_back(std::make_unique<Box>(width, height, length, tex_path, x, y, z, swap_chain_images.size(), 
+		return add_model(std::make_unique<Box>(width, height, length, tex_path, x, y, z, frames_in_flight, 
 			command_pool, graphics_queue, descriptor_set_layout, vulkan_device));
-		models.back()->init_model();
 	}
-	void Engine::translate_model(const int id, const float x, const float y, const float z)
+	void Engine::translate_model(const Model_handle id, const float x, const float y, const float z)
+	{
+		transforms.translate(get_model_node(id), glm::vec3(x, y, z));
+	}
+	void Engine::rotate_model(const Model_handle id, const float x, const float y, const float z)
+	{
+		transforms.rotate(get_model_node(id), glm::angleAxis(glm::radians(x), glm::vec3(1.0f, 0.0f, 0.0f))
+			* glm::angleAxis(glm::radians(y), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::angleAxis(glm::radians(z), glm::vec3(0.0f, 0.0f, 1.0f)));
+	}
+	void Engine::scale_model(const Model_handle id, const float x, const float y, const float z)
 	{
-		models.at(id)->translate(x, y, z);
+		if (x != 0.0f && y != 0.0f && z != 0.0f)
+			transforms.scale(get_model_node(id), glm::vec3(x, y, z));
 	}
-	void Engine::rotate_model(const int id, const float x, const float y, const float z)
+	void Engine::set_model_parent(const Model_handle id, const uint32_t parent_node)
 	{
-		models.at(id)->rotate(x, y, z);
+		transforms.set_parent(get_model_node(id), parent_node);
 	}
-	void Engine::scale_model(const int id, const float x, const float y, const float z)
+	uint32_t Engine::get_model_node(const Model_handle id) const
 	{
-		models.at(id)->scale(x, y, z);
+		return scene.get<Transform_component>().get(get_entity(id)).node;
+	}
+	Entity Engine::get_entity(const Model_handle id) const
+	{
+		//Entities are recycled, so a stale handle must not reach the slot's current entity
+		if (!models.contains(id))
+			throw std::runtime_error("Handle doesn't refer to a live model!\n");
+		return model_entities.at(id.index);
+	}
+	Transform_hierarchy& Engine::get_transform_hierarchy()
+	{
+		return transforms;
 	}
 	bool Engine::check_valid_layer_supp()
 	{
@@ -310,6 +714,8 @@ float Engine::last_frame = 0.0f;
 		uint32_t extension_count{};
 		const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&extension_count);
 		std::vector<const char*> ext(glfw_extensions, extension_count + glfw_extensions);
+		//Needed by VK_KHR_timeline_semaphore on a 1.0 instance
+		ext.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 		if (enable_validation_layers)
 			ext.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		return ext;
@@ -374,15 +780,15 @@ float Engine::last_frame = 0.0f;
 		auto app = reinterpret_cast<Engine*>(glfwGetWindowUserPointer(window));
 		if (key == GLFW_KEY_2 && action == GLFW_RELEASE)
 		{
-			app->camera_index = ++(app->camera_index) % app->cameras.size();
-			app->active_camera = &(app->cameras.at(app->camera_index));
+			app->camera_index = (app->camera_index + 1) % app->cameras.size();
+			app->active_camera = app->cameras.handle_at(app->camera_index);
 		}
 		if (key == GLFW_KEY_F && action == GLFW_PRESS)
 		{
 			app->toogle_wireframe();
 		}
 	}
-	void Engine::create_swap_chain()
+	void Engine::create_swap_chain(VkSwapchainKHR old_swap_chain)
 	{
 		Swap_chain_support_details support_detail = vulkan_device->query_swap_chain_support(vulkan_device->get_physical_device());
 		VkPresentModeKHR pres_mode = choose_presentation_mode(support_detail.presentation_modes);
@@ -400,11 +806,22 @@ float Engine::last_frame = 0.0f;
 		swap_info.imageColorSpace = surf_format.colorSpace;
 		swap_info.imageArrayLayers = 1;
 		swap_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		//Tonemapping writes the swap chain image directly when it can be a storage image, otherwise its result is blitted in.
+		//A post pass draws into the swap chain itself
+		swap_chain_storage = false;
+		if (uses_hdr() && !uses_post_pass())
+		{
+			VkFormatProperties format_properties = vulkan_device->get_format_properties(surf_format.format);
+			swap_chain_storage = vulkan_device->supports_storage_write_without_format()
+				&& (support_detail.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT)
+				&& (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+			swap_info.imageUsage |= swap_chain_storage ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
 		swap_info.preTransform = support_detail.capabilities.currentTransform;
 		swap_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		swap_info.clipped = VK_TRUE;
 		swap_info.presentMode = pres_mode;
-		swap_info.oldSwapchain = VK_NULL_HANDLE;
+		swap_info.oldSwapchain = old_swap_chain;
 		Queue_family_indecies ind = vulkan_device->find_queue_family_indicies(vulkan_device->get_physical_device());
 		std::array<uint32_t, 2> queue_family_indecies = { ind.graphics_family.value(), ind.present_family.value() };
 		if (ind.graphics_family != ind.present_family)
@@ -424,8 +841,33 @@ float Engine::last_frame = 0.0f;
 		vkGetSwapchainImagesKHR(vulkan_device->get_device(), swap_chain, &image_count, swap_chain_images.data());
 
 		aspect_ratio = static_cast<float>(swap_chain_extent.width) / static_cast<float>(swap_chain_extent.height);
+		target_extent = {};
+		target_extent = get_scaled_extent(settings.dynamic_resolution ? resolution.get_max_scale() : 1.0f);
+		render_extent = settings.dynamic_resolution ? get_scaled_extent(resolution.get_scale()) : target_extent;
 
 	}
+	void Engine::rebuild_swap_chain()
+	{
+		//A size change invalidates the attachments and pipeline too, which only the full path rebuilds
+		Swap_chain_support_details support_detail = vulkan_device->query_swap_chain_support(vulkan_device->get_physical_device());
+		VkExtent2D extent = choose_swap_extend(support_detail.capabilities);
+		if (framebuffer_resized || extent.width != swap_chain_extent.width || extent.height != swap_chain_extent.height)
+		{
+			framebuffer_resized = false;
+			recreate_swap_chain();
+			return;
+		}
+		wait_for_frame(frame_number);
+		for (const auto& view : swap_chain_img_views)
+			vkDestroyImageView(vulkan_device->get_device(), view, nullptr);
+		VkSwapchainKHR old_swap_chain = swap_chain;
+		create_swap_chain(old_swap_chain);
+		vkDestroySwapchainKHR(vulkan_device->get_device(), old_swap_chain, nullptr);
+		create_image_views();
+		render_graph->update_import(swap_chain_target, swap_chain_images, swap_chain_img_views);
+		if (hdr_pass != Render_graph::NO_PASS && swap_chain_storage)
+			hdr->set_output(swap_chain_img_views, true);
+	}
 	void Engine::create_image_views()
 	{
 		swap_chain_img_views.resize(swap_chain_images.size());
@@ -436,34 +878,276 @@ float Engine::last_frame = 0.0f;
 	}
 	void Engine::create_descriptor_set_layout()
 	{
-		VkDescriptorSetLayoutBinding ubo_binding{};
-		ubo_binding.binding = 0;
-		ubo_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		ubo_binding.descriptorCount = 1;
-		ubo_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		//Frame uniforms, the cached static and the per-frame dynamic shadow maps, then the lights and their cluster lists
+		std::array<VkDescriptorSetLayoutBinding, 6> frame_bindings{};
+		for (uint32_t i = 0; i < frame_bindings.size(); ++i)
+		{
+			frame_bindings.at(i).binding = i;
+			frame_bindings.at(i).descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+				: i < 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			frame_bindings.at(i).descriptorCount = 1;
+			frame_bindings.at(i).stageFlags = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = static_cast<uint32_t>(frame_bindings.size());
+		layout_info.pBindings = frame_bindings.data();
+		if (vkCreateDescriptorSetLayout(vulkan_device->get_device(), &layout_info, nullptr, &frame_set_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create descriptor set layout!\n");
+
 		VkDescriptorSetLayoutBinding sampler_binding{};
 		sampler_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		sampler_binding.binding = sampler_binding.descriptorCount = 1;
+		sampler_binding.binding = 0;
+		sampler_binding.descriptorCount = 1;
 		sampler_binding.pImmutableSamplers = nullptr;
 		sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { ubo_binding, sampler_binding };
-
-		VkDescriptorSetLayoutCreateInfo layout_info{};
-		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
-		layout_info.pBindings = bindings.data();
+		layout_info.bindingCount = 1;
+		layout_info.pBindings = &sampler_binding;
 		if (vkCreateDescriptorSetLayout(vulkan_device->get_device(), &layout_info, nullptr, &descriptor_set_layout) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create descriptor set layout!\n");
-
-
 	}
 	void Engine::create_graphics_pipeline()
+	{
+		VkDescriptorSetLayout set_layouts[] = { frame_set_layout, descriptor_set_layout };
+		VkPushConstantRange push_range{};
+		push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_range.offset = 0;
+		push_range.size = sizeof(Draw_constants);
+		VkPipelineLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layout_info.setLayoutCount = 2;
+		layout_info.pSetLayouts = set_layouts;
+		layout_info.pushConstantRangeCount = 1;
+		layout_info.pPushConstantRanges = &push_range;
+		if (vkCreatePipelineLayout(vulkan_device->get_device(), &layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create pipeline layout!\n");
+		//Meshes with a constant colour use the variant without a colour stream
+		pipelines.at(0) = create_pipeline_variant(false);
+		pipelines.at(1) = create_pipeline_variant(true);
+		depth_pipeline = uses_depth_prepass() ? create_depth_pipeline() : VK_NULL_HANDLE;
+	}
+	void Engine::create_cull_pipeline()
+	{
+		if (settings.meshlet_culling == Meshlet_culling::gpu && !vulkan_device->graphics_supports_compute())
+			settings.meshlet_culling = Meshlet_culling::cpu;
+		if (settings.meshlet_culling != Meshlet_culling::gpu)
+			return;
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); ++i)
+		{
+			bindings.at(i).binding = i;
+			bindings.at(i).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings.at(i).descriptorCount = 1;
+			bindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo set_layout_info{};
+		set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		set_layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		set_layout_info.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(vulkan_device->get_device(), &set_layout_info, nullptr, &cull_set_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create culling descriptor set layout!\n");
+		VkPushConstantRange push_range{};
+		push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_range.size = sizeof(Cull_constants);
+		VkPipelineLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layout_info.setLayoutCount = 1;
+		layout_info.pSetLayouts = &cull_set_layout;
+		layout_info.pushConstantRangeCount = 1;
+		layout_info.pPushConstantRanges = &push_range;
+		if (vkCreatePipelineLayout(vulkan_device->get_device(), &layout_info, nullptr, &cull_pipeline_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create culling pipeline layout!\n");
+		Shader compute_shader(R"(src\meshlet_cull.spv)", vulkan_device->get_device());
+		VkShaderModule compute_module = compute_shader.create_shader_module();
+		VkComputePipelineCreateInfo pipeline_info{};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeline_info.stage.module = compute_module;
+		pipeline_info.stage.pName = "main";
+		pipeline_info.layout = cull_pipeline_layout;
+		if (vkCreateComputePipelines(vulkan_device->get_device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &cull_pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create culling pipeline!\n");
+		vkDestroyShaderModule(vulkan_device->get_device(), compute_module, nullptr);
+	}
+	void Engine::create_post_pipeline()
+	{
+		if (!uses_post_pass())
+			return;
+		VkDevice device = vulkan_device->get_device();
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		VkDescriptorSetLayoutCreateInfo set_layout_info{};
+		set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		set_layout_info.bindingCount = 1;
+		set_layout_info.pBindings = &binding;
+		if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &post_set_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create post-process descriptor set layout!\n");
+		VkPushConstantRange push_range{};
+		push_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		push_range.size = sizeof(Post_constants);
+		VkPipelineLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layout_info.setLayoutCount = 1;
+		layout_info.pSetLayouts = &post_set_layout;
+		layout_info.pushConstantRangeCount = 1;
+		layout_info.pPushConstantRanges = &push_range;
+		if (vkCreatePipelineLayout(device, &layout_info, nullptr, &post_pipeline_layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create post-process pipeline layout!\n");
+
+		//FXAA and upscaling rely on bilinear taps between texels
+		VkSamplerCreateInfo sampler_info{};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = sampler_info.minFilter = VK_FILTER_LINEAR;
+		sampler_info.addressModeU = sampler_info.addressModeV = sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		if (vkCreateSampler(device, &sampler_info, nullptr, &post_sampler) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create post-process sampler!\n");
+		VkDescriptorPoolSize pool_size{};
+		pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_size.descriptorCount = 1;
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+		pool_info.maxSets = 1;
+		if (vkCreateDescriptorPool(device, &pool_info, nullptr, &post_descriptor_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create post-process descriptor pool!\n");
+		VkDescriptorSetAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = post_descriptor_pool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &post_set_layout;
+		if (vkAllocateDescriptorSets(device, &alloc_info, &post_descriptor_set) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate post-process descriptor set!\n");
+		VkDescriptorImageInfo img_info{};
+		img_info.sampler = post_sampler;
+		img_info.imageView = render_graph->get_image_view(scene_target);
+		img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		VkWriteDescriptorSet descriptor_write{};
+		descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_write.dstSet = post_descriptor_set;
+		descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptor_write.descriptorCount = 1;
+		descriptor_write.pImageInfo = &img_info;
+		vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+
+		//FXAA reads the scaled scene directly, so it doubles as the upscale when both are on
+		std::string fragment_path = settings.anti_aliasing == Anti_aliasing::fxaa ? R"(src\fxaa.spv)" : R"(src\upscale.spv)";
+		Shader vertex_shader(R"(src\fullscreen.spv)", device), fragment_shader(fragment_path, device);
+		VkShaderModule vertex_module = vertex_shader.create_shader_module(), fragment_module = fragment_shader.create_shader_module();
+		std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+		stages.at(0).sType = stages.at(1).sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages.at(0).stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stages.at(0).module = vertex_module;
+		stages.at(1).stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		stages.at(1).module = fragment_module;
+		stages.at(0).pName = stages.at(1).pName = "main";
+		//The triangle is generated from gl_VertexIndex, there are no vertex inputs
+		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		VkPipelineInputAssemblyStateCreateInfo assembly_info{};
+		assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkViewport viewport{};
+		viewport.width = static_cast<float>(swap_chain_extent.width);
+		viewport.height = static_cast<float>(swap_chain_extent.height);
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissors{};
+		scissors.extent = swap_chain_extent;
+		VkPipelineViewportStateCreateInfo viewport_info{};
+		viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewport_info.viewportCount = viewport_info.scissorCount = 1;
+		viewport_info.pViewports = &viewport;
+		viewport_info.pScissors = &scissors;
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.lineWidth = 1.0f;
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		VkPipelineColorBlendAttachmentState colour_blending_att{};
+		colour_blending_att.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+			| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineColorBlendStateCreateInfo colour_blending{};
+		colour_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colour_blending.attachmentCount = 1;
+		colour_blending.pAttachments = &colour_blending_att;
+		VkGraphicsPipelineCreateInfo pipeline_info{};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeline_info.stageCount = static_cast<uint32_t>(stages.size());
+		pipeline_info.pStages = stages.data();
+		pipeline_info.pVertexInputState = &vertex_input_info;
+		pipeline_info.pInputAssemblyState = &assembly_info;
+		pipeline_info.pViewportState = &viewport_info;
+		pipeline_info.pRasterizationState = &rasterizer;
+		pipeline_info.pMultisampleState = &multisampling;
+		pipeline_info.pColorBlendState = &colour_blending;
+		pipeline_info.layout = post_pipeline_layout;
+		pipeline_info.renderPass = post_render_pass;
+		pipeline_info.subpass = render_graph->get_subpass(post_pass);
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &post_pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create post-process pipeline!\n");
+		vkDestroyShaderModule(device, vertex_module, nullptr);
+		vkDestroyShaderModule(device, fragment_module, nullptr);
+	}
+	void Engine::record_cull_pass(VkCommandBuffer command_buffer)
+	{
+		bool culled = false;
+		//Only attached models, the meshlets of one still uploading may not be there yet
+		auto& mesh_pool = scene.get<Mesh_component>();
+		for (uint32_t i = 0; i < mesh_pool.size(); ++i)
+		{
+			const auto& model = models.get(mesh_pool.data()[i].model);
+			if (!model->uses_gpu_culling())
+				continue;
+			if (!culled)
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+			culled = true;
+			Cull_constants constants = model->get_cull_constants(current_frame);
+			VkDescriptorSet set = model->get_cull_descriptor_set();
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout, 0, 1, &set, 0, nullptr);
+			vkCmdPushConstants(command_buffer, cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+			vkCmdDispatch(command_buffer, (constants.meshlet_count + 63) / 64, 1, 1);
+		}
+		if (culled)
+		{
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+		//Enables the draws of objects visible last frame for the early passes
+		if (uses_occlusion_culling())
+			occlusion->record_early(command_buffer, current_frame);
+	}
+	void Engine::record_light_pass(VkCommandBuffer command_buffer)
+	{
+		if (frame_light_count == 0)
+			return;
+		Free_camera& camera = current_camera();
+		glm::mat4 proj = camera.get_projection_matrix();
+		proj[1][1] *= -1;
+		clusterer->record(command_buffer, current_frame, camera.get_view_matrix(), proj, camera.get_near_plane(), camera.get_far_plane());
+	}
+	void Engine::record_occlusion_pass(VkCommandBuffer command_buffer)
+	{
+		glm::mat4 proj = current_camera().get_projection_matrix();
+		proj[1][1] *= -1;
+		occlusion->record_late(command_buffer, current_frame, proj * current_camera().get_view_matrix(), render_extent);
+	}
+	VkPipeline Engine::create_pipeline_variant(const bool with_colour)
 	{
 		//auto vertex_shader = read_shader_file(R"(src\vert.spv)");
 		//auto fragment_shader = read_shader_file(poly_mode.second);
 
-		Shader vertex_shader(R"(src\vert.spv)", vulkan_device->get_device()),
+		Shader vertex_shader(with_colour ? R"(src\vert.spv)" : R"(src\vert_no_colour.spv)", vulkan_device->get_device()),
 			fragment_shader(poly_mode.second, vulkan_device->get_device());
 
 		VkShaderModule vertex_module = vertex_shader.create_shader_module(),
@@ -479,8 +1163,8 @@ float Engine::last_frame = 0.0f;
 		VkPipelineShaderStageCreateInfo pipeline_infos[] = { pipeline_vertex_info, pipeline_fragment_info };
 
 		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-		auto bindings_description = Vertex::get_binding_description();
-		auto attribute_desc = Vertex::get_attribute_descriptions();
+		auto bindings_description = settings.vertex_layout.get_binding_description(with_colour);
+		auto attribute_desc = settings.vertex_layout.get_attribute_descriptions(with_colour);
 		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertex_input_info.pVertexAttributeDescriptions = attribute_desc.data();
 		vertex_input_info.pVertexBindingDescriptions = &bindings_description;
@@ -519,8 +1203,8 @@ float Engine::last_frame = 0.0f;
 
 		VkPipelineMultisampleStateCreateInfo multisampling{};
 		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_TRUE;
-		multisampling.rasterizationSamples = vulkan_device->get_msaa_samples();
+		multisampling.sampleShadingEnable = settings.sample_shading && msaa_samples != VK_SAMPLE_COUNT_1_BIT && vulkan_device->supports_sample_rate_shading();
+		multisampling.rasterizationSamples = msaa_samples;
 		multisampling.minSampleShading = 0.2f;
 
 		VkPipelineColorBlendAttachmentState colour_blending_att{};
@@ -534,28 +1218,22 @@ float Engine::last_frame = 0.0f;
 		colour_blending.attachmentCount = 1;
 		colour_blending.logicOpEnable = VK_FALSE;
 
+		//The rendered area follows the render scale, so it is set while recording
 		VkDynamicState dynamic_states[] = {
 			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
+			VK_DYNAMIC_STATE_SCISSOR
 		};
 		VkPipelineDynamicStateCreateInfo dynamic_state{};
 		dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 		dynamic_state.pDynamicStates = dynamic_states;
 		dynamic_state.dynamicStateCount = 2;
 
-		VkPipelineLayoutCreateInfo layout_info{};
-		layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		layout_info.setLayoutCount = 1;
-		layout_info.pSetLayouts = &descriptor_set_layout;
-		layout_info.pushConstantRangeCount = 0;
-		layout_info.pPushConstantRanges = nullptr;
-		if (vkCreatePipelineLayout(vulkan_device->get_device(), &layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create pipeline layout!\n");
-
 		VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
 		depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depth_stencil_info.depthTestEnable = depth_stencil_info.depthWriteEnable = VK_TRUE;
-		depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS;
+		//After the pre-pass only the nearest surface of each sample is left to shade
+		depth_stencil_info.depthTestEnable = VK_TRUE;
+		depth_stencil_info.depthWriteEnable = uses_depth_prepass() ? VK_FALSE : VK_TRUE;
+		depth_stencil_info.depthCompareOp = uses_depth_prepass() ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
 		depth_stencil_info.depthBoundsTestEnable = depth_stencil_info.stencilTestEnable = VK_FALSE;
 
 		VkGraphicsPipelineCreateInfo graphics_pipeline_info{};
@@ -569,103 +1247,210 @@ float Engine::last_frame = 0.0f;
 		graphics_pipeline_info.pMultisampleState = &multisampling;
 		graphics_pipeline_info.pColorBlendState = &colour_blending;
 		graphics_pipeline_info.layout = pipeline_layout;
-		graphics_pipeline_info.subpass = 0;
+		graphics_pipeline_info.subpass = render_graph->get_subpass(scene_pass);
 		graphics_pipeline_info.renderPass = render_pass;
 		graphics_pipeline_info.pDepthStencilState = &depth_stencil_info;
+		graphics_pipeline_info.pDynamicState = &dynamic_state;
+		VkPipeline pipeline;
 		if (vkCreateGraphicsPipelines(vulkan_device->get_device(), VK_NULL_HANDLE, 1, &graphics_pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create graphics pipeline!\n");
 
 
 		vkDestroyShaderModule(vulkan_device->get_device(), vertex_module, nullptr);
 		vkDestroyShaderModule(vulkan_device->get_device(), fragment_module, nullptr);
+		return pipeline;
 	}
-	void Engine::create_render_passes()
-	{
-		VkAttachmentDescription colour_att{};
-		colour_att.format = swap_chain_image_format;
-		colour_att.samples = vulkan_device->get_msaa_samples();
-		colour_att.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colour_att.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colour_att.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colour_att.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colour_att.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colour_att.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentReference colour_att_ref{};
-		colour_att_ref.attachment = 0;
-		colour_att_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentDescription depth_att{};
-		depth_att.format = find_depth_format();
-		depth_att.samples = vulkan_device->get_msaa_samples();
-		depth_att.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depth_att.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depth_att.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		depth_att.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depth_att.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depth_att.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentReference depth_att_ref{};
-		depth_att_ref.attachment = 1;
-		depth_att_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentDescription colour_att_resolve{};
-		colour_att_resolve.format = swap_chain_image_format;
-		colour_att_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
-		colour_att_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colour_att_resolve.loadOp = colour_att_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colour_att_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colour_att_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colour_att_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		VkAttachmentReference colour_att_resolve_ref{};
-		colour_att_resolve_ref.attachment = 2;
-		colour_att_resolve_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-
-
-		VkSubpassDescription subpass{};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colour_att_ref;
-		subpass.pDepthStencilAttachment = &depth_att_ref;
-		subpass.pResolveAttachments = &colour_att_resolve_ref;
-		std::array<VkAttachmentDescription, 3> attachments = { colour_att, depth_att, colour_att_resolve };
-		VkRenderPassCreateInfo render_pass_info{};
-		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-		render_pass_info.subpassCount = 1;
-		render_pass_info.pAttachments = attachments.data();
-		render_pass_info.pSubpasses = &subpass;
-		VkSubpassDependency subpass_dep{};
-		subpass_dep.srcSubpass = VK_SUBPASS_EXTERNAL;
-		subpass_dep.dstSubpass = subpass_dep.srcAccessMask = 0;
-		subpass_dep.srcStageMask = subpass_dep.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		subpass_dep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		render_pass_info.dependencyCount = 1;
-		render_pass_info.pDependencies = &subpass_dep;
-		if (vkCreateRenderPass(vulkan_device->get_device(), &render_pass_info, nullptr, &render_pass) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create render pass!\n");
-
-	}
-	void Engine::create_framebuffers()
-	{
-		swap_chain_framebuffers.resize(swap_chain_img_views.size());
-		for (int i = 0; i < swap_chain_img_views.size(); ++i)
-		{
-			std::array<VkImageView, 3> attachments = { colour_img_view, depth_img_view, swap_chain_img_views.at(i) };
-			VkFramebufferCreateInfo framebuffer_info{};
-			framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebuffer_info.pAttachments = attachments.data();
-			framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-			framebuffer_info.layers = 1;
-			framebuffer_info.renderPass = render_pass;
-			framebuffer_info.height = swap_chain_extent.height;
-			framebuffer_info.width = swap_chain_extent.width;
-			if (vkCreateFramebuffer(vulkan_device->get_device(), &framebuffer_info, nullptr, &swap_chain_framebuffers.at(i)) != VK_SUCCESS)
-				throw std::runtime_error("Failed to create framebuffer!\n");
+	VkPipeline Engine::create_depth_pipeline()
+	{
+		//Position-only vertex stage and no fragment stage, the rasterizer writes depth by itself
+		Shader vertex_shader(R"(src\vert_depth.spv)", vulkan_device->get_device());
+		VkShaderModule vertex_module = vertex_shader.create_shader_module();
+		VkPipelineShaderStageCreateInfo pipeline_vertex_info{};
+		pipeline_vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_vertex_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		pipeline_vertex_info.module = vertex_module;
+		pipeline_vertex_info.pName = "main";
+
+		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+		auto binding_description = settings.vertex_layout.get_position_binding_description();
+		auto attribute_desc = settings.vertex_layout.get_position_attribute_description();
+		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertex_input_info.pVertexAttributeDescriptions = &attribute_desc;
+		vertex_input_info.pVertexBindingDescriptions = &binding_description;
+		vertex_input_info.vertexAttributeDescriptionCount = vertex_input_info.vertexBindingDescriptionCount = 1;
+
+		VkPipelineInputAssemblyStateCreateInfo assembly_info{};
+		assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		assembly_info.primitiveRestartEnable = VK_FALSE;
+
+		VkPipelineViewportStateCreateInfo viewport_info{};
+		viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewport_info.viewportCount = viewport_info.scissorCount = 1;
+
+		//Has to rasterize exactly like the scene pipelines or the equal test rejects their fragments
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = rasterizer.rasterizerDiscardEnable = rasterizer.depthBiasEnable = VK_FALSE;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.rasterizationSamples = msaa_samples;
+
+		VkPipelineColorBlendStateCreateInfo colour_blending{};
+		colour_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colour_blending.attachmentCount = 0;
+
+		VkDynamicState dynamic_states[] = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+		VkPipelineDynamicStateCreateInfo dynamic_state{};
+		dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamic_state.pDynamicStates = dynamic_states;
+		dynamic_state.dynamicStateCount = 2;
 
+		VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
+		depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depth_stencil_info.depthTestEnable = depth_stencil_info.depthWriteEnable = VK_TRUE;
+		depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS;
+		depth_stencil_info.depthBoundsTestEnable = depth_stencil_info.stencilTestEnable = VK_FALSE;
+
+		VkGraphicsPipelineCreateInfo graphics_pipeline_info{};
+		graphics_pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		graphics_pipeline_info.stageCount = 1;
+		graphics_pipeline_info.pStages = &pipeline_vertex_info;
+		graphics_pipeline_info.pVertexInputState = &vertex_input_info;
+		graphics_pipeline_info.pRasterizationState = &rasterizer;
+		graphics_pipeline_info.pInputAssemblyState = &assembly_info;
+		graphics_pipeline_info.pViewportState = &viewport_info;
+		graphics_pipeline_info.pMultisampleState = &multisampling;
+		graphics_pipeline_info.pColorBlendState = &colour_blending;
+		graphics_pipeline_info.layout = pipeline_layout;
+		graphics_pipeline_info.subpass = render_graph->get_subpass(depth_pass);
+		graphics_pipeline_info.renderPass = render_graph->get_render_pass(depth_pass);
+		graphics_pipeline_info.pDepthStencilState = &depth_stencil_info;
+		graphics_pipeline_info.pDynamicState = &dynamic_state;
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(vulkan_device->get_device(), VK_NULL_HANDLE, 1, &graphics_pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create depth pre-pass pipeline!\n");
+		vkDestroyShaderModule(vulkan_device->get_device(), vertex_module, nullptr);
+		return pipeline;
+	}
+	void Engine::build_render_graph()
+	{
+		msaa_samples = vulkan_device->get_usable_sample_count(settings.msaa_samples);
+		render_graph = std::make_unique<Render_graph>(vulkan_device, settings.merge_subpasses);
+		//Acquired images are waited for at colour output, their old contents are never needed
+		Resource_state acquired{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 };
+		swap_chain_target = render_graph->import_image("swap chain", { swap_chain_image_format, swap_chain_extent }, swap_chain_images, swap_chain_img_views,
+			acquired, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		//Final colour of the scene, either presented directly or read by the HDR chain or the post pass
+		VkFormat colour_format = uses_hdr() ? find_supported_format({ VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT }, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) : swap_chain_image_format;
+		uint32_t output = uses_hdr() || uses_post_pass() ? render_graph->create_image("scene", { colour_format, target_extent }) : swap_chain_target;
+		uint32_t depth = render_graph->create_image("depth", { find_depth_format(), target_extent, msaa_samples });
+		VkClearValue colour_clear{}, depth_clear{};
+		colour_clear.color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		depth_clear.depthStencil = { 1.0f, 0 };
+
+		//Writes the indirect draw buffers, which the graph doesn't track
+		cull_pass = render_graph->add_pass("cull", Pass_type::compute, [this](VkCommandBuffer command_buffer) { record_cull_pass(command_buffer); });
+		render_graph->set_side_effects(cull_pass);
+		//Bins the lights into the cluster lists read by the scene passes, also outside the graph
+		light_pass = render_graph->add_pass("light cull", Pass_type::compute, [this](VkCommandBuffer command_buffer) { record_light_pass(command_buffer); });
+		render_graph->set_side_effects(light_pass);
+		uint32_t colour = msaa_samples != VK_SAMPLE_COUNT_1_BIT
+			? render_graph->create_image("multisampled colour", { colour_format, target_extent, msaa_samples }) : output;
+		//Adds an optional depth pass and the scene pass, the first phase clears the attachments and later ones continue on them
+		auto add_geometry = [&](const std::string& name, Occlusion_phase phase, uint32_t& depth_only_pass) {
+			bool first = phase != Occlusion_phase::late;
+			depth_only_pass = Render_graph::NO_PASS;
+			if (uses_depth_prepass())
+			{
+				depth_only_pass = render_graph->add_pass("depth prepass" + name, Pass_type::graphics,
+					[this, phase](VkCommandBuffer command_buffer) { record_depth_pass(command_buffer, phase); });
+				if (first)
+					render_graph->use(depth_only_pass, depth, Graph_access::depth_attachment, depth_clear);
+				else
+					render_graph->use(depth_only_pass, depth, Graph_access::depth_attachment);
+				render_graph->set_render_area(depth_only_pass, render_extent);
+			}
+			uint32_t pass = render_graph->add_pass("scene" + name, Pass_type::graphics,
+				[this, phase](VkCommandBuffer command_buffer) { record_scene_pass(command_buffer, phase); });
+			if (first)
+				render_graph->use(pass, colour, Graph_access::colour_attachment, colour_clear);
+			else
+				render_graph->use(pass, colour, Graph_access::colour_attachment);
+			//Samples are resolved inside the pass, so they never have to leave tile memory. Every phase resolves, which
+			//keeps the render passes of both phases compatible with the same pipelines
+			if (colour != output)
+				render_graph->use(pass, output, Graph_access::resolve_attachment);
+			//Depth is complete after the pre-pass, which then becomes the first subpass of the scene render pass
+			if (depth_only_pass != Render_graph::NO_PASS)
+				render_graph->use(pass, depth, Graph_access::depth_read);
+			else if (first)
+				render_graph->use(pass, depth, Graph_access::depth_attachment, depth_clear);
+			else
+				render_graph->use(pass, depth, Graph_access::depth_attachment);
+			render_graph->set_render_area(pass, render_extent);
+			return pass;
+		};
+		occlusion_pass = late_depth_pass = late_scene_pass = Render_graph::NO_PASS;
+		if (uses_occlusion_culling())
+		{
+			scene_pass = add_geometry(" early", Occlusion_phase::early, depth_pass);
+			//Reduces the early depth into the pyramid and enables the draws of objects that became visible
+			occlusion_pass = render_graph->add_pass("occlusion cull", Pass_type::compute, [this](VkCommandBuffer command_buffer) { record_occlusion_pass(command_buffer); });
+			render_graph->use(occlusion_pass, depth, Graph_access::sampled);
+			render_graph->set_side_effects(occlusion_pass);
+			late_scene_pass = add_geometry(" late", Occlusion_phase::late, late_depth_pass);
+		}
+		else
+			scene_pass = add_geometry("", Occlusion_phase::all, depth_pass);
+		scene_target = output;
+		hdr_pass = blit_pass = Render_graph::NO_PASS;
+		if (uses_hdr())
+		{
+			//Tonemapping leaves a display ready image, the one the post pass or the blit reads unless it is the swap chain
+			tonemap_target = swap_chain_storage ? swap_chain_target : render_graph->create_image("tonemapped", { VK_FORMAT_R16G16B16A16_SFLOAT, target_extent });
+			hdr_pass = render_graph->add_pass("hdr", Pass_type::compute, [this](VkCommandBuffer command_buffer) { record_hdr_pass(command_buffer); });
+			render_graph->use(hdr_pass, output, Graph_access::sampled);
+			render_graph->use(hdr_pass, tonemap_target, Graph_access::storage_write);
+			scene_target = tonemap_target;
+			if (!uses_post_pass() && !swap_chain_storage)
+			{
+				blit_pass = render_graph->add_pass("blit", Pass_type::compute, [this](VkCommandBuffer command_buffer) { record_blit_pass(command_buffer); });
+				render_graph->use(blit_pass, tonemap_target, Graph_access::transfer_read);
+				render_graph->use(blit_pass, swap_chain_target, Graph_access::transfer_write);
+			}
 		}
+		post_pass = Render_graph::NO_PASS;
+		if (uses_post_pass())
+		{
+			post_pass = render_graph->add_pass("post", Pass_type::graphics, [this](VkCommandBuffer command_buffer) { record_post_pass(command_buffer); });
+			render_graph->use(post_pass, scene_target, Graph_access::sampled);
+			render_graph->use(post_pass, swap_chain_target, Graph_access::colour_attachment);
+		}
+		render_graph->compile();
+		render_graph->realize();
+		render_pass = render_graph->get_render_pass(scene_pass);
+		if (occlusion_pass != Render_graph::NO_PASS)
+			occlusion->create_pyramid(render_graph->get_image_view(depth), msaa_samples, target_extent);
+		else if (occlusion)
+			occlusion->destroy_pyramid();
+		if (hdr_pass != Render_graph::NO_PASS)
+		{
+			hdr->create_targets(render_graph->get_image_view(output), target_extent, settings.bloom_levels);
+			hdr->set_output(swap_chain_storage ? swap_chain_img_views : std::vector<VkImageView>{ render_graph->get_image_view(tonemap_target) }, swap_chain_storage);
+		}
+		else if (hdr)
+			hdr->destroy_targets();
+		post_render_pass = post_pass != Render_graph::NO_PASS ? render_graph->get_render_pass(post_pass) : VK_NULL_HANDLE;
 	}
 	void Engine::create_command_pool()
 	{
@@ -673,10 +1458,39 @@ float Engine::last_frame = 0.0f;
 		VkCommandPoolCreateInfo pool_info{};
 		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		pool_info.queueFamilyIndex = family_indecies.graphics_family.value();
+		pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		if (vkCreateCommandPool(vulkan_device->get_device(), &pool_info, nullptr, &command_pool) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create command pool!\n");
 
 	}
+	Model_handle Engine::add_model(std::unique_ptr<Model> model)
+	{
+		configure_model(*model);
+		model->init_model();
+		return register_model(std::move(model));
+	}
+	void Engine::configure_model(Model& model)
+	{
+		model.set_mip_generation(settings.mip_generation, settings.mip_filter);
+		model.set_vertex_layout(settings.vertex_layout);
+		model.set_mesh_processing(settings.optimize_meshes, settings.use_mesh_cache, settings.lod_levels);
+		model.set_meshlet_culling(settings.meshlet_culling, settings.meshlet_min_triangles, cull_set_layout);
+		model.set_resource_pool(resource_pool);
+	}
+	Model_handle Engine::register_model(std::unique_ptr<Model> model)
+	{
+		Entity entity = scene.create();
+		glm::mat4 world = model->get_model_matrix();
+		scene.get<Transform_component>().emplace(entity, { transforms.add_node(Transform_hierarchy::NO_PARENT, world), world });
+		scene.get<Material_component>().emplace(entity, { model->has_vertex_colour() ? 1u : 0u });
+		scene.get<Bounds_component>().emplace(entity, { model->get_bounds_centre(), model->get_bounds_radius(), glm::vec3(0.0f), 0.0f });
+		Model_handle handle = models.insert(std::move(model));
+		pending_models.push_back(handle);
+		if (model_entities.size() <= handle.index)
+			model_entities.resize(handle.index + 1);
+		model_entities.at(handle.index) = entity;
+		return handle;
+	}
 	VkImageView Engine::create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels)
 	{
 		VkImageViewCreateInfo info{};
@@ -693,122 +1507,140 @@ float Engine::last_frame = 0.0f;
 			throw std::runtime_error("Failed to create texture image view!\n");
 		return img_view;
 	}
-	void Engine::create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags flags, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem, uint32_t mip_levels, VkSampleCountFlagBits num_samples)
-	{
-		VkImageCreateInfo img_info{};
-		img_info.mipLevels = mip_levels;
-		img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		img_info.imageType = VK_IMAGE_TYPE_2D;
-		img_info.extent.width = width;
-		img_info.extent.height = height;
-		img_info.extent.depth = img_info.arrayLayers = 1;
-		img_info.format = format;
-		img_info.tiling = tiling;
-		img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		img_info.usage = flags;
-		img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		img_info.samples = num_samples;
-		if (vkCreateImage(vulkan_device->get_device(), &img_info, nullptr, &img) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create texture image!\n");
-		VkMemoryRequirements mem_req{};
-		vkGetImageMemoryRequirements(vulkan_device->get_device(), img, &mem_req);
-		VkMemoryAllocateInfo malloc_info{};
-		malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		malloc_info.allocationSize = mem_req.size;
-		malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, properties);
-		if (vkAllocateMemory(vulkan_device->get_device(), &malloc_info, nullptr, &mem) != VK_SUCCESS)
-			throw std::runtime_error("Failed to allocate texture memory!\n");
-		vkBindImageMemory(vulkan_device->get_device(), img, mem, 0);
-	}
-	VkCommandBuffer Engine::begin_single_time_commands()
+	void Engine::record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index)
 	{
-		VkCommandBufferAllocateInfo alloc_info{};
-		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		alloc_info.commandBufferCount = 1;
-		alloc_info.commandPool = command_pool;
-		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-
-		VkCommandBuffer command_buffer;
-		vkAllocateCommandBuffers(vulkan_device->get_device(), &alloc_info, &command_buffer);
-		VkCommandBufferBeginInfo begin_info{};
-		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		vkBeginCommandBuffer(command_buffer, &begin_info);
-
-		return command_buffer;
-	}
-	void Engine::end_single_time_commands(VkCommandBuffer command_buffer)
-	{
-		vkEndCommandBuffer(command_buffer);
-		VkSubmitInfo submit_info{};
-		submit_info.commandBufferCount = 1;
-		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.pCommandBuffers = &command_buffer;
-		vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-		vkDeviceWaitIdle(vulkan_device->get_device());
-		vkFreeCommandBuffers(vulkan_device->get_device(), command_pool, 1, &command_buffer);
-	}
-	void Engine::transition_image_layout(VkImage img, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels)
-	{
-		auto command_buffer = begin_single_time_commands();
-
-		VkImageMemoryBarrier barrier{};
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.image = img;
-		barrier.oldLayout = old_layout;
-		barrier.newLayout = new_layout;
-		barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		{
-			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			if (has_stencil_component(format))
-				barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-		else
-			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		barrier.subresourceRange.layerCount = 1;
-		barrier.subresourceRange.levelCount = mip_levels;
-		barrier.subresourceRange.baseArrayLayer = barrier.subresourceRange.baseMipLevel = 0;
-		VkPipelineStageFlags source_stage{}, destination_stage{};
-		if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		VkCommandBufferBeginInfo buffer_begin_info{};
+		buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(command_buffer, &buffer_begin_info) != VK_SUCCESS)
+			throw std::runtime_error("Failed to begin recording command buffer!\n");
+		upload_wait = vulkan_device->record_acquires(command_buffer, completed_upload, upload_wait_stages);
+		if (timestamp_pool != VK_NULL_HANDLE)
 		{
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			vkCmdResetQueryPool(command_buffer, timestamp_pool, current_frame * 2, 2);
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool, current_frame * 2);
 		}
-		else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		//Shadow maps are owned by the shadow renderer and complete before the graph samples them
+		shadows->record(command_buffer, shadow_casters);
+		//The render area follows the render scale, the targets keep the size of the largest one
+		for (const auto pass : { depth_pass, scene_pass, late_depth_pass, late_scene_pass })
+			if (pass != Render_graph::NO_PASS)
+				render_graph->set_render_area(pass, render_extent);
+		current_image = image_index;
+		render_graph->execute(command_buffer, image_index);
+		if (timestamp_pool != VK_NULL_HANDLE)
 		{
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool, current_frame * 2 + 1);
+			timestamps_pending.at(current_frame) = true;
 		}
-		else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		{
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
-			source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		}
-		else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to end command buffer recording!\n");
+	}
+	void Engine::record_depth_pass(VkCommandBuffer command_buffer, Occlusion_phase phase)
+	{
+		//Same draws as the scene pass, so both passes see the same levels and meshlets
+		record_draw_list(command_buffer, true, phase);
+	}
+	void Engine::record_scene_pass(VkCommandBuffer command_buffer, Occlusion_phase phase)
+	{
+		record_draw_list(command_buffer, false, phase);
+	}
+	void Engine::record_draw_list(VkCommandBuffer command_buffer, const bool depth_only, Occlusion_phase phase)
+	{
+		VkViewport viewport{};
+		viewport.width = static_cast<float>(render_extent.width);
+		viewport.height = static_cast<float>(render_extent.height);
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		VkRect2D scissors{};
+		scissors.extent = render_extent;
+		vkCmdSetScissor(command_buffer, 0, 1, &scissors);
+		//The draw list is grouped by state, binds matching the previous draw are skipped
+		VkPipeline bound_pipeline = VK_NULL_HANDLE;
+		VkBuffer bound_vertices = VK_NULL_HANDLE, bound_indices = VK_NULL_HANDLE;
+		VkDescriptorSet bound_set = VK_NULL_HANDLE;
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &frame_descriptor_sets.at(current_frame), 0, nullptr);
+		for (const auto& item : draw_list)
 		{
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destination_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			const auto& model = models.get(item.model);
+			//Meshlets culled on the GPU aren't tested for occlusion, they are drawn once in the early phase
+			if (phase == Occlusion_phase::late && model->uses_gpu_culling())
+				continue;
+			VkPipeline pipeline = depth_only ? depth_pipeline : pipelines.at(item.pipeline);
+			if (pipeline != bound_pipeline)
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bound_pipeline = pipeline);
+			VkBuffer vertex_buffer = depth_only ? model->get_position_buffer() : model->get_vertex_buffer();
+			if (vertex_buffer != bound_vertices)
+			{
+				VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &offset);
+				bound_vertices = vertex_buffer;
+			}
+			if (model->get_index_buffer() != bound_indices)
+				vkCmdBindIndexBuffer(command_buffer, bound_indices = model->get_index_buffer(), 0, model->get_index_type());
+			//Depth only draws never sample the material
+			VkDescriptorSet set = model->get_descriptor_set();
+			if (!depth_only && set != bound_set)
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &(bound_set = set), 0, nullptr);
+			vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Draw_constants), &item.constants);
+			if (model->uses_gpu_culling())
+			{
+				//Culled meshlets were written with zero instances
+				VkDeviceSize offset = model->get_indirect_offset(current_frame);
+				uint32_t count = model->get_meshlet_count(), stride = sizeof(VkDrawIndexedIndirectCommand);
+				if (vulkan_device->supports_multi_draw_indirect())
+					vkCmdDrawIndexedIndirect(command_buffer, model->get_indirect_buffer(), offset, count, stride);
+				else
+					for (uint32_t i = 0; i < count; ++i)
+						vkCmdDrawIndexedIndirect(command_buffer, model->get_indirect_buffer(), offset + i * stride, 1, stride);
+				continue;
+			}
+			if (phase != Occlusion_phase::all)
+			{
+				//Commands of occluded objects were written with zero instances
+				VkBuffer commands = occlusion->get_command_buffer(current_frame);
+				VkDeviceSize offset = occlusion->get_command_offset(current_frame, phase, item.first_command);
+				uint32_t count = static_cast<uint32_t>(model->get_submeshes().size()), stride = sizeof(VkDrawIndexedIndirectCommand);
+				if (vulkan_device->supports_multi_draw_indirect())
+					vkCmdDrawIndexedIndirect(command_buffer, commands, offset, count, stride);
+				else
+					for (uint32_t i = 0; i < count; ++i)
+						vkCmdDrawIndexedIndirect(command_buffer, commands, offset + i * stride, 1, stride);
+				continue;
+			}
+			for (const auto& range : model->get_submeshes())
+				vkCmdDrawIndexed(command_buffer, range.index_count, 1, range.first_index, range.vertex_offset, 0);
 		}
-		else
-			throw std::runtime_error("Unsupported layout transition!\n");
-
-		vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-
-		end_single_time_commands(command_buffer);
 	}
-	void Engine::create_command_buffers()
+	void Engine::record_post_pass(VkCommandBuffer command_buffer)
+	{
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, post_pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, post_pipeline_layout, 0, 1, &post_descriptor_set, 0, nullptr);
+		Post_constants constants{};
+		constants.texel_size = glm::vec2(1.0f / target_extent.width, 1.0f / target_extent.height);
+		constants.uv_scale = glm::vec2(render_extent.width, render_extent.height) * constants.texel_size;
+		constants.sharpness = settings.upscale_filter == Upscale_filter::sharpen ? settings.sharpness : 0.0f;
+		vkCmdPushConstants(command_buffer, post_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+		vkCmdDraw(command_buffer, 3, 1, 0, 0);
+	}
+	void Engine::record_hdr_pass(VkCommandBuffer command_buffer)
+	{
+		hdr->record(command_buffer, current_image, render_extent, delta_time);
+	}
+	void Engine::record_blit_pass(VkCommandBuffer command_buffer)
+	{
+		//Converts to the swap chain format and size, the tonemap pass already wrote sRGB encoded values
+		VkImageBlit region{};
+		region.srcSubresource.aspectMask = region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.layerCount = region.dstSubresource.layerCount = 1;
+		region.srcOffsets[1] = { static_cast<int32_t>(render_extent.width), static_cast<int32_t>(render_extent.height), 1 };
+		region.dstOffsets[1] = { static_cast<int32_t>(swap_chain_extent.width), static_cast<int32_t>(swap_chain_extent.height), 1 };
+		vkCmdBlitImage(command_buffer, render_graph->get_image(tonemap_target), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			swap_chain_images.at(current_image), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+	}
+	void Engine::create_frame_resources()
 	{
-		command_buffers.resize(swap_chain_framebuffers.size());
+		command_buffers.resize(frames_in_flight);
 		VkCommandBufferAllocateInfo alloc_info{};
 		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
@@ -817,158 +1649,396 @@ float Engine::last_frame = 0.0f;
 		if (vkAllocateCommandBuffers(vulkan_device->get_device(), &alloc_info, command_buffers.data()) != VK_SUCCESS)
 			throw std::runtime_error("Failed to allocate command buffers!\n");
 
-		for (int i = 0; i < command_buffers.size(); ++i)
-		{
-			VkCommandBufferBeginInfo buffer_begin_info{};
-			buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			if (vkBeginCommandBuffer(command_buffers.at(i), &buffer_begin_info) != VK_SUCCESS)
-				throw std::runtime_error("Failed to begin recording command buffer!\n");
-			VkRenderPassBeginInfo render_pass_begin{};
-			render_pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			render_pass_begin.renderPass = render_pass;
-			render_pass_begin.framebuffer = swap_chain_framebuffers.at(i);
-			render_pass_begin.renderArea.offset = { 0, 0 };
-			render_pass_begin.renderArea.extent = swap_chain_extent;
-			std::array<VkClearValue, 2> clear_values{};
-			clear_values.at(0).color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clear_values.at(1).depthStencil = { 1.0f, 0 };
-			render_pass_begin.clearValueCount = static_cast<uint32_t>(clear_values.size());
-			render_pass_begin.pClearValues = clear_values.data();
-			vkCmdBeginRenderPass(command_buffers.at(i), &render_pass_begin, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(command_buffers.at(i), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-			for (const auto& model : models)
-			{
-				VkBuffer vertex_buffers[] = { model->get_vertex_buffer() };
-				VkDeviceSize offsets[] = { 0 };
-				vkCmdBindVertexBuffers(command_buffers.at(i), 0, 1, vertex_buffers, offsets);
-				vkCmdBindIndexBuffer(command_buffers.at(i), model->get_index_buffer(), 0, VK_INDEX_TYPE_UINT32);
-				vkCmdBindDescriptorSets(command_buffers.at(i), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout,
-					0, 1, model->get_descriptor_sets().data(), 0, nullptr);
-				vkCmdDrawIndexed(command_buffers.at(i), model->get_indicies_size(), 1, 0, 0, 0);
-
-			}
-			vkCmdEndRenderPass(command_buffers.at(i));
-			if (vkEndCommandBuffer(command_buffers.at(i)) != VK_SUCCESS)
-				throw std::runtime_error("Failed to end command buffer recording!\n");
-
-		}
-
-	}
-	void Engine::create_semaphores_and_fences()
-	{
-		image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		rendering_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-		images_in_flight.resize(swap_chain_images.size(), VK_NULL_HANDLE);
+		image_available_semaphores.resize(frames_in_flight);
+		rendering_finished_semaphores.resize(frames_in_flight);
 		VkSemaphoreCreateInfo semaphore_info{};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		VkFenceCreateInfo fence_info{};
-		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		for (uint32_t i = 0; i < frames_in_flight; ++i)
 			if (vkCreateSemaphore(vulkan_device->get_device(), &semaphore_info, nullptr, &image_available_semaphores.at(i)) != VK_SUCCESS ||
-				vkCreateSemaphore(vulkan_device->get_device(), &semaphore_info, nullptr, &rendering_finished_semaphores.at(i)) != VK_SUCCESS ||
-				vkCreateFence(vulkan_device->get_device(), &fence_info, nullptr, &in_flight_fences.at(i)) != VK_SUCCESS)
+				vkCreateSemaphore(vulkan_device->get_device(), &semaphore_info, nullptr, &rendering_finished_semaphores.at(i)) != VK_SUCCESS)
 				throw std::runtime_error("Failed to create sync objects for a frame!\n");
+		create_frame_uniforms();
+		timestamps_pending.assign(frames_in_flight, false);
+		if (!vulkan_device->supports_timestamps())
+			return;
+		VkQueryPoolCreateInfo query_info{};
+		query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_info.queryCount = frames_in_flight * 2;
+		if (vkCreateQueryPool(vulkan_device->get_device(), &query_info, nullptr, &timestamp_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create timestamp query pool!\n");
+	}
+	void Engine::create_frame_uniforms()
+	{
+		//Host coherent and mapped for the lifetime of the buffers, rewritten once per frame
+		VkDevice device = vulkan_device->get_device();
+		frame_uniform_buffers.resize(frames_in_flight);
+		frame_uniform_memory.resize(frames_in_flight);
+		frame_uniform_data.resize(frames_in_flight);
+		for (uint32_t i = 0; i < frames_in_flight; ++i)
+		{
+			VkBufferCreateInfo buffer_info{};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+			buffer_info.size = sizeof(Frame_uniforms);
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			if (vkCreateBuffer(device, &buffer_info, nullptr, &frame_uniform_buffers.at(i)) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create frame uniform buffer!\n");
+			VkMemoryRequirements mem_req{};
+			vkGetBufferMemoryRequirements(device, frame_uniform_buffers.at(i), &mem_req);
+			VkMemoryAllocateInfo malloc_info{};
+			malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			malloc_info.allocationSize = mem_req.size;
+			malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			if (vkAllocateMemory(device, &malloc_info, nullptr, &frame_uniform_memory.at(i)) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate frame uniform memory!\n");
+			vkBindBufferMemory(device, frame_uniform_buffers.at(i), frame_uniform_memory.at(i), 0);
+			vkMapMemory(device, frame_uniform_memory.at(i), 0, sizeof(Frame_uniforms), 0, &frame_uniform_data.at(i));
+		}
 
+		std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+		pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		pool_sizes.at(0).descriptorCount = frames_in_flight;
+		pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_sizes.at(1).descriptorCount = 2 * frames_in_flight;
+		pool_sizes.at(2).type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_sizes.at(2).descriptorCount = 3 * frames_in_flight;
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_info.pPoolSizes = pool_sizes.data();
+		pool_info.maxSets = frames_in_flight;
+		if (vkCreateDescriptorPool(device, &pool_info, nullptr, &frame_descriptor_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create descriptor pool!\n");
+		std::vector<VkDescriptorSetLayout> layouts(frames_in_flight, frame_set_layout);
+		VkDescriptorSetAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = frame_descriptor_pool;
+		alloc_info.descriptorSetCount = frames_in_flight;
+		alloc_info.pSetLayouts = layouts.data();
+		frame_descriptor_sets.resize(frames_in_flight);
+		if (vkAllocateDescriptorSets(device, &alloc_info, frame_descriptor_sets.data()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate descriptor sets!\n");
+		for (uint32_t i = 0; i < frames_in_flight; ++i)
+		{
+			std::array<VkDescriptorBufferInfo, 4> buffer_infos{};
+			buffer_infos.at(0).buffer = frame_uniform_buffers.at(i);
+			buffer_infos.at(0).range = sizeof(Frame_uniforms);
+			buffer_infos.at(1).buffer = clusterer->get_light_buffer(i);
+			buffer_infos.at(2).buffer = clusterer->get_light_grid();
+			buffer_infos.at(3).buffer = clusterer->get_light_indices();
+			for (uint32_t b = 1; b < buffer_infos.size(); ++b)
+				buffer_infos.at(b).range = VK_WHOLE_SIZE;
+			std::array<VkDescriptorImageInfo, 2> shadow_infos{};
+			shadow_infos.at(0).imageView = shadows->get_static_view();
+			shadow_infos.at(1).imageView = shadows->get_dynamic_view();
+			for (auto& info : shadow_infos)
+			{
+				info.sampler = shadows->get_sampler();
+				info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			}
+			std::array<VkWriteDescriptorSet, 6> writes{};
+			for (uint32_t w = 0; w < writes.size(); ++w)
+			{
+				writes.at(w).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes.at(w).dstSet = frame_descriptor_sets.at(i);
+				writes.at(w).dstBinding = w;
+				writes.at(w).descriptorCount = 1;
+				if (w == 0)
+				{
+					writes.at(w).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+					writes.at(w).pBufferInfo = &buffer_infos.at(0);
+				}
+				else if (w < 3)
+				{
+					writes.at(w).descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					writes.at(w).pImageInfo = &shadow_infos.at(w - 1);
+				}
+				else
+				{
+					writes.at(w).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writes.at(w).pBufferInfo = &buffer_infos.at(w - 2);
+				}
+			}
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
 	}
-	void Engine::create_colour_resources()
-	{
-		VkFormat colour_format = swap_chain_image_format;
-		create_image(swap_chain_extent.width, swap_chain_extent.height, colour_format,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colour_img, colour_mem, 1, vulkan_device->get_msaa_samples());
-		colour_img_view = create_image_view(colour_img, colour_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-		transition_image_layout(colour_img, colour_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
-	}
-	void Engine::create_depth_resources()
+	void Engine::destroy_frame_resources()
 	{
-		VkFormat depth_format = find_depth_format();
-		create_image(swap_chain_extent.width, swap_chain_extent.height, depth_format, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depth_img, depth_mem, 1, vulkan_device->get_msaa_samples());
-		depth_img_view = create_image_view(depth_img, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-		transition_image_layout(depth_img, depth_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-
+		for (uint32_t i = 0; i < frames_in_flight; ++i)
+		{
+			vkDestroySemaphore(vulkan_device->get_device(), image_available_semaphores.at(i), nullptr);
+			vkDestroySemaphore(vulkan_device->get_device(), rendering_finished_semaphores.at(i), nullptr);
+		}
+		vkFreeCommandBuffers(vulkan_device->get_device(), command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
+		vkDestroyQueryPool(vulkan_device->get_device(), timestamp_pool, nullptr);
+		timestamp_pool = VK_NULL_HANDLE;
+		for (uint32_t i = 0; i < frame_uniform_buffers.size(); ++i)
+		{
+			vkDestroyBuffer(vulkan_device->get_device(), frame_uniform_buffers.at(i), nullptr);
+			vkFreeMemory(vulkan_device->get_device(), frame_uniform_memory.at(i), nullptr);
+		}
+		vkDestroyDescriptorPool(vulkan_device->get_device(), frame_descriptor_pool, nullptr);
+		frame_descriptor_pool = VK_NULL_HANDLE;
+		for (const auto& model : models)
+		{
+			resource_pool->release_buffer(model->get_indirect_buffer());
+			vkDestroyDescriptorPool(vulkan_device->get_device(), model->get_cull_descriptor_pool(), nullptr);
+		}
 	}
 	void Engine::clean_swap_chain()
 	{
-		vkDestroyImageView(vulkan_device->get_device(), colour_img_view, nullptr);
-		vkDestroyImage(vulkan_device->get_device(), colour_img, nullptr);
-		vkFreeMemory(vulkan_device->get_device(), colour_mem, nullptr);		
-		vkDestroyImageView(vulkan_device->get_device(), depth_img_view, nullptr);
-		vkDestroyImage(vulkan_device->get_device(), depth_img, nullptr);
-		vkFreeMemory(vulkan_device->get_device(), depth_mem, nullptr);
-		for (const auto& framebuffer : swap_chain_framebuffers)
-			vkDestroyFramebuffer(vulkan_device->get_device(), framebuffer, nullptr);
-		vkFreeCommandBuffers(vulkan_device->get_device(), command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
-		vkDestroyPipeline(vulkan_device->get_device(), pipeline, nullptr);
+		//Render passes, attachments and framebuffers belong to the graph
+		render_graph.reset();
+		render_pass = post_render_pass = VK_NULL_HANDLE;
+		vkDestroyPipeline(vulkan_device->get_device(), post_pipeline, nullptr);
+		vkDestroyPipelineLayout(vulkan_device->get_device(), post_pipeline_layout, nullptr);
+		vkDestroyDescriptorPool(vulkan_device->get_device(), post_descriptor_pool, nullptr);
+		vkDestroyDescriptorSetLayout(vulkan_device->get_device(), post_set_layout, nullptr);
+		vkDestroySampler(vulkan_device->get_device(), post_sampler, nullptr);
+		post_pipeline = VK_NULL_HANDLE;
+		post_pipeline_layout = VK_NULL_HANDLE;
+		post_descriptor_pool = VK_NULL_HANDLE;
+		post_set_layout = VK_NULL_HANDLE;
+		post_sampler = VK_NULL_HANDLE;
+		for (const auto& pipeline : pipelines)
+			vkDestroyPipeline(vulkan_device->get_device(), pipeline, nullptr);
+		vkDestroyPipeline(vulkan_device->get_device(), depth_pipeline, nullptr);
+		depth_pipeline = VK_NULL_HANDLE;
 		vkDestroyPipelineLayout(vulkan_device->get_device(), pipeline_layout, nullptr);
-		vkDestroyRenderPass(vulkan_device->get_device(), render_pass, nullptr);
 		for (const auto& view : swap_chain_img_views)
 			vkDestroyImageView(vulkan_device->get_device(), view, nullptr);
 		vkDestroySwapchainKHR(vulkan_device->get_device(), swap_chain, nullptr);
-		for (const auto& model : models)
+	}
+	void Engine::update_transforms()
+	{
+		static auto start_time = std::chrono::high_resolution_clock::now();
+		auto current_time = std::chrono::high_resolution_clock::now();
+		animation_time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
+		transforms.update();
+		auto& transform_pool = scene.get<Transform_component>();
+		auto& animation_pool = scene.get<Animation_component>();
+		auto& bounds_pool = scene.get<Bounds_component>();
+		const auto& transform_entities = transform_pool.get_entities();
+		bool static_moved = false;
+		for (uint32_t i = 0; i < transform_pool.size(); ++i)
 		{
-			auto uniform_buffers = model->get_uniform_buffers();
-			for (int i = 0; i < uniform_buffers.size(); ++i)
+			Transform_component& transform = transform_pool.data()[i];
+			if (transforms.was_updated(transform.node) && !animation_pool.contains(transform_entities[i]))
 			{
-				vkDestroyBuffer(vulkan_device->get_device(), uniform_buffers.at(i), nullptr);
-				vkFreeMemory(vulkan_device->get_device(), model->get_uniform_buffer_memory(i), nullptr);
+				transform.world = transforms.get_world_matrix(transform.node);
+				static_moved = true;
 			}
-			vkDestroyDescriptorPool(vulkan_device->get_device(), model->get_descriptor_pool(), nullptr);
+		}
+		//Static casters are cached in the shadow maps, moving one invalidates them
+		if (static_moved)
+			shadows->invalidate();
+		const auto& animated_entities = animation_pool.get_entities();
+		for (uint32_t i = 0; i < animation_pool.size(); ++i)
+		{
+			Transform_component& transform = transform_pool.get(animated_entities[i]);
+			transform.world = glm::rotate(transforms.get_world_matrix(transform.node),
+				glm::radians(animation_pool.data()[i].degrees_per_second) * animation_time, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		const auto& bounded_entities = bounds_pool.get_entities();
+		for (uint32_t i = 0; i < bounds_pool.size(); ++i)
+		{
+			Bounds_component& bounds = bounds_pool.data()[i];
+			const glm::mat4& world = transform_pool.get(bounded_entities[i]).world;
+			float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+			bounds.centre = glm::vec3(world * glm::vec4(bounds.local_centre, 1.0f));
+			bounds.radius = bounds.local_radius * scale;
 		}
 	}
 	void Engine::update_uniform_buffer(uint32_t index)
 	{
-		static auto start_time = std::chrono::high_resolution_clock::now();
-		auto current_time = std::chrono::high_resolution_clock::now();
-		float time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
-		
-		for (const auto &model : models)
+		//Per-object data is pushed while recording, only the camera goes through memory
+		Frame_uniforms uniforms{};
+		uniforms.view = current_camera().get_view_matrix();
+		uniforms.proj = current_camera().get_projection_matrix();
+		uniforms.proj[1][1] *= -1;
+		for (uint32_t i = 0; i < shadows->get_cascade_count(); ++i)
 		{
-			Uniform_buffer_object ubo{};
-			if (model->get_animation_state())
-				ubo.model = glm::rotate(model->get_model_matrix(), glm::radians(90.0f) * time, glm::vec3(0.0f, 1.0f, 0.0f));
-			else
-				ubo.model = model->get_model_matrix();
-			ubo.view = active_camera->get_view_matrix();
-			ubo.proj = active_camera->get_projection_matrix();
-			ubo.proj[1][1] *= -1;
-
-			void* data;
-			vkMapMemory(vulkan_device->get_device(), model->get_uniform_buffer_memory(index), 0, sizeof(ubo), 0, &data);
-			memcpy(data, &ubo, sizeof(ubo));
-			vkUnmapMemory(vulkan_device->get_device(), model->get_uniform_buffer_memory(index));
+			uniforms.shadow_matrices.at(i) = shadows->get_cascade(i).view_projection;
+			uniforms.cascade_splits[i] = shadows->get_cascade(i).split;
+		}
+		uniforms.shadow_params = glm::vec4(settings.shadows ? shadows->get_cascade_count() : 0, shadows->get_texel_size(), settings.shadow_ambient, 0.0f);
+		Free_camera& camera = current_camera();
+		uniforms.cluster_grid = glm::uvec4(clusterer->get_grid(), frame_light_count);
+		uniforms.cluster_params = glm::vec4(clusterer->get_slice_params(camera.get_near_plane(), camera.get_far_plane()),
+			render_extent.width, render_extent.height);
+		uniforms.output_params = glm::vec4(uses_hdr() ? 0.0f : 1.0f, 0.0f, 0.0f, 0.0f);
+		memcpy(frame_uniform_data.at(index), &uniforms, sizeof(uniforms));
+	}
+	void Engine::select_lods()
+	{
+		//Pixels covered by one world unit at distance 1 along the vertical axis of the view
+		float pixels_per_unit = render_extent.height / (2.0f * std::tan(glm::radians(current_camera().get_fov()) * 0.5f));
+		auto& mesh_pool = scene.get<Mesh_component>();
+		auto& transform_pool = scene.get<Transform_component>();
+		auto& animation_pool = scene.get<Animation_component>();
+		const auto& entities = mesh_pool.get_entities();
+		bool static_changed = false;
+		for (uint32_t i = 0; i < mesh_pool.size(); ++i)
+			if (models.get(mesh_pool.data()[i].model)->select_lod(transform_pool.get(entities[i]).world, current_camera().get_position_vector(),
+				pixels_per_unit, settings.lod_error_threshold, settings.lod_hysteresis))
+				static_changed = static_changed || !animation_pool.contains(entities[i]);
+		//The cached static cascades hold the silhouette of the level a caster had when they were drawn
+		if (static_changed)
+			shadows->invalidate();
+	}
+	void Engine::cull_meshlets()
+	{
+		glm::mat4 view_projection = current_camera().get_projection_matrix() * current_camera().get_view_matrix();
+		auto& mesh_pool = scene.get<Mesh_component>();
+		auto& transform_pool = scene.get<Transform_component>();
+		const auto& entities = mesh_pool.get_entities();
+		for (uint32_t i = 0; i < mesh_pool.size(); ++i)
+		{
+			const auto& model = models.get(mesh_pool.data()[i].model);
+			if (model->has_meshlets())
+				model->cull_meshlets(meshlet_builder::make_view(view_projection, transform_pool.get(entities[i]).world, current_camera().get_position_vector()));
 		}
 	}
+	void Engine::build_draw_list()
+	{
+		//Whole objects outside the frustum are dropped before any of their meshlets or ranges are looked at
+		Cull_view view = meshlet_builder::make_view(current_camera().get_projection_matrix() * current_camera().get_view_matrix(),
+			glm::mat4(1.0f), current_camera().get_position_vector());
+		auto& mesh_pool = scene.get<Mesh_component>();
+		auto& material_pool = scene.get<Material_component>();
+		auto& bounds_pool = scene.get<Bounds_component>();
+		auto& transform_pool = scene.get<Transform_component>();
+		const auto& entities = mesh_pool.get_entities();
+		glm::mat4 view_matrix = current_camera().get_view_matrix();
+		float near_plane = current_camera().get_near_plane(), far_plane = current_camera().get_far_plane();
+		draw_candidates.clear();
+		draw_sorter.clear();
+		for (uint32_t i = 0; i < mesh_pool.size(); ++i)
+		{
+			const Bounds_component& bounds = bounds_pool.get(entities[i]);
+			bool visible = true;
+			for (const auto& plane : view.planes)
+				visible = visible && glm::dot(glm::vec3(plane), bounds.centre) + plane.w >= -bounds.radius;
+			if (!visible)
+				continue;
+			//Every model owns its buffers and texture, so its slot identifies both the material and the mesh
+			Model_handle handle = mesh_pool.data()[i].model;
+			const auto& model = models.get(handle);
+			uint32_t pipeline = material_pool.get(entities[i]).pipeline;
+			float depth = -(view_matrix * glm::vec4(bounds.centre, 1.0f)).z - bounds.radius;
+			draw_sorter.add(Draw_sorter::make_key(pipeline, handle.index, handle.index, depth, near_plane, far_plane));
+			Draw_constants constants{};
+			//Quantized positions are relative to the mesh bounds, folding the bounds in keeps the shader a plain transform
+			constants.model = transform_pool.get(entities[i]).world * model->get_position_transform();
+			constants.uv_transform = model->get_uv_transform();
+			constants.colour = model->get_constant_colour();
+			draw_candidates.push_back({ pipeline, handle, constants, 0 });
+		}
+		draw_list.clear();
+		for (const auto index : draw_sorter.sort())
+			draw_list.push_back(draw_candidates[index]);
+		if (!uses_occlusion_culling())
+			return;
+		//Visibility is kept per model slot, so it survives the draw list being rebuilt and reordered every frame
+		occlusion->reserve_slots(static_cast<uint32_t>(model_entities.size()), deletion_queue, frame_number);
+		occlusion->begin_frame();
+		for (auto& item : draw_list)
+		{
+			const auto& model = models.get(item.model);
+			if (model->uses_gpu_culling())
+				continue;
+			const Bounds_component& bounds = bounds_pool.get(model_entities.at(item.model.index));
+			item.first_command = occlusion->add_object(bounds.centre, bounds.radius, item.model.index, model->get_submeshes());
+		}
+	}
+	void Engine::update_shadows()
+	{
+		shadow_casters.clear();
+		if (!settings.shadows)
+			return;
+		Free_camera& camera = current_camera();
+		shadows->update(camera.get_view_matrix(), camera.get_projection_matrix(), camera.get_near_plane(),
+			std::min(settings.shadow_distance, camera.get_far_plane()), settings.cascade_split_lambda, settings.shadow_cache_margin);
+		//Casters outside the camera frustum still throw shadows into it, each cascade culls them against its own box
+		auto& mesh_pool = scene.get<Mesh_component>();
+		auto& bounds_pool = scene.get<Bounds_component>();
+		auto& transform_pool = scene.get<Transform_component>();
+		auto& animation_pool = scene.get<Animation_component>();
+		const auto& entities = mesh_pool.get_entities();
+		for (uint32_t i = 0; i < mesh_pool.size(); ++i)
+		{
+			const auto& model = models.get(mesh_pool.data()[i].model);
+			const Bounds_component& bounds = bounds_pool.get(entities[i]);
+			shadow_casters.push_back({ transform_pool.get(entities[i]).world * model->get_position_transform(), bounds.centre, bounds.radius,
+				model->get_position_buffer(), model->get_index_buffer(), model->get_index_type(), &model->get_lod_ranges(), animation_pool.contains(entities[i]) });
+		}
+	}
+	void Engine::update_lights()
+	{
+		//Without compute on the graphics queue the lists can't be built and the scene is lit by the sun alone
+		frame_light_count = 0;
+		if (!vulkan_device->graphics_supports_compute() || lights.empty())
+			return;
+		frame_light_count = clusterer->upload(current_frame, &*lights.begin(), lights.size());
+	}
 	void Engine::draw_frame()
 	{
-		vkWaitForFences(vulkan_device->get_device(), 1, &in_flight_fences.at(current_frame), VK_TRUE, std::numeric_limits<uint64_t>::max());
+		//The slot is free again once the frame that last used it has been retired on the timeline
+		if (frame_number >= frames_in_flight)
+			vulkan_device->wait_timeline(frame_timeline, frame_number + 1 - frames_in_flight);
+		deletion_queue.flush(get_completed_frame());
+		attach_uploaded_models();
+		update_render_scale();
+		//Input of the whole frame has been accumulated, the camera matrices are rebuilt once
+		current_camera().update();
+		stream_scene();
 		uint32_t image_index{};
-		vkAcquireNextImageKHR(vulkan_device->get_device(), swap_chain, std::numeric_limits<uint64_t>::max(), image_available_semaphores.at(current_frame), VK_NULL_HANDLE, &image_index);
-
-		if (images_in_flight.at(image_index) != VK_NULL_HANDLE)
-			vkWaitForFences(vulkan_device->get_device(), 1, &images_in_flight.at(image_index), VK_TRUE, std::numeric_limits<uint64_t>::max());
-
-		images_in_flight.at(image_index) = in_flight_fences.at(current_frame);
-
-		update_uniform_buffer(image_index);
+		VkResult result = vkAcquireNextImageKHR(vulkan_device->get_device(), swap_chain, std::numeric_limits<uint64_t>::max(), image_available_semaphores.at(current_frame), VK_NULL_HANDLE, &image_index);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreate_swap_chain();
+			return;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+			throw std::runtime_error("Failed to acquire swap chain image!\n");
 
+		update_transforms();
+		select_lods();
+		cull_meshlets();
+		build_draw_list();
+		update_shadows();
+		update_lights();
+		update_uniform_buffer(current_frame);
+		VkCommandBuffer command_buffer = command_buffers.at(current_frame);
+		vkResetCommandBuffer(command_buffer, 0);
+		record_command_buffer(command_buffer, image_index);
+
+		//The binary semaphore feeds presentation, the timeline value marks the frame as retired
+		uint64_t signal_values[] = { 0, ++frame_number };
+		//Uploads acquired by the frame have completed already, the wait only orders their copies before it
+		uint64_t wait_values[] = { 0, upload_wait };
+		VkTimelineSemaphoreSubmitInfoKHR timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timeline_info.signalSemaphoreValueCount = 2;
+		timeline_info.pSignalSemaphoreValues = signal_values;
+		timeline_info.waitSemaphoreValueCount = upload_wait ? 2 : 1;
+		timeline_info.pWaitSemaphoreValues = wait_values;
 		VkSubmitInfo submit_info{};
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		VkSemaphore wait_semaphores[] = { image_available_semaphores.at(current_frame) };
-		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submit_info.pCommandBuffers = &command_buffers[image_index];
-			submit_info.commandBufferCount = 1;
-			submit_info.waitSemaphoreCount = 1;
-			submit_info.pWaitSemaphores = wait_semaphores;
-			submit_info.pWaitDstStageMask = wait_stages;
-			VkSemaphore signal_semaphores[] = { rendering_finished_semaphores.at(current_frame) };
-			submit_info.signalSemaphoreCount = 1;
-			submit_info.pSignalSemaphores = signal_semaphores;
-			vkResetFences(vulkan_device->get_device(), 1, &in_flight_fences.at(current_frame));
-			if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences.at(current_frame)) != VK_SUCCESS)
-				throw std::runtime_error("Failed to submit draw command buffer!\n");
+		submit_info.pNext = &timeline_info;
+		VkSemaphore wait_semaphores[] = { image_available_semaphores.at(current_frame), vulkan_device->get_upload_timeline() };
+		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, upload_wait_stages };
+		submit_info.pCommandBuffers = &command_buffer;
+		submit_info.commandBufferCount = 1;
+		submit_info.waitSemaphoreCount = upload_wait ? 2 : 1;
+		submit_info.pWaitSemaphores = wait_semaphores;
+		submit_info.pWaitDstStageMask = wait_stages;
+		VkSemaphore signal_semaphores[] = { rendering_finished_semaphores.at(current_frame), frame_timeline };
+		submit_info.signalSemaphoreCount = 2;
+		submit_info.pSignalSemaphores = signal_semaphores;
+		if (vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit draw command buffer!\n");
 		VkPresentInfoKHR present_info{};
 		VkSwapchainKHR swap_chains[] = { swap_chain };
 		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -977,16 +2047,88 @@ float Engine::last_frame = 0.0f;
 		present_info.pSwapchains = swap_chains;
 		present_info.pWaitSemaphores = signal_semaphores;
 		present_info.pImageIndices = &image_index;
-		VkResult result = vkQueuePresentKHR(present_queue, &present_info);
+		result = vkQueuePresentKHR(present_queue, &present_info);
+		if (settings.measure_latency)
+			record_latency();
+		current_frame = (current_frame + 1) % frames_in_flight;
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized)
 		{
 			framebuffer_resized = false;
 			recreate_swap_chain();
 		}
 		else if (result != VK_SUCCESS)
-			throw std::runtime_error("Failed to acquire swap chain image!\n");
-
-		current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+			throw std::runtime_error("Failed to present swap chain image!\n");
+	}
+	void Engine::update_render_scale()
+	{
+		//The slot has been waited for, so its timestamps from the last use are available
+		if (timestamp_pool != VK_NULL_HANDLE && timestamps_pending.at(current_frame))
+		{
+			std::array<uint64_t, 2> ticks{};
+			if (vkGetQueryPoolResults(vulkan_device->get_device(), timestamp_pool, current_frame * 2, 2, sizeof(ticks), ticks.data(),
+				sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			{
+				float ms = (ticks.at(1) - ticks.at(0)) * vulkan_device->get_timestamp_period() * 1e-6f;
+				gpu_time_ms = gpu_time_ms > 0.0f ? gpu_time_ms + (ms - gpu_time_ms) * Resolution_controller::SMOOTHING : ms;
+				if (settings.dynamic_resolution)
+					resolution.update(ms);
+			}
+			timestamps_pending.at(current_frame) = false;
+		}
+		render_extent = settings.dynamic_resolution ? get_scaled_extent(resolution.get_scale()) : target_extent;
+	}
+	bool Engine::uses_post_pass() const
+	{
+		return settings.anti_aliasing != Anti_aliasing::none || settings.dynamic_resolution;
+	}
+	bool Engine::uses_hdr() const
+	{
+		return settings.hdr && hdr;
+	}
+	bool Engine::uses_depth_prepass() const
+	{
+		//Wireframe lines wouldn't match the filled depth
+		return settings.depth_prepass && poly_mode.first == VK_POLYGON_MODE_FILL;
+	}
+	bool Engine::uses_occlusion_culling() const
+	{
+		//Lines don't hide what is behind them
+		return settings.occlusion_culling && occlusion && poly_mode.first == VK_POLYGON_MODE_FILL;
+	}
+	VkExtent2D Engine::get_scaled_extent(const float scale) const
+	{
+		VkExtent2D extent{};
+		extent.width = std::max(1u, static_cast<uint32_t>(swap_chain_extent.width * scale + 0.5f));
+		extent.height = std::max(1u, static_cast<uint32_t>(swap_chain_extent.height * scale + 0.5f));
+		//Rounding must not step outside the allocated targets
+		if (target_extent.width && target_extent.height)
+		{
+			extent.width = std::min(extent.width, target_extent.width);
+			extent.height = std::min(extent.height, target_extent.height);
+		}
+		return extent;
+	}
+	void Engine::limit_frame_rate()
+	{
+		if (settings.target_fps <= 0.0f)
+			return;
+		auto frame_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / settings.target_fps));
+		auto now = std::chrono::steady_clock::now();
+		//Sleeping before input is sampled keeps the wait out of the input to present latency
+		if (next_frame_deadline > now)
+			std::this_thread::sleep_until(next_frame_deadline);
+		//A frame that ran late restarts the schedule instead of trying to catch up with a burst
+		next_frame_deadline = std::max(next_frame_deadline, now) + frame_duration;
+	}
+	void Engine::record_latency()
+	{
+		auto now = std::chrono::steady_clock::now();
+		latency.last_input_to_present_ms = std::chrono::duration<float, std::milli>(now - input_time).count();
+		if (last_present_time != std::chrono::steady_clock::time_point{})
+			latency.last_frame_time_ms = std::chrono::duration<float, std::milli>(now - last_present_time).count();
+		last_present_time = now;
+		++latency.samples;
+		latency.average_input_to_present_ms += (latency.last_input_to_present_ms - latency.average_input_to_present_ms) / latency.samples;
 	}
 	void Engine::recreate_swap_chain()
 	{
@@ -998,59 +2140,54 @@ float Engine::last_frame = 0.0f;
 		}
 		vkDeviceWaitIdle(vulkan_device->get_device());
 		clean_swap_chain();
-		create_swap_chain();
+		create_swap_chain(VK_NULL_HANDLE);
 		for (auto& camera : cameras)
 			camera.set_aspect_ratio(aspect_ratio);
 		create_image_views();
-		create_render_passes();
+		build_render_graph();
 		create_graphics_pipeline();
-		create_colour_resources();
-		create_depth_resources();
-		create_framebuffers();
-		for (const auto &model: models)
-			model->recreate_swap_chain_elements();
-		create_command_buffers();
+		create_post_pipeline();
 
 	}
 	void Engine::process_input()
 	{
-		float speed = active_camera->get_speed() * delta_time,
+		float speed = current_camera().get_speed() * delta_time,
 			angle = 45.0f * delta_time;
 			if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-				active_camera->walk(speed);
+				current_camera().walk(speed);
 
 			if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-				active_camera->strafe(-speed);
+				current_camera().strafe(-speed);
 
 			if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) 
-				active_camera->walk(-speed);
+				current_camera().walk(-speed);
 
 			if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-				active_camera->strafe(+speed);
+				current_camera().strafe(+speed);
 
 			if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-				active_camera->lift(speed);
+				current_camera().lift(speed);
 
 			if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-				active_camera->lift(-speed);
+				current_camera().lift(-speed);
 
 			if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-				active_camera->rotate(0.0f, -angle);
+				current_camera().rotate(0.0f, -angle);
 
 			if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-				active_camera->rotate(0.0f, angle);
+				current_camera().rotate(0.0f, angle);
 
 			if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-				active_camera->rotate(angle, 0.0f);
+				current_camera().rotate(angle, 0.0f);
 
 			if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-				active_camera->rotate(-angle, 0.0f);
+				current_camera().rotate(-angle, 0.0f);
 
 			if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-				active_camera->set_fov(-angle);
+				current_camera().set_fov(-angle);
 
 			if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-				active_camera->set_fov(angle);
+				current_camera().set_fov(angle);
 	}
 	void Engine::info()
 	{
@@ -1078,7 +2215,7 @@ F - Toogle wireframe
 	{
 		for (const auto& mode : modes)
 		{
-			if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+			if (mode == settings.present_mode)
 				return mode;
 		}
 		return VK_PRESENT_MODE_FIFO_KHR;
@@ -1128,10 +2265,10 @@ F - Toogle wireframe
 	}
 	VkFormat Engine::find_depth_format()
 	{
+		//The depth pyramid is reduced from a sampled view, which can't cover both aspects of a stencil format
+		if (uses_occlusion_culling())
+			return find_supported_format({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_IMAGE_TILING_OPTIMAL,
+				VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 		return find_supported_format({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
 			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 	}
-	bool Engine::has_stencil_component(VkFormat format)
-	{
-		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-	}
@@ -18,6 +18,7 @@
 #include <optional>
 #include <limits>
 #include <chrono>
+#include <thread>
 #include "vulkan/vulkan.h"
 #include "GLFW/glfw3.h"
 #include "glm/glm.hpp"
@@ -28,6 +29,19 @@
 #include "shader.h"
 #include "VulkanDevice.h"
 #include "utility.h"
+#include "settings.h"
+#include "deletion_queue.h"
+#include "transform_hierarchy.h"
+#include "scene_components.h"
+#include "resource_pool.h"
+#include "scene_streamer.h"
+#include "resolution_controller.h"
+#include "render_graph.h"
+#include "draw_sorter.h"
+#include "occlusion_culler.h"
+#include "shadow_renderer.h"
+#include "light_clusterer.h"
+#include "hdr_processor.h"
 #ifdef RELEASE
 const bool enable_validation_layers = false;
 #else
@@ -43,55 +57,183 @@ const bool enable_validation_layers = true;
 		const VkAllocationCallbacks* allocator_pointer
 	);
 
+	using Camera_handle = Handle<Free_camera>;
+	using Light_handle = Handle<Light_data>;
+
+	//Streamed cell whose models are read and processed on a worker thread, they get their resources once it finishes
+	struct Stream_load
+	{
+		Cell_key cell;
+		std::vector<std::unique_ptr<Model>> models;
+		std::future<void> prepared;
+	};
+
+	//CPU side latency, measured from sampling input in glfwPollEvents to vkQueuePresentKHR returning
+	struct Latency_stats
+	{
+		float last_input_to_present_ms = 0.0f;
+		float average_input_to_present_ms = 0.0f;
+		float last_frame_time_ms = 0.0f;
+		uint64_t samples = 0;
+	};
+
+	//Camera matrices and shadow cascades read by every draw of a frame
+	struct Frame_uniforms
+	{
+		glm::mat4 view;
+		glm::mat4 proj;
+		std::array<glm::mat4, Shadow_renderer::MAX_CASCADES> shadow_matrices;
+		//View depth each cascade ends at
+		glm::vec4 cascade_splits;
+		//x cascade count, 0 without shadows, y shadow map texel size, z ambient
+		glm::vec4 shadow_params;
+		//Clusters along each axis, w light count, 0 when the lights weren't binned this frame
+		glm::uvec4 cluster_grid;
+		//Slice scale and bias, then the render area in pixels
+		glm::vec4 cluster_params;
+		//x 1 when the scene pass writes display colour and has to sRGB encode it, 0 when the HDR chain does
+		glm::vec4 output_params;
+	};
+
+	//Push constants of the post pass, the scene occupies uv_scale of the scene image
+	struct Post_constants
+	{
+		glm::vec2 texel_size;
+		glm::vec2 uv_scale;
+		float sharpness;
+	};
+
 	class Engine
 	{
 	public:
 		Engine(const std::string& name, const int width, const int height);
+		Engine(const std::string& name, const int width, const int height, const Engine_settings& engine_settings);
 		~Engine();
 		void run();
 
 		void toogle_wireframe();
+		void set_mip_generation(Mip_generation generation, Mip_filter filter);
+		//Frame pacing, frames are numbered from 1 on the frame timeline semaphore
+		void set_frames_in_flight(const uint32_t count);
+		uint64_t get_submitted_frame() const;
+		uint64_t get_completed_frame();
+		void wait_for_frame(const uint64_t frame);
+		//Presentation and latency
+		void set_present_mode(VkPresentModeKHR mode);
+		void set_frame_limit(const float fps);
+		void set_latency_measurement(const bool enabled);
+		Latency_stats get_latency_stats() const;
+		//Anti-aliasing, changes rebuild the swap chain resources
+		void set_msaa_samples(const uint32_t samples);
+		void set_anti_aliasing(Anti_aliasing mode);
+		//Depth pre-pass, changes rebuild the swap chain resources
+		void set_depth_prepass(const bool enabled);
+		//Occlusion culling, changes rebuild the swap chain resources
+		void set_occlusion_culling(const bool enabled);
+		//Shadows of the directional light, the direction points from the light into the scene
+		void set_shadows(const bool enabled);
+		void set_light_direction(const float x, const float y, const float z);
+		//Point and spot lights, range is the distance the light reaches and the spot angles are full cone angles in degrees
+		Light_handle create_point_light(const float x, const float y, const float z, const float range, const float r, const float g, const float b, const float intensity);
+		Light_handle create_spot_light(const float x, const float y, const float z, const float dir_x, const float dir_y, const float dir_z, const float range,
+			const float inner_angle, const float outer_angle, const float r, const float g, const float b, const float intensity);
+		void set_light_position(const Light_handle id, const float x, const float y, const float z);
+		void set_light_colour(const Light_handle id, const float r, const float g, const float b, const float intensity);
+		void destroy_light(const Light_handle id);
+		//HDR target with bloom and automatic exposure, changes rebuild the swap chain resources
+		void set_hdr(const bool enabled);
+		void set_bloom(const float threshold, const float intensity);
+		//Compensation in stops, rate is how fast exposure follows the scene per second
+		void set_exposure(const float compensation, const float rate);
+		//Dynamic resolution, scales are fractions of the swap chain extent per axis
+		void set_dynamic_resolution(const bool enabled);
+		void set_render_scale_limits(const float min_scale, const float max_scale);
+		void set_target_gpu_time(const float ms);
+		void set_upscale_filter(Upscale_filter filter, const float sharpness);
+		float get_render_scale() const;
+		//Smoothed GPU time of the frames, 0 when the device can't write timestamps
+		float get_gpu_time() const;
+		//Level of detail selection, threshold is the projected error in pixels
+		void set_lod_selection(const float threshold, const float hysteresis);
+		uint32_t get_model_lod(const Model_handle id) const;
 		//Camera functions
-		void create_camera();
-		void create_camera(const float x, const float y, const float z);
-		void translate_camera(const int id, const float x, const float y, const float z);
-		void set_camera_position(const int id, const float x, const float y, const float z);
-		void rotate_camera(const int id, const float yaw, const float pitch, const float roll);
-		void change_fov(const int id, const float fov);
+		Camera_handle create_camera();
+		Camera_handle create_camera(const float x, const float y, const float z);
+		Camera_handle get_active_camera() const;
+		void set_active_camera(const Camera_handle camera);
+		void translate_camera(const Camera_handle id, const float x, const float y, const float z);
+		void set_camera_position(const Camera_handle id, const float x, const float y, const float z);
+		void rotate_camera(const Camera_handle id, const float yaw, const float pitch, const float roll);
+		void change_fov(const Camera_handle id, const float fov);
 		//Model functions
-		void create_model(const std::string& model_path);
-		void create_model(const std::string& model_path, const float x, const float y, const float z);
-		void create_model(const std::string& model_path, const std::string& tex_path);
-		void create_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z);
-		void create_sphere(const float radious);
-		void create_sphere(const float radious, const float x, const float y, const float z);
-		void create_sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z);
-		void create_sphere(const float radious, const std::string& tex_path);
-		void create_plane(const float width, const float height);
-		void create_plane(const float width, const float height, const float x, const float y, const float z);
-		void create_plane(const float width, const float height, const std::string& tex_path);
-		void create_plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z);
-		void create_box(const float width, const float height, const float length);
-		void create_box(const float width, const float height, const float length, const float x, const float y, const float z);
-		void create_box(const float width, const float height, const float length, const std::string& tex_path);
-		void create_box(const float width, const float height, const float length, const std::string& tex_path, const float x, const float y, const float z);
-		void translate_model(const int id, const float x, const float y, const float z);
-		void rotate_model(const int id, const float x, const float y, const float z);
-		void scale_model(const int id, const float x, const float y, const float z);
-		void change_texture(const int id, const std::string& path);
-		void switch_animated_rotation(const int id);
+		Model_handle create_model(const std::string& model_path);
+		Model_handle create_model(const std::string& model_path, const float x, const float y, const float z);
+		Model_handle create_model(const std::string& model_path, const std::string& tex_path);
+		Model_handle create_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z);
+		Model_handle create_sphere(const float radious);
+		Model_handle create_sphere(const float radious, const float x, const float y, const float z);
+		Model_handle create_sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z);
+		Model_handle create_sphere(const float radious, const std::string& tex_path);
+		Model_handle create_plane(const float width, const float height);
+		Model_handle create_plane(const float width, const float height, const float x, const float y, const float z);
+		Model_handle create_plane(const float width, const float height, const std::string& tex_path);
+		Model_handle create_plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z);
+		Model_handle create_box(const float width, const float height, const float length);
+		Model_handle create_box(const float width, const float height, const float length, const float x, const float y, const float z);
+		Model_handle create_box(const float width, const float height, const float length, const std::string& tex_path);
+		Model_handle create_box(const float width, const float height, const float length, const std::string& tex_path, const float x, const float y, const float z);
+		void translate_model(const Model_handle id, const float x, const float y, const float z);
+		void rotate_model(const Model_handle id, const float x, const float y, const float z);
+		void scale_model(const Model_handle id, const float x, const float y, const float z);
+		//Parent is a node of the transform hierarchy, NO_PARENT detaches the model
+		void set_model_parent(const Model_handle id, const uint32_t parent_node);
+		uint32_t get_model_node(const Model_handle id) const;
+		Transform_hierarchy& get_transform_hierarchy();
+		void change_texture(const Model_handle id, const std::string& path);
+		void change_mesh(const Model_handle id, const std::string& path);
+		void switch_animated_rotation(const Model_handle id);
+		//Removal and replacement, GPU memory is recycled once the frames already submitted have finished with it
+		void destroy_model(const Model_handle id);
+		void replace_model(const Model_handle id, const std::string& model_path, const std::string& tex_path);
+		bool is_model_alive(const Model_handle id) const;
+		//Streamed models are loaded and unloaded with their grid cell as the active camera moves
+		void add_streamed_model(const std::string& model_path, const float x, const float y, const float z);
+		void add_streamed_model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z);
+		void set_streaming_radii(const float load_radius, const float unload_radius);
+		void set_streaming_budget(const VkDeviceSize bytes);
+		VkDeviceSize get_streamed_memory() const;
 
 
 	private:
 		//User defined attributes
 		std::string app_name;
 		const int WIDTH, HEIGHT;
-		int current_frame = 0;
-		const int MAX_FRAMES_IN_FLIGHT = 2;
-		std::vector<Free_camera> cameras;
-		Free_camera* active_camera;
-		int camera_index;
-		std::vector<std::unique_ptr<Model>> models;
+		Engine_settings settings;
+		uint32_t frames_in_flight;
+		uint32_t current_frame = 0;
+		uint64_t frame_number = 0;
+		Slot_map<Free_camera> cameras;
+		Camera_handle active_camera;
+		size_t camera_index;
+		Slot_map<std::unique_ptr<Model>> models;
+		std::shared_ptr<Resource_pool> resource_pool;
+		Scene_streamer streamer;
+		std::vector<Stream_load> stream_loads;
+		Transform_hierarchy transforms;
+		//Per-object frame data lives in packed component arrays, models only own the GPU resources
+		Scene_registry scene;
+		//Indexed by the slot of a model handle
+		std::vector<Entity> model_entities;
+		//Models whose uploads are still in flight, their entity gets the mesh component once the upload timeline passes them
+		std::vector<Model_handle> pending_models;
+		//Last completed upload when the frame started, and what its submission has to wait for after recording the acquires
+		uint64_t completed_upload = 0;
+		uint64_t upload_wait = 0;
+		VkPipelineStageFlags upload_wait_stages = 0;
+		std::vector<Draw_item> draw_list;
+		//Visible draws before sorting
+		std::vector<Draw_item> draw_candidates;
+		Draw_sorter draw_sorter;
 		uint32_t aspect_ratio;
 		static float delta_time;
 		static float last_frame;
@@ -105,22 +247,81 @@ const bool enable_validation_layers = true;
 		std::vector<VkImage> swap_chain_images;
 		VkFormat swap_chain_image_format;
 		VkExtent2D swap_chain_extent;
+		//Size of the scene targets and the part of them rendered this frame, both equal the swap chain extent
+		//without dynamic resolution
+		VkExtent2D target_extent{};
+		VkExtent2D render_extent{};
+		Resolution_controller resolution;
+		//Two timestamps per frame slot around the whole command buffer
+		VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+		std::vector<bool> timestamps_pending;
+		float gpu_time_ms = 0.0f;
 		std::vector<VkImageView>swap_chain_img_views;
-		VkRenderPass render_pass;
+		//Owned by the render graph, rebuilt with the swap chain
+		std::unique_ptr<Render_graph> render_graph;
+		VkRenderPass render_pass = VK_NULL_HANDLE;
+		VkRenderPass post_render_pass = VK_NULL_HANDLE;
+		uint32_t swap_chain_target = 0;
+		uint32_t scene_target = 0;
+		uint32_t cull_pass = Render_graph::NO_PASS;
+		uint32_t light_pass = Render_graph::NO_PASS;
+		uint32_t depth_pass = Render_graph::NO_PASS;
+		uint32_t scene_pass = Render_graph::NO_PASS;
+		//With occlusion culling the geometry passes above draw the early phase, these the late one
+		uint32_t occlusion_pass = Render_graph::NO_PASS;
+		uint32_t late_depth_pass = Render_graph::NO_PASS;
+		uint32_t late_scene_pass = Render_graph::NO_PASS;
+		uint32_t post_pass = Render_graph::NO_PASS;
+		//Bloom, exposure and tonemapping, followed by a blit when the swap chain can't be written as a storage image
+		uint32_t hdr_pass = Render_graph::NO_PASS;
+		uint32_t blit_pass = Render_graph::NO_PASS;
+		uint32_t tonemap_target = 0;
+		bool swap_chain_storage = false;
+		//Swap chain image the frame being recorded renders to
+		uint32_t current_image = 0;
+		//Set 0 holds the frame uniforms, one buffer and set per frame in flight, set 1 the material of a model
+		VkDescriptorSetLayout frame_set_layout = VK_NULL_HANDLE;
+		VkDescriptorPool frame_descriptor_pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> frame_descriptor_sets;
+		std::vector<VkBuffer> frame_uniform_buffers;
+		std::vector<VkDeviceMemory> frame_uniform_memory;
+		std::vector<void*> frame_uniform_data;
 		VkDescriptorSetLayout descriptor_set_layout;
 		VkPipelineLayout pipeline_layout;
-		VkPipeline pipeline;
-		VkImage depth_img;
-		VkDeviceMemory depth_mem;
-		VkImageView depth_img_view;
-		VkImage colour_img;
-		VkDeviceMemory colour_mem;
-		VkImageView colour_img_view;
-		std::vector<VkFramebuffer> swap_chain_framebuffers;
+		std::array<VkPipeline, 2> pipelines;
+		VkPipeline depth_pipeline = VK_NULL_HANDLE;
+		VkDescriptorSetLayout cull_set_layout = VK_NULL_HANDLE;
+		VkPipelineLayout cull_pipeline_layout = VK_NULL_HANDLE;
+		VkPipeline cull_pipeline = VK_NULL_HANDLE;
+		//Created only when the graphics queue can run compute work
+		std::unique_ptr<Occlusion_culler> occlusion;
+		std::unique_ptr<Shadow_renderer> shadows;
+		//Every mesh of the scene, static ones are only drawn when their cascade's cache is invalid
+		std::vector<Shadow_caster> shadow_casters;
+		Slot_map<Light_data> lights;
+		std::unique_ptr<Light_clusterer> clusterer;
+		//Created only when the graphics queue can run compute work
+		std::unique_ptr<Hdr_processor> hdr;
+		//Lights binned for the current frame, 0 skips the light culling pass
+		uint32_t frame_light_count = 0;
+		float animation_time = 0.0f;
+		VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+		//The scene is rendered into the scene target and filtered into the swap chain image when FXAA or dynamic resolution is on
+		VkDescriptorSetLayout post_set_layout = VK_NULL_HANDLE;
+		VkPipelineLayout post_pipeline_layout = VK_NULL_HANDLE;
+		VkPipeline post_pipeline = VK_NULL_HANDLE;
+		VkSampler post_sampler = VK_NULL_HANDLE;
+		VkDescriptorPool post_descriptor_pool = VK_NULL_HANDLE;
+		VkDescriptorSet post_descriptor_set = VK_NULL_HANDLE;
 		VkCommandPool command_pool;
 		std::vector<VkCommandBuffer> command_buffers;
 		std::vector<VkSemaphore> image_available_semaphores, rendering_finished_semaphores;
-		std::vector<VkFence> in_flight_fences, images_in_flight;
+		VkSemaphore frame_timeline;
+		Deletion_queue deletion_queue;
+		std::chrono::steady_clock::time_point next_frame_deadline{};
+		std::chrono::steady_clock::time_point input_time{};
+		std::chrono::steady_clock::time_point last_present_time{};
+		Latency_stats latency{};
 		bool framebuffer_resized = false;
 		GLFWwindow* window;
 		std::vector<VkExtensionProperties> supported_extensions;
@@ -131,26 +332,59 @@ const bool enable_validation_layers = true;
 		void create_instance();
 		bool check_valid_layer_supp();
 		void debug_messenger_setup();
-		void create_swap_chain();
+		void create_swap_chain(VkSwapchainKHR old_swap_chain);
+		void rebuild_swap_chain();
 		void create_image_views();
 		void create_descriptor_set_layout();
 		void create_graphics_pipeline();
-		void create_render_passes();
-		void create_framebuffers();
+		void create_cull_pipeline();
+		void create_post_pipeline();
+		bool uses_post_pass() const;
+		bool uses_depth_prepass() const;
+		bool uses_occlusion_culling() const;
+		bool uses_hdr() const;
+		VkExtent2D get_scaled_extent(const float scale) const;
+		void update_render_scale();
+		VkPipeline create_pipeline_variant(const bool with_colour);
+		VkPipeline create_depth_pipeline();
+		void build_render_graph();
 		void create_command_pool();
+		Model_handle add_model(std::unique_ptr<Model> model);
+		void configure_model(Model& model);
+		Model_handle register_model(std::unique_ptr<Model> model);
+		Free_camera& current_camera();
+		Entity get_entity(const Model_handle id) const;
+		void retire_texture(const Model& model);
+		void retire_mesh(const Model& model);
+		void detach_model(const Model_handle id);
+		void attach_uploaded_models();
+		void stream_scene();
+		void finish_stream_load(Stream_load& load);
 		VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels);
-		void create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-			VkImageUsageFlags flags, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem, uint32_t mip_levels, VkSampleCountFlagBits num_samples);
-		VkCommandBuffer begin_single_time_commands();
-		void end_single_time_commands(VkCommandBuffer command_buffer);
-		void transition_image_layout(VkImage img, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels);
-		void create_command_buffers();
-		void create_semaphores_and_fences();
-		void create_colour_resources();
-		void create_depth_resources();
+		void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index);
+		void record_depth_pass(VkCommandBuffer command_buffer, Occlusion_phase phase);
+		void record_scene_pass(VkCommandBuffer command_buffer, Occlusion_phase phase);
+		void record_draw_list(VkCommandBuffer command_buffer, const bool depth_only, Occlusion_phase phase);
+		void record_occlusion_pass(VkCommandBuffer command_buffer);
+		void record_post_pass(VkCommandBuffer command_buffer);
+		void record_hdr_pass(VkCommandBuffer command_buffer);
+		void record_blit_pass(VkCommandBuffer command_buffer);
+		void create_frame_resources();
+		void create_frame_uniforms();
+		void destroy_frame_resources();
 		void clean_swap_chain();
+		void update_transforms();
 		void update_uniform_buffer(uint32_t index);
+		void select_lods();
+		void cull_meshlets();
+		void build_draw_list();
+		void update_shadows();
+		void update_lights();
+		void record_light_pass(VkCommandBuffer command_buffer);
+		void record_cull_pass(VkCommandBuffer command_buffer);
 		void draw_frame();
+		void limit_frame_rate();
+		void record_latency();
 		void recreate_swap_chain();
 		void process_input();
 		void info();
@@ -160,7 +394,6 @@ const bool enable_validation_layers = true;
 		uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags prop);
 		VkFormat find_supported_format(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags flags);
 		VkFormat find_depth_format();
-		bool has_stencil_component(VkFormat format);
 		//Static functions
 		static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 			VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -13,7 +13,11 @@
 		if (is_device_suitable(device))
 		{
 			physical_device = device;
-			msaa_samples = get_max_usable_sample_count();
+			VkPhysicalDeviceProperties dev_prop{};
+			vkGetPhysicalDeviceProperties(physical_device, &dev_prop);
+			sample_counts = dev_prop.limits.framebufferColorSampleCounts & dev_prop.limits.framebufferDepthSampleCounts;
+			timestamps = dev_prop.limits.timestampComputeAndGraphics == VK_TRUE;
+			timestamp_period = dev_prop.limits.timestampPeriod;
 			break;
 		}
 	}
@@ -53,8 +57,10 @@ bool VulkanDevice::is_device_suitable(const VkPhysicalDevice& dev)
 [ [ noreturn ] ] void VulkanDevice::create_device(bool enable_validation_layers, const std::vector<const char*>& validation_layers, VkQueue& graphics_queue, VkQueue& present_queue)
 {
 	std::vector<VkDeviceQueueCreateInfo> queue_info_vec{};
-	Queue_family_indecies ind = find_queue_family_indicies(physical_device);
+	Queue_family_indecies ind = queue_families = find_queue_family_indicies(physical_device);
 	std::set<uint32_t> queue_indecies{ ind.graphics_family.value(), ind.present_family.value() };
+	if (ind.transfer_family.has_value())
+		queue_indecies.insert(ind.transfer_family.value());
 	float queue_priority = 1.0f;
 	for (uint32_t queue : queue_indecies)
 	{
@@ -65,13 +71,32 @@ bool VulkanDevice::is_device_suitable(const VkPhysicalDevice& dev)
 		queue_info.pQueuePriorities = &queue_priority;
 		queue_info_vec.emplace_back(queue_info);
 	}
-	VkPhysicalDeviceFeatures device_features{};
-	device_features.samplerAnisotropy = device_features.sampleRateShading = device_features.wideLines = device_features.fillModeNonSolid = VK_TRUE;
+	VkPhysicalDeviceFeatures supported_features{}, device_features{};
+	vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+	device_features.samplerAnisotropy = device_features.wideLines = device_features.fillModeNonSolid = VK_TRUE;
+	//Optional, per sample shading is only used when the settings ask for it
+	device_features.sampleRateShading = supported_features.sampleRateShading;
+	sample_rate_shading = supported_features.sampleRateShading == VK_TRUE;
+	//Without it every indirect draw has to be issued with a draw count of 1
+	device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+	multi_draw_indirect = supported_features.multiDrawIndirect == VK_TRUE;
+	//Lets compute shaders write the swap chain, whose formats have no GLSL image format
+	device_features.shaderStorageImageWriteWithoutFormat = supported_features.shaderStorageImageWriteWithoutFormat;
+	storage_write_without_format = supported_features.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+	uint32_t family_count{};
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> family_properties(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, family_properties.data());
+	graphics_compute = (family_properties.at(ind.graphics_family.value()).queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
 	VkDeviceCreateInfo logical_device_create_info{};
 	logical_device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	logical_device_create_info.pQueueCreateInfos = queue_info_vec.data();
 	logical_device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_info_vec.size());
 	logical_device_create_info.pEnabledFeatures = &device_features;
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features{};
+	timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timeline_features.timelineSemaphore = VK_TRUE;
+	logical_device_create_info.pNext = &timeline_features;
 	logical_device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
 	logical_device_create_info.ppEnabledExtensionNames = device_extensions.data();
 	if (enable_validation_layers)
@@ -81,8 +106,117 @@ bool VulkanDevice::is_device_suitable(const VkPhysicalDevice& dev)
 	}
 	if (vkCreateDevice(physical_device, &logical_device_create_info, nullptr, &device) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create logical device!\n");
+	wait_semaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	if (!wait_semaphores || !get_semaphore_counter_value)
+		throw std::runtime_error("Failed to load timeline semaphore functions!\n");
 	vkGetDeviceQueue(device, ind.graphics_family.value(), 0, &graphics_queue);
 	vkGetDeviceQueue(device, ind.present_family.value(), 0, &present_queue);
+	if (ind.transfer_family.has_value())
+		vkGetDeviceQueue(device, ind.transfer_family.value(), 0, &transfer_queue);
+	create_upload_objects();
+}
+
+void VulkanDevice::create_upload_objects()
+{
+	upload_timeline = create_timeline_semaphore(0);
+	if (!has_transfer_queue())
+		return;
+	VkCommandPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_info.queueFamilyIndex = queue_families.transfer_family.value();
+	if (vkCreateCommandPool(device, &pool_info, nullptr, &transfer_command_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create transfer command pool!\n");
+}
+
+void VulkanDevice::destroy_upload_objects()
+{
+	//The queues are idle by now, so whatever the uploads still hold can go
+	upload_deletions.flush_all();
+	pending_acquires.clear();
+	vkDestroySemaphore(device, upload_timeline, nullptr);
+	if (!has_transfer_queue())
+		return;
+	vkDestroyCommandPool(device, transfer_command_pool, nullptr);
+}
+
+uint64_t VulkanDevice::submit_upload(VkQueue queue, VkCommandBuffer command_buffer, VkCommandPool pool)
+{
+	uint64_t value = ++upload_value;
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info{};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &value;
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &upload_timeline;
+	if (vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit upload command buffer!\n");
+	VkDevice dev = device;
+	upload_deletions.push(value, [=]() { vkFreeCommandBuffers(dev, pool, 1, &command_buffer); });
+	return value;
+}
+
+void VulkanDevice::retire_upload(const uint64_t value, std::function<void()> deleter)
+{
+	upload_deletions.push(value, std::move(deleter));
+}
+
+void VulkanDevice::queue_acquire(Upload_acquire acquire)
+{
+	pending_acquires.push_back(std::move(acquire));
+}
+
+uint64_t VulkanDevice::record_acquires(VkCommandBuffer command_buffer, const uint64_t completed, VkPipelineStageFlags& wait_stages)
+{
+	uint64_t value = 0;
+	wait_stages = 0;
+	//The transfer queue completes uploads in submission order, so the ready ones are at the front
+	while (!pending_acquires.empty() && pending_acquires.front().value <= completed)
+	{
+		Upload_acquire& acquire = pending_acquires.front();
+		//Starting at the stage the frame waits on the timeline in chains the barrier to the copy
+		vkCmdPipelineBarrier(command_buffer, acquire.dst_stage, acquire.dst_stage, 0, 0, nullptr,
+			static_cast<uint32_t>(acquire.buffer_barriers.size()), acquire.buffer_barriers.data(),
+			static_cast<uint32_t>(acquire.image_barriers.size()), acquire.image_barriers.data());
+		if (acquire.after)
+			acquire.after(command_buffer);
+		value = acquire.value;
+		wait_stages |= acquire.dst_stage;
+		pending_acquires.pop_front();
+	}
+	return value;
+}
+
+void VulkanDevice::cancel_acquires(const std::vector<VkBuffer>& buffers, VkImage image)
+{
+	auto released = [&](const Upload_acquire& acquire) {
+		for (const auto& barrier : acquire.buffer_barriers)
+			if (std::find(buffers.begin(), buffers.end(), barrier.buffer) != buffers.end())
+				return true;
+		for (const auto& barrier : acquire.image_barriers)
+			if (barrier.image == image)
+				return true;
+		return false;
+	};
+	pending_acquires.erase(std::remove_if(pending_acquires.begin(), pending_acquires.end(), released), pending_acquires.end());
+}
+
+uint64_t VulkanDevice::collect_uploads()
+{
+	uint64_t completed = get_timeline_value(upload_timeline);
+	upload_deletions.flush(completed);
+	return completed;
+}
+
+void VulkanDevice::wait_upload(const uint64_t value)
+{
+	wait_timeline(upload_timeline, std::min(value, upload_value));
 }
 
 Queue_family_indecies VulkanDevice::find_queue_family_indicies(const VkPhysicalDevice& dev)
@@ -94,14 +228,20 @@ Queue_family_indecies VulkanDevice::find_queue_family_indicies(const VkPhysicalD
 	vkGetPhysicalDeviceQueueFamilyProperties(dev, &family_count, queue_families.data());
 	for (int i = 0; i < queue_families.size(); ++i)
 	{
+		VkQueueFlags flags = queue_families.at(i).queueFlags;
+		VkExtent3D granularity = queue_families.at(i).minImageTransferGranularity;
+		bool copy_engine = (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+		//Coarser granularity would forbid copying the small mip levels, so such queues are skipped
+		if (copy_engine && granularity.width == 1 && granularity.height == 1 && granularity.depth == 1 && !indecies.transfer_family.has_value())
+			indecies.transfer_family = i;
+		if (indecies.is_complete())
+			continue;
 		if (queue_families.at(i).queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			indecies.graphics_family = i;
 		VkBool32 present_family = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, surface, &present_family);
 		if (present_family)
 			indecies.present_family = i;
-		if (indecies.is_complete())
-			break;
 	}
 
 	return indecies;
@@ -130,24 +270,12 @@ Swap_chain_support_details VulkanDevice::query_swap_chain_support(const VkPhysic
 	return details;
 }
 
-VkSampleCountFlagBits VulkanDevice::get_max_usable_sample_count()
-{
-	VkPhysicalDeviceProperties dev_prop{};
-	vkGetPhysicalDeviceProperties(physical_device, &dev_prop);
-	VkSampleCountFlags counts = std::min(dev_prop.limits.framebufferColorSampleCounts, dev_prop.limits.framebufferDepthSampleCounts);
-	if (counts & VK_SAMPLE_COUNT_64_BIT)
-		return VK_SAMPLE_COUNT_64_BIT;
-	if (counts & VK_SAMPLE_COUNT_32_BIT)
-		return VK_SAMPLE_COUNT_32_BIT;
-	if (counts & VK_SAMPLE_COUNT_16_BIT)
-		return VK_SAMPLE_COUNT_16_BIT;
-	if (counts & VK_SAMPLE_COUNT_8_BIT)
-		return VK_SAMPLE_COUNT_8_BIT;
-	if (counts & VK_SAMPLE_COUNT_4_BIT)
-		return VK_SAMPLE_COUNT_4_BIT;
-	if (counts & VK_SAMPLE_COUNT_2_BIT)
-		return VK_SAMPLE_COUNT_2_BIT;
-
+VkSampleCountFlagBits VulkanDevice::get_usable_sample_count(const uint32_t requested) const
+{
+	//Sample count bits equal the counts they stand for
+	for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1)
+		if (count <= requested && (sample_counts & count))
+			return static_cast<VkSampleCountFlagBits>(count);
 	return VK_SAMPLE_COUNT_1_BIT;
 }
 
@@ -170,3 +298,36 @@ VkPhysicalDeviceMemoryProperties VulkanDevice::get_memory_properties()
 	vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
 	return mem_props;
 }
+
+VkSemaphore VulkanDevice::create_timeline_semaphore(uint64_t initial_value)
+{
+	VkSemaphoreTypeCreateInfoKHR type_info{};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	type_info.initialValue = initial_value;
+	VkSemaphoreCreateInfo semaphore_info{};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+	VkSemaphore semaphore;
+	if (vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timeline semaphore!\n");
+	return semaphore;
+}
+
+void VulkanDevice::wait_timeline(VkSemaphore semaphore, uint64_t value)
+{
+	VkSemaphoreWaitInfoKHR wait_info{};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &semaphore;
+	wait_info.pValues = &value;
+	if (wait_semaphores(device, &wait_info, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to wait for timeline semaphore!\n");
+}
+
+uint64_t VulkanDevice::get_timeline_value(VkSemaphore semaphore)
+{
+	uint64_t value{};
+	get_semaphore_counter_value(device, semaphore, &value);
+	return value;
+}
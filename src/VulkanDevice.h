@@ -5,32 +5,93 @@
 #include <set>
 #include <iostream>
 #include <algorithm>
+#include <limits>
+#include <deque>
+#include <functional>
 #include "vulkan/vulkan.h"
 #include "utility.h"
+#include "deletion_queue.h"
+
+//Graphics queue half of an upload's ownership transfer, recorded into the first frame after the copy has completed
+struct Upload_acquire
+{
+	uint64_t value;
+	std::vector<VkBufferMemoryBarrier> buffer_barriers;
+	std::vector<VkImageMemoryBarrier> image_barriers;
+	VkPipelineStageFlags dst_stage;
+	//Graphics work that has to follow the acquire, such as blitting the mip chain
+	std::function<void(VkCommandBuffer)> after;
+};
 	class VulkanDevice
 	{
 		VkInstance instance;
 		VkSurfaceKHR& surface;
 		VkPhysicalDevice physical_device = VK_NULL_HANDLE;
 		VkDevice device;
-		VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+		Queue_family_indecies queue_families;
+		VkQueue transfer_queue = VK_NULL_HANDLE;
+		VkCommandPool transfer_command_pool = VK_NULL_HANDLE;
+		//Signalled by every upload submission, what an upload holds is freed once the timeline passes its value
+		VkSemaphore upload_timeline = VK_NULL_HANDLE;
+		uint64_t upload_value = 0;
+		Deletion_queue upload_deletions;
+		std::deque<Upload_acquire> pending_acquires;
+		VkSampleCountFlags sample_counts = VK_SAMPLE_COUNT_1_BIT;
+		bool sample_rate_shading = false;
+		bool timestamps = false;
+		float timestamp_period = 1.0f;
+		bool multi_draw_indirect = false;
+		bool storage_write_without_format = false;
+		bool graphics_compute = false;
 		uint32_t supported_extension_count;
-		const std::vector<const char*>device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		const std::vector<const char*>device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+		PFN_vkWaitSemaphoresKHR wait_semaphores = nullptr;
+		PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value = nullptr;
 		std::vector<VkExtensionProperties> supported_extensions;
 		void create_physical_device();
 		bool check_device_extension_support(const VkPhysicalDevice& dev);
 		bool is_device_suitable(const VkPhysicalDevice& dev);
 		void create_device(bool enable_validation_layers, const std::vector<const char*>& validation_layers, VkQueue& graphics_queue, VkQueue& present_queue);
-		VkSampleCountFlagBits get_max_usable_sample_count();
+		void create_upload_objects();
 	public:
 		VulkanDevice(VkInstance& inst, VkSurfaceKHR& srfc, bool enable_validation_layers, const std::vector<const char*>& validation_layers, VkQueue& graphics_queue, VkQueue& present_queue);
 		VkFormatProperties get_format_properties(VkFormat& format);
 		VkPhysicalDeviceMemoryProperties get_memory_properties();
 		Queue_family_indecies find_queue_family_indicies(const VkPhysicalDevice& dev);
 		Swap_chain_support_details query_swap_chain_support(const VkPhysicalDevice& dev);
-		inline VkSampleCountFlagBits get_msaa_samples() { return msaa_samples; };
+		//Highest count usable for both colour and depth attachments that doesn't exceed the requested one
+		VkSampleCountFlagBits get_usable_sample_count(const uint32_t requested) const;
+		inline bool supports_sample_rate_shading() const { return sample_rate_shading; };
+		//Nanoseconds per timestamp tick, only meaningful when timestamps are supported on the graphics queue
+		inline bool supports_timestamps() const { return timestamps; };
+		inline float get_timestamp_period() const { return timestamp_period; };
 		inline VkDevice& get_device() { return device; };
 		inline VkPhysicalDevice get_physical_device() { return physical_device; };
+		inline bool has_transfer_queue() const { return transfer_queue != VK_NULL_HANDLE; };
+		inline VkQueue get_transfer_queue() { return transfer_queue; };
+		inline VkCommandPool get_transfer_command_pool() { return transfer_command_pool; };
+		inline VkSemaphore get_upload_timeline() { return upload_timeline; };
+		inline uint32_t get_graphics_family() const { return queue_families.graphics_family.value(); };
+		inline uint32_t get_transfer_family() const { return queue_families.transfer_family.value(); };
+		inline bool supports_multi_draw_indirect() const { return multi_draw_indirect; };
+		inline bool supports_storage_write_without_format() const { return storage_write_without_format; };
+		inline bool graphics_supports_compute() const { return graphics_compute; };
+		void destroy_upload_objects();
+		//Uploads never wait on the CPU, each submission signals the next value of the upload timeline and returns it
+		uint64_t submit_upload(VkQueue queue, VkCommandBuffer command_buffer, VkCommandPool pool);
+		void retire_upload(const uint64_t value, std::function<void()> deleter);
+		void queue_acquire(Upload_acquire acquire);
+		//Records the acquires of uploads up to completed and returns the value the frame has to wait for, 0 when none
+		uint64_t record_acquires(VkCommandBuffer command_buffer, const uint64_t completed, VkPipelineStageFlags& wait_stages);
+		//Resources thrown away before their acquire was recorded are never handed over, their copies have to be complete
+		void cancel_acquires(const std::vector<VkBuffer>& buffers, VkImage image);
+		//Frees what completed uploads held and returns the last completed value
+		uint64_t collect_uploads();
+		void wait_upload(const uint64_t value);
+		//Timeline semaphores
+		VkSemaphore create_timeline_semaphore(uint64_t initial_value);
+		void wait_timeline(VkSemaphore semaphore, uint64_t value);
+		uint64_t get_timeline_value(VkSemaphore semaphore);
 	};
 #endif
 
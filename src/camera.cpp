@@ -20,41 +20,46 @@ Free_camera::Free_camera(const float x, const float y, const float z, const floa
 }
 void Free_camera::update()
 {
-	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotation = glm::rotate(rotation, glm::radians(pitch), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotation = glm::rotate(rotation, glm::radians(roll), glm::vec3(0.0f, 0.0f, 1.0f));
-	position += translation;
-	translation = glm::vec3(0.0f);
-	look = glm::vec3(rotation * glm::vec4( 0.0f, 0.0f, 1.0f, 0.0f ));
-	up = glm::vec3(rotation * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
-	right = glm::cross(look, up);
-	glm::vec3 point = position + look;
-	view = glm::lookAt(position, point, up);
-	set_projection_matrix();
+	if (view_dirty)
+	{
+		//Same as rotating about y, then x, then z
+		glm::mat4 rotation = glm::eulerAngleYXZ(glm::radians(yaw), glm::radians(pitch), glm::radians(roll));
+		position += translation;
+		translation = glm::vec3(0.0f);
+		look = glm::vec3(rotation[2]);
+		up = glm::vec3(rotation[1]);
+		right = glm::cross(look, up);
+		glm::vec3 point = position + look;
+		view = glm::lookAt(position, point, up);
+		view_dirty = false;
+	}
+	if (projection_dirty)
+		set_projection_matrix();
 }
 
+//Movement accumulates along the axes of the last update and is applied by the next one
 void Free_camera::walk(const float dt)
 {
 	translation += dt * look;
-	update();
+	view_dirty = true;
 }
 
 void Free_camera::strafe(const float dt)
 {
 	translation += dt * right;
-	update();
+	view_dirty = true;
 }
 
 void Free_camera::lift(const float dt)
 {
 	translation += dt * up;
-	update();
+	view_dirty = true;
 }
 
 void Free_camera::set_translation_vector(const float x, const float y, const float z)
 {
 	translation = glm::vec3(x, y, z);
-	update();
+	view_dirty = true;
 }
 
 void Free_camera::rotate(const float y, const float p)
@@ -65,7 +70,7 @@ void Free_camera::rotate(const float y, const float p)
 		pitch = 89.0f;
 	else if (pitch < -89.0f)
 		pitch = -89.0f;
-	update();
+	view_dirty = true;
 
 }
 
@@ -107,6 +112,7 @@ Camera::Camera(const float x, const float y, const float z, const float aspect):
 void Camera::set_projection_matrix()
 {
 	projection = glm::perspective(glm::radians(fov), aspect_ratio, Z_near, Z_far);
+	projection_dirty = false;
 }
 
 const glm::mat4 Camera::get_projection_matrix() const
@@ -122,25 +128,20 @@ const glm::mat4 Camera::get_view_matrix() const
 void Camera::set_position_vector(const float x, const float y, const float z)
 {
 	position = glm::vec3(x, y, z);
+	view_dirty = true;
 }
 
 void Camera::set_fov(const float f)
 {
-	if (fov < 1.0f)
-		fov = 1.0f;
-	else if (fov > 180.0f)
-		fov = 180.0f;
-	else
-	{
-		fov += f;
-		update();
-	}
+	float new_fov = glm::clamp(fov + f, 1.0f, 179.0f);
+	projection_dirty = projection_dirty || new_fov != fov;
+	fov = new_fov;
 }
 
 void Camera::set_aspect_ratio(const float a)
 {
+	projection_dirty = projection_dirty || a != aspect_ratio;
 	aspect_ratio = a;
-	update();
 }
 
 void Camera::set_rotation(const float y, const float p, const float r)
@@ -148,6 +149,7 @@ void Camera::set_rotation(const float y, const float p, const float r)
 	yaw = y;
 	pitch = p;
 	roll = r;
+	view_dirty = true;
 }
 
 const glm::vec3 Camera::get_position_vector() const
@@ -159,3 +161,13 @@ const float Camera::get_fov() const
 {
 	return fov;
 }
+
+float Camera::get_near_plane() const
+{
+	return Z_near;
+}
+
+float Camera::get_far_plane() const
+{
+	return Z_far;
+}
@@ -10,6 +10,8 @@ protected:
 	glm::mat4 view, projection;
 	float fov, aspect_ratio, Z_near, Z_far, yaw, pitch, roll = 0;
 	glm::vec3 look, up, right, position;
+	//Changes only mark the matrices, update rebuilds each one at most once per call
+	bool view_dirty = true, projection_dirty = true;
 
 public:
 	Camera();
@@ -17,6 +19,7 @@ public:
 	Camera(const float x, const float y, const float z);
 	Camera(const float x, const float y, const float z, const float aspect);
 	virtual ~Camera() = default;
+	//Called once per frame, before the matrices are read
 	virtual void update() = 0;
 	virtual void rotate(const float y, const float p) = 0;
 	void set_projection_matrix();
@@ -28,6 +31,8 @@ public:
 	void set_rotation(const float y, const float p, const float r);
 	const glm::vec3 get_position_vector() const;
 	const float get_fov() const;
+	float get_near_plane() const;
+	float get_far_plane() const;
 
 };
 class Free_camera : public Camera
@@ -1,4 +1,22 @@
 C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe vertex_shader5.vert -o vert.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe vertex_shader_no_colour.vert -o vert_no_colour.spv
 C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe fragment_shader.frag -o frag.spv
 C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe fragment_shader_wireframe.frag -o frag_wire.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe meshlet_cull.comp -o meshlet_cull.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe fullscreen_triangle.vert -o fullscreen.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe fxaa.frag -o fxaa.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe upscale.frag -o upscale.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe vertex_shader_depth.vert -o vert_depth.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe occlusion_cull.comp -o occlusion_cull.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe hzb_build.comp -o hzb_build.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe -DMULTISAMPLED hzb_build.comp -o hzb_build_ms.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe shadow.vert -o shadow.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe cluster_build.comp -o cluster_build.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe light_cull.comp -o light_cull.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe -DPREFILTER bloom_downsample.comp -o bloom_prefilter.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe bloom_downsample.comp -o bloom_downsample.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe bloom_upsample.comp -o bloom_upsample.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe exposure.comp -o exposure.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe tonemap.comp -o tonemap.spv
+C:/VulkanSDK/1.1.121.2/Bin32/glslc.exe -DUNFORMATTED_OUTPUT tonemap.comp -o tonemap_unformatted.spv
 pause
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "deletion_queue.h"
+
+void Deletion_queue::push(const uint64_t frame, std::function<void()> deleter)
+{
+	pending.emplace_back(frame, std::move(deleter));
+}
+
+void Deletion_queue::flush(const uint64_t completed_frame)
+{
+	//Entries are pushed with non-decreasing frame numbers, so the front is always the oldest
+	while (!pending.empty() && pending.front().first <= completed_frame)
+	{
+		pending.front().second();
+		pending.pop_front();
+	}
+}
+
+void Deletion_queue::flush_all()
+{
+	for (auto& entry : pending)
+		entry.second();
+	pending.clear();
+}
+
+bool Deletion_queue::empty() const
+{
+	return pending.empty();
+}
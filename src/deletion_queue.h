@@ -0,0 +1,17 @@
+#ifndef DELETION_QUEUE_H
+#define DELETION_QUEUE_H
+#include <deque>
+#include <functional>
+#include <utility>
+#include <cstdint>
+//Destroys resources once the last frame that could reference them has completed on the GPU
+class Deletion_queue
+{
+	std::deque<std::pair<uint64_t, std::function<void()>>> pending;
+public:
+	void push(const uint64_t frame, std::function<void()> deleter);
+	void flush(const uint64_t completed_frame);
+	void flush_all();
+	bool empty() const;
+};
+#endif // !DELETION_QUEUE_H
@@ -0,0 +1,60 @@
+#include "draw_sorter.h"
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+uint64_t Draw_sorter::make_key(const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const float depth,
+	const float near_plane, const float far_plane)
+{
+	const uint32_t depth_bits = DEPTH_BAND_BITS + FINE_DEPTH_BITS;
+	float t = std::log(std::max(depth, near_plane) / near_plane) / std::log(far_plane / near_plane);
+	uint64_t quantized = static_cast<uint64_t>(std::clamp(t, 0.0f, 1.0f) * static_cast<float>((1u << depth_bits) - 1));
+	uint64_t key = pipeline & ((1u << PIPELINE_BITS) - 1);
+	key = (key << DEPTH_BAND_BITS) | (quantized >> FINE_DEPTH_BITS);
+	key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+	key = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+	return (key << FINE_DEPTH_BITS) | (quantized & ((1u << FINE_DEPTH_BITS) - 1));
+}
+
+void Draw_sorter::clear()
+{
+	keys.clear();
+	order.clear();
+}
+
+void Draw_sorter::add(const uint64_t key)
+{
+	order.push_back(static_cast<uint32_t>(keys.size()));
+	keys.push_back(key);
+}
+
+const std::vector<uint32_t>& Draw_sorter::sort()
+{
+	//Least significant digit first, one byte per pass. Bytes every key shares, such as unused pipeline bits, are skipped
+	key_scratch.resize(keys.size());
+	order_scratch.resize(order.size());
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		std::array<uint32_t, 256> offsets{};
+		for (const auto key : keys)
+			++offsets[(key >> shift) & 0xFF];
+		if (keys.empty() || offsets[(keys.front() >> shift) & 0xFF] == keys.size())
+			continue;
+		uint32_t sum = 0;
+		for (auto& offset : offsets)
+		{
+			uint32_t count = offset;
+			offset = sum;
+			sum += count;
+		}
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			uint32_t dst = offsets[(keys[i] >> shift) & 0xFF]++;
+			key_scratch[dst] = keys[i];
+			order_scratch[dst] = order[i];
+		}
+		keys.swap(key_scratch);
+		order.swap(order_scratch);
+	}
+	return order;
+}
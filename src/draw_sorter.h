@@ -0,0 +1,28 @@
+#ifndef DRAW_SORTER_H
+#define DRAW_SORTER_H
+#include <vector>
+#include <cstdint>
+
+//Orders the draws of a frame by 64 bit keys. From the most significant bits down a key holds the pipeline,
+//a coarse view depth band, the material, the mesh and the depth within the band, so draws are grouped by
+//state while still going roughly front to back for early depth rejection
+class Draw_sorter
+{
+	std::vector<uint64_t> keys, key_scratch;
+	std::vector<uint32_t> order, order_scratch;
+public:
+	static constexpr uint32_t PIPELINE_BITS = 4;
+	static constexpr uint32_t DEPTH_BAND_BITS = 8;
+	static constexpr uint32_t MATERIAL_BITS = 20;
+	static constexpr uint32_t MESH_BITS = 20;
+	static constexpr uint32_t FINE_DEPTH_BITS = 12;
+	//Depth is the view space distance, spread logarithmically between the planes so near draws get finer steps.
+	//Identifiers wider than their field wrap, which only costs grouping
+	static uint64_t make_key(const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const float depth,
+		const float near_plane, const float far_plane);
+	void clear();
+	void add(const uint64_t key);
+	//Indices of the added draws in ascending key order, stable for equal keys
+	const std::vector<uint32_t>& sort();
+};
+#endif // !DRAW_SORTER_H
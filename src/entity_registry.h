@@ -0,0 +1,119 @@
+#ifndef ENTITY_REGISTRY_H
+#define ENTITY_REGISTRY_H
+#include <vector>
+#include <tuple>
+#include <cstdint>
+#include <stdexcept>
+
+using Entity = uint32_t;
+
+//Components are packed densely with an entity indexed lookup table, removal moves the last component into
+//the hole so systems always iterate a gap free array
+template<typename Component>
+class Sparse_set
+{
+	static constexpr uint32_t ABSENT = UINT32_MAX;
+	std::vector<uint32_t> sparse;
+	std::vector<Entity> entities;
+	std::vector<Component> components;
+public:
+	Component& emplace(const Entity entity, const Component& component)
+	{
+		if (entity >= sparse.size())
+			sparse.resize(static_cast<size_t>(entity) + 1, ABSENT);
+		if (sparse[entity] != ABSENT)
+			return components[sparse[entity]] = component;
+		sparse[entity] = static_cast<uint32_t>(components.size());
+		entities.push_back(entity);
+		components.push_back(component);
+		return components.back();
+	}
+	void remove(const Entity entity)
+	{
+		if (!contains(entity))
+			return;
+		uint32_t index = sparse[entity];
+		Entity last = entities.back();
+		components[index] = std::move(components.back());
+		entities[index] = last;
+		sparse[last] = index;
+		components.pop_back();
+		entities.pop_back();
+		sparse[entity] = ABSENT;
+	}
+	bool contains(const Entity entity) const
+	{
+		return entity < sparse.size() && sparse[entity] != ABSENT;
+	}
+	Component& get(const Entity entity)
+	{
+		if (!contains(entity))
+			throw std::runtime_error("Entity doesn't have the requested component!\n");
+		return components[sparse[entity]];
+	}
+	const Component& get(const Entity entity) const
+	{
+		if (!contains(entity))
+			throw std::runtime_error("Entity doesn't have the requested component!\n");
+		return components[sparse[entity]];
+	}
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(components.size());
+	}
+	std::vector<Component>& data()
+	{
+		return components;
+	}
+	const std::vector<Entity>& get_entities() const
+	{
+		return entities;
+	}
+};
+
+//Owns one sparse set per component type, destroyed entities are recycled
+template<typename... Components>
+class Entity_registry
+{
+	std::tuple<Sparse_set<Components>...> pools;
+	std::vector<Entity> free_entities;
+	//Guards the free list, an entity queued twice would be handed out to two creators
+	std::vector<bool> alive;
+	Entity next_entity = 0;
+public:
+	Entity create()
+	{
+		if (free_entities.empty())
+		{
+			alive.push_back(true);
+			return next_entity++;
+		}
+		Entity entity = free_entities.back();
+		free_entities.pop_back();
+		alive[entity] = true;
+		return entity;
+	}
+	void destroy(const Entity entity)
+	{
+		if (!is_alive(entity))
+			return;
+		(std::get<Sparse_set<Components>>(pools).remove(entity), ...);
+		alive[entity] = false;
+		free_entities.push_back(entity);
+	}
+	bool is_alive(const Entity entity) const
+	{
+		return entity < alive.size() && alive[entity];
+	}
+	template<typename Component>
+	Sparse_set<Component>& get()
+	{
+		return std::get<Sparse_set<Component>>(pools);
+	}
+	template<typename Component>
+	const Sparse_set<Component>& get() const
+	{
+		return std::get<Sparse_set<Component>>(pools);
+	}
+};
+#endif // !ENTITY_REGISTRY_H
@@ -1,13 +1,111 @@
 #version 450
 #extension GL_ARB_separate_shader_objects: enable
 
+layout (set = 0, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 proj;
+    mat4 shadowMatrices[4];
+    vec4 cascadeSplits;
+    //x cascade count, 0 without shadows, y shadow map texel size, z light left in shadow
+    vec4 shadowParams;
+    //xyz clusters along each axis, w light count
+    uvec4 clusterGrid;
+    //Slice scale and bias, render area in pixels
+    vec4 clusterParams;
+    //x 1 when the output is display colour, 0 when it goes into the HDR chain
+    vec4 outputParams;
+} frame;
+
+struct Light
+{
+    vec4 positionRange;
+    vec4 colourIntensity;
+    vec4 directionOuter;
+    vec4 spot;
+};
+
 layout(location = 0) out vec4 outColour;
 layout(location = 0) in vec3 fragColour;
 layout(location = 1) in vec2 fragTexCord;
-layout(binding = 1) uniform sampler2D textureSampler;
+layout(location = 2) in vec3 fragPosition;
+layout(set = 0, binding = 1) uniform sampler2DArrayShadow staticShadows;
+layout(set = 0, binding = 2) uniform sampler2DArrayShadow dynamicShadows;
+layout(std430, set = 0, binding = 3) readonly buffer Lights
+{
+    Light lights[];
+};
+layout(std430, set = 0, binding = 4) readonly buffer LightGrid
+{
+    uvec2 lightGrid[];
+};
+layout(std430, set = 0, binding = 5) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+
+//Fraction of the light reaching the fragment, static and moving casters are kept in separate maps
+float shadow()
+{
+	int count = int(frame.shadowParams.x);
+	float depth = -(frame.view * vec4(fragPosition, 1.0)).z;
+	if (count == 0 || depth > frame.cascadeSplits[count - 1])
+		return 1.0;
+	int cascade = 0;
+	while (cascade < count - 1 && depth > frame.cascadeSplits[cascade])
+		++cascade;
+	vec4 light = frame.shadowMatrices[cascade] * vec4(fragPosition, 1.0);
+	vec2 uv = light.xy * 0.5 + 0.5;
+	//3x3 PCF, each tap is already a bilinear blend of four comparisons
+	float lit = 0.0;
+	for (int y = -1; y <= 1; ++y)
+		for (int x = -1; x <= 1; ++x)
+		{
+			vec4 coord = vec4(uv + vec2(x, y) * frame.shadowParams.y, cascade, light.z);
+			lit += texture(staticShadows, coord) * texture(dynamicShadows, coord);
+		}
+	return lit / 9.0;
+}
+
+//Light of the cluster's point and spot lights. There are no vertex normals, so only distance and cone are accounted for
+vec3 clusterLights()
+{
+    if (frame.clusterGrid.w == 0)
+        return vec3(0.0);
+    float depth = -(frame.view * vec4(fragPosition, 1.0)).z;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / frame.clusterParams.zw * vec2(frame.clusterGrid.xy)), frame.clusterGrid.xy - 1);
+    uint slice = uint(clamp(floor(log(max(depth, 1e-4)) * frame.clusterParams.x - frame.clusterParams.y), 0.0, float(frame.clusterGrid.z - 1)));
+    uvec2 range = lightGrid[tile.x + frame.clusterGrid.x * (tile.y + frame.clusterGrid.y * slice)];
+    vec3 result = vec3(0.0);
+    for (uint i = range.x; i < range.x + range.y; ++i)
+    {
+        Light light = lights[lightIndices[i]];
+        vec3 offset = light.positionRange.xyz - fragPosition;
+        float distance = length(offset);
+        //Inverse square falloff windowed to reach zero at the range
+        float window = clamp(1.0 - pow(distance / light.positionRange.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+        float cone = dot(-offset / max(distance, 1e-4), light.directionOuter.xyz);
+        attenuation *= smoothstep(light.directionOuter.w, light.spot.x, cone);
+        result += light.colourIntensity.rgb * light.colourIntensity.w * attenuation;
+    }
+    return result;
+}
+
+//Neither the swap chain nor the LDR scene image is an sRGB format, so the curve is applied here
+vec3 linearToSrgb(vec3 colour)
+{
+	return mix(colour * 12.92, 1.055 * pow(colour, vec3(1.0 / 2.4)) - 0.055, greaterThan(colour, vec3(0.0031308)));
+}
 
 void main()
 {
 	//outColour = vec4(texture(textureSampler, fragTexCord).rgb / fragColour, 1.0);
-	outColour = texture(textureSampler, fragTexCord);
-}
\ No newline at end of file
+	//The texture is sRGB, so lighting is done on linear values and the result is encoded once on the way to the display
+	vec4 colour = texture(textureSampler, fragTexCord);
+	vec3 lit = colour.rgb * (mix(frame.shadowParams.z, 1.0, shadow()) + clusterLights());
+	if (frame.outputParams.x != 0.0)
+		lit = linearToSrgb(clamp(lit, 0.0, 1.0));
+	outColour = vec4(lit, colour.a);
+}
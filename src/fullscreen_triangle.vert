@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+
+layout(location = 0) out vec2 fragTexCord;
+
+//One triangle covering the screen, uv spans 0..2 so the visible part maps to 0..1
+void main()
+{
+	fragTexCord = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(fragTexCord * 2.0 - 1.0, 0.0, 1.0);
+}
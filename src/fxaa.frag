@@ -0,0 +1,58 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+
+layout(location = 0) out vec4 outColour;
+layout(location = 0) in vec2 fragTexCord;
+layout(binding = 0) uniform sampler2D sceneSampler;
+layout(push_constant) uniform Post_constants
+{
+	vec2 texelSize;
+	vec2 uvScale;
+} constants;
+
+const float EDGE_THRESHOLD_MIN = 0.0312;
+const float EDGE_THRESHOLD_MAX = 0.125;
+const float SPAN_MAX = 8.0;
+const float REDUCE_MUL = 1.0 / 8.0;
+const float REDUCE_MIN = 1.0 / 128.0;
+
+float luma(vec3 colour)
+{
+	return dot(colour, vec3(0.299, 0.587, 0.114));
+}
+
+//Only the top left part scaled by uvScale holds the rendered scene, taps must not read past it
+vec4 sampleScene(vec2 uv)
+{
+	return texture(sceneSampler, clamp(uv, 0.5 * constants.texelSize, constants.uvScale - 0.5 * constants.texelSize));
+}
+
+void main()
+{
+	vec2 uv = fragTexCord * constants.uvScale;
+	vec4 centre = sampleScene(uv);
+	float lumaM = luma(centre.rgb);
+	float lumaNW = luma(sampleScene(uv + vec2(-1.0, -1.0) * constants.texelSize).rgb);
+	float lumaNE = luma(sampleScene(uv + vec2(1.0, -1.0) * constants.texelSize).rgb);
+	float lumaSW = luma(sampleScene(uv + vec2(-1.0, 1.0) * constants.texelSize).rgb);
+	float lumaSE = luma(sampleScene(uv + vec2(1.0, 1.0) * constants.texelSize).rgb);
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+	//Flat areas are left untouched
+	if (lumaMax - lumaMin < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD_MAX))
+	{
+		outColour = centre;
+		return;
+	}
+	//Blur along the edge, perpendicular to the luma gradient
+	vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+	float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL, REDUCE_MIN);
+	float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+	dir = clamp(dir * rcpDirMin, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * constants.texelSize;
+	vec3 rgbA = 0.5 * (sampleScene(uv + dir * (1.0 / 3.0 - 0.5)).rgb
+		+ sampleScene(uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+	vec3 rgbB = rgbA * 0.5 + 0.25 * (sampleScene(uv + dir * -0.5).rgb
+		+ sampleScene(uv + dir * 0.5).rgb);
+	float lumaB = luma(rgbB);
+	outColour = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, centre.a);
+}
@@ -0,0 +1,453 @@
+#include "hdr_processor.h"
+#include "shader.h"
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	const VkFormat BLOOM_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+	const uint32_t HISTOGRAM_BINS = 256;
+	//Used part of bloom level i for a rendered area, every level halves the one above
+	VkExtent2D get_level_extent(VkExtent2D extent, const uint32_t level)
+	{
+		return { std::max(1u, extent.width >> (level + 1)), std::max(1u, extent.height >> (level + 1)) };
+	}
+	uint32_t get_group_count(const uint32_t size)
+	{
+		return (size + 7) / 8;
+	}
+}
+
+Hdr_processor::Hdr_processor(std::shared_ptr<VulkanDevice> device, const bool unformatted_support) : dev(device)
+{
+	create_pipelines(unformatted_support);
+	create_buffer(sizeof(uint32_t) * HISTOGRAM_BINS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, histogram, histogram_mem);
+	create_buffer(sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, exposure, exposure_mem);
+}
+
+Hdr_processor::~Hdr_processor()
+{
+	destroy();
+}
+
+void Hdr_processor::create_pipelines(const bool unformatted_support)
+{
+	VkDevice device = dev->get_device();
+	//Source, destination, histogram, adapted luminance and the bloom read by the tonemapping pass
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings.at(i).binding = i;
+		bindings.at(i).descriptorType = i == 0 || i == 4 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+			: i == 1 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings.at(i).descriptorCount = 1;
+		bindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo set_layout_info{};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	set_layout_info.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &set_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create HDR descriptor set layout!\n");
+
+	//Every step shares the layout, the range covers the largest constants
+	VkPushConstantRange push_range{};
+	push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_range.size = static_cast<uint32_t>(std::max({ sizeof(Bloom_constants), sizeof(Exposure_constants), sizeof(Tonemap_constants) }));
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &set_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_range;
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create HDR pipeline layout!\n");
+
+	prefilter_pipeline = create_compute_pipeline(R"(src\bloom_prefilter.spv)");
+	downsample_pipeline = create_compute_pipeline(R"(src\bloom_downsample.spv)");
+	upsample_pipeline = create_compute_pipeline(R"(src\bloom_upsample.spv)");
+	exposure_pipeline = create_compute_pipeline(R"(src\exposure.spv)");
+	tonemap_pipeline = create_compute_pipeline(R"(src\tonemap.spv)");
+	if (unformatted_support)
+		unformatted_tonemap_pipeline = create_compute_pipeline(R"(src\tonemap_unformatted.spv)");
+
+	//Bilinear taps between texels do part of the filtering
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = sampler_info.addressModeV = sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	if (vkCreateSampler(device, &sampler_info, nullptr, &sampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create HDR sampler!\n");
+}
+
+VkPipeline Hdr_processor::create_compute_pipeline(const std::string& path)
+{
+	Shader compute_shader(path, dev->get_device());
+	VkShaderModule compute_module = compute_shader.create_shader_module();
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = compute_module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = pipeline_layout;
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(dev->get_device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create HDR pipeline!\n");
+	vkDestroyShaderModule(dev->get_device(), compute_module, nullptr);
+	return pipeline;
+}
+
+void Hdr_processor::set_bloom(const float threshold, const float intensity)
+{
+	bloom_threshold = std::max(0.0f, threshold);
+	bloom_intensity = std::max(0.0f, intensity);
+}
+
+void Hdr_processor::set_exposure(const float min_log2, const float max_log2, const float rate, const float compensation_ev)
+{
+	min_log = min_log2;
+	max_log = std::max(max_log2, min_log2 + 1.0f);
+	adaptation_rate = std::max(0.0f, rate);
+	compensation = compensation_ev;
+}
+
+void Hdr_processor::create_targets(VkImageView scene, VkExtent2D extent, const uint32_t levels)
+{
+	destroy_targets();
+	VkDevice device = dev->get_device();
+	scene_view = scene;
+	scene_extent = extent;
+	uint32_t level_count = 1;
+	while (level_count < levels && (std::min(extent.width, extent.height) >> (level_count + 1)) > 0)
+		++level_count;
+	for (uint32_t i = 0; i < level_count; ++i)
+		level_extents.push_back(get_level_extent(extent, i));
+
+	VkImageCreateInfo img_info{};
+	img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	img_info.imageType = VK_IMAGE_TYPE_2D;
+	img_info.format = BLOOM_FORMAT;
+	img_info.extent = { level_extents.front().width, level_extents.front().height, 1 };
+	img_info.mipLevels = level_count;
+	img_info.arrayLayers = 1;
+	img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	img_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (vkCreateImage(device, &img_info, nullptr, &bloom) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create bloom image!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetImageMemoryRequirements(device, bloom, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (vkAllocateMemory(device, &malloc_info, nullptr, &bloom_mem) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate bloom memory!\n");
+	vkBindImageMemory(device, bloom, bloom_mem, 0);
+	VkImageViewCreateInfo view_info{};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = bloom;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = BLOOM_FORMAT;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.layerCount = 1;
+	level_views.resize(level_count);
+	for (uint32_t i = 0; i < level_count; ++i)
+	{
+		view_info.subresourceRange.baseMipLevel = i;
+		if (vkCreateImageView(device, &view_info, nullptr, &level_views.at(i)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create bloom view!\n");
+	}
+
+	uint32_t set_count = 2 * level_count - 1;
+	std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+	pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes.at(0).descriptorCount = set_count;
+	pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes.at(1).descriptorCount = set_count;
+	pool_sizes.at(2).type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes.at(2).descriptorCount = 2 * set_count;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = set_count;
+	if (vkCreateDescriptorPool(device, &pool_info, nullptr, &target_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create bloom descriptor pool!\n");
+	std::vector<VkDescriptorSetLayout> layouts(set_count, set_layout);
+	std::vector<VkDescriptorSet> sets(set_count);
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = target_pool;
+	alloc_info.descriptorSetCount = set_count;
+	alloc_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(device, &alloc_info, sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate bloom descriptor sets!\n");
+	//Downsampling reads the level above, the first one the scene. Upsampling reads a level and adds onto the one above it
+	downsample_sets.assign(sets.begin(), sets.begin() + level_count);
+	upsample_sets.assign(sets.begin() + level_count, sets.end());
+	for (uint32_t i = 0; i < level_count; ++i)
+		write_set(downsample_sets.at(i), i == 0 ? scene_view : level_views.at(i - 1),
+			i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL, level_views.at(i), VK_NULL_HANDLE);
+	for (uint32_t i = 1; i < level_count; ++i)
+		write_set(upsample_sets.at(i - 1), level_views.at(i), VK_IMAGE_LAYOUT_GENERAL, level_views.at(i - 1), VK_NULL_HANDLE);
+}
+
+void Hdr_processor::set_output(const std::vector<VkImageView>& views, const bool unformatted)
+{
+	if (unformatted && unformatted_tonemap_pipeline == VK_NULL_HANDLE)
+		throw std::runtime_error("Device can't write unformatted storage images!\n");
+	VkDevice device = dev->get_device();
+	vkDestroyDescriptorPool(device, output_pool, nullptr);
+	output_pool = VK_NULL_HANDLE;
+	output_sets.clear();
+	unformatted_output = unformatted;
+	uint32_t set_count = static_cast<uint32_t>(views.size());
+	std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+	pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes.at(0).descriptorCount = 2 * set_count;
+	pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes.at(1).descriptorCount = set_count;
+	pool_sizes.at(2).type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes.at(2).descriptorCount = 2 * set_count;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = set_count;
+	if (vkCreateDescriptorPool(device, &pool_info, nullptr, &output_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create tonemapping descriptor pool!\n");
+	std::vector<VkDescriptorSetLayout> layouts(set_count, set_layout);
+	output_sets.resize(set_count);
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = output_pool;
+	alloc_info.descriptorSetCount = set_count;
+	alloc_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(device, &alloc_info, output_sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate tonemapping descriptor sets!\n");
+	for (uint32_t i = 0; i < set_count; ++i)
+		write_set(output_sets.at(i), scene_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, views.at(i), level_views.front());
+}
+
+void Hdr_processor::write_set(VkDescriptorSet set, VkImageView source, VkImageLayout source_layout, VkImageView destination, VkImageView bloom_view)
+{
+	VkDescriptorImageInfo source_info{}, destination_info{}, bloom_info{};
+	source_info.sampler = sampler;
+	source_info.imageView = source;
+	source_info.imageLayout = source_layout;
+	destination_info.imageView = destination;
+	destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	bloom_info.sampler = sampler;
+	bloom_info.imageView = bloom_view;
+	bloom_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	VkDescriptorBufferInfo histogram_info{}, exposure_info{};
+	histogram_info.buffer = histogram;
+	histogram_info.range = VK_WHOLE_SIZE;
+	exposure_info.buffer = exposure;
+	exposure_info.range = VK_WHOLE_SIZE;
+	std::array<VkWriteDescriptorSet, 5> writes{};
+	for (uint32_t w = 0; w < writes.size(); ++w)
+	{
+		writes.at(w).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes.at(w).dstSet = set;
+		writes.at(w).dstBinding = w;
+		writes.at(w).descriptorCount = 1;
+	}
+	writes.at(0).descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes.at(0).pImageInfo = &source_info;
+	writes.at(1).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writes.at(1).pImageInfo = &destination_info;
+	writes.at(2).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes.at(2).pBufferInfo = &histogram_info;
+	writes.at(3).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes.at(3).pBufferInfo = &exposure_info;
+	writes.at(4).descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes.at(4).pImageInfo = &bloom_info;
+	//Bloom steps never read the bloom binding
+	uint32_t write_count = bloom_view != VK_NULL_HANDLE ? 5 : 4;
+	vkUpdateDescriptorSets(dev->get_device(), write_count, writes.data(), 0, nullptr);
+}
+
+void Hdr_processor::destroy_targets()
+{
+	VkDevice device = dev->get_device();
+	vkDestroyDescriptorPool(device, output_pool, nullptr);
+	vkDestroyDescriptorPool(device, target_pool, nullptr);
+	for (const auto& view : level_views)
+		vkDestroyImageView(device, view, nullptr);
+	vkDestroyImage(device, bloom, nullptr);
+	vkFreeMemory(device, bloom_mem, nullptr);
+	output_pool = target_pool = VK_NULL_HANDLE;
+	output_sets.clear();
+	downsample_sets.clear();
+	upsample_sets.clear();
+	level_views.clear();
+	level_extents.clear();
+	bloom = VK_NULL_HANDLE;
+	bloom_mem = VK_NULL_HANDLE;
+	scene_view = VK_NULL_HANDLE;
+}
+
+void Hdr_processor::compute_barrier(VkCommandBuffer command_buffer) const
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Hdr_processor::record(VkCommandBuffer command_buffer, const uint32_t output, VkExtent2D render_extent, const float delta_time)
+{
+	if (output_sets.empty())
+		return;
+	uint32_t level_count = static_cast<uint32_t>(level_views.size());
+	//Last frame's chain has finished reading the histogram and the levels, which are rebuilt from scratch
+	VkMemoryBarrier memory_barrier{};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkImageMemoryBarrier image_barrier{};
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	image_barrier.srcQueueFamilyIndex = image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = bloom;
+	image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_barrier.subresourceRange.levelCount = level_count;
+	image_barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &memory_barrier, 0, nullptr, 1, &image_barrier);
+	vkCmdFillBuffer(command_buffer, histogram, 0, VK_WHOLE_SIZE, 0);
+	//Zero tells the exposure pass to start from the measured luminance instead of adapting to it
+	if (!exposure_initialized)
+	{
+		vkCmdFillBuffer(command_buffer, exposure, 0, VK_WHOLE_SIZE, 0);
+		exposure_initialized = true;
+	}
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	float log_range = max_log - min_log;
+	for (uint32_t i = 0; i < level_count; ++i)
+	{
+		//The second level only waits for the first, which the exposure barrier already covered
+		if (i > 1)
+			compute_barrier(command_buffer);
+		VkExtent2D source_size = i == 0 ? scene_extent : level_extents.at(i - 1);
+		VkExtent2D source_used = i == 0 ? render_extent : get_level_extent(render_extent, i - 1);
+		VkExtent2D used = get_level_extent(render_extent, i);
+		Bloom_constants constants{};
+		constants.source_texel = 1.0f / glm::vec2(source_size.width, source_size.height);
+		constants.source_uv_scale = glm::vec2(source_used.width, source_used.height) * constants.source_texel;
+		constants.source_uv_max = (glm::vec2(source_used.width, source_used.height) - 0.5f) * constants.source_texel;
+		constants.destination_size = glm::uvec2(used.width, used.height);
+		constants.params = glm::vec4(bloom_threshold, 0.5f * bloom_threshold, min_log, 1.0f / log_range);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, i == 0 ? prefilter_pipeline : downsample_pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &downsample_sets.at(i), 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(command_buffer, get_group_count(used.width), get_group_count(used.height), 1);
+		if (i > 0)
+			continue;
+		//The histogram is complete with the first level, exposure runs alongside the rest of the chain
+		compute_barrier(command_buffer);
+		Exposure_constants exposure_constants{};
+		exposure_constants.min_log = min_log;
+		exposure_constants.log_range = log_range;
+		exposure_constants.adaptation = 1.0f - std::exp(-delta_time * adaptation_rate);
+		exposure_constants.pixel_count = static_cast<float>(used.width * used.height);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, exposure_pipeline);
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(exposure_constants), &exposure_constants);
+		vkCmdDispatch(command_buffer, 1, 1, 1);
+	}
+	for (uint32_t i = level_count - 1; i > 0; --i)
+	{
+		compute_barrier(command_buffer);
+		VkExtent2D source_used = get_level_extent(render_extent, i);
+		VkExtent2D used = get_level_extent(render_extent, i - 1);
+		Bloom_constants constants{};
+		constants.source_texel = 1.0f / glm::vec2(level_extents.at(i).width, level_extents.at(i).height);
+		constants.source_uv_scale = glm::vec2(source_used.width, source_used.height) * constants.source_texel;
+		constants.source_uv_max = (glm::vec2(source_used.width, source_used.height) - 0.5f) * constants.source_texel;
+		constants.destination_size = glm::uvec2(used.width, used.height);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, upsample_pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &upsample_sets.at(i - 1), 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(command_buffer, get_group_count(used.width), get_group_count(used.height), 1);
+	}
+
+	//The last upsample happens while tonemapping, so the bloom never exists at full resolution
+	compute_barrier(command_buffer);
+	VkExtent2D bloom_used = get_level_extent(render_extent, 0);
+	Tonemap_constants constants{};
+	constants.bloom_texel = 1.0f / glm::vec2(level_extents.front().width, level_extents.front().height);
+	constants.bloom_uv_scale = glm::vec2(bloom_used.width, bloom_used.height) * constants.bloom_texel;
+	constants.bloom_uv_max = (glm::vec2(bloom_used.width, bloom_used.height) - 0.5f) * constants.bloom_texel;
+	constants.size = glm::uvec2(render_extent.width, render_extent.height);
+	constants.bloom_intensity = bloom_intensity;
+	constants.exposure_scale = std::exp2(compensation);
+	VkDescriptorSet output_set = output_sets.at(std::min<size_t>(output, output_sets.size() - 1));
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, unformatted_output ? unformatted_tonemap_pipeline : tonemap_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &output_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer, get_group_count(render_extent.width), get_group_count(render_extent.height), 1);
+}
+
+void Hdr_processor::destroy()
+{
+	if (set_layout == VK_NULL_HANDLE)
+		return;
+	VkDevice device = dev->get_device();
+	destroy_targets();
+	vkDestroyBuffer(device, histogram, nullptr);
+	vkFreeMemory(device, histogram_mem, nullptr);
+	vkDestroyBuffer(device, exposure, nullptr);
+	vkFreeMemory(device, exposure_mem, nullptr);
+	for (const auto& pipeline : { prefilter_pipeline, downsample_pipeline, upsample_pipeline, exposure_pipeline, tonemap_pipeline, unformatted_tonemap_pipeline })
+		vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+	set_layout = VK_NULL_HANDLE;
+}
+
+void Hdr_processor::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.usage = usage;
+	buffer_info.size = size;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(dev->get_device(), &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create HDR buffer!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetBufferMemoryRequirements(dev->get_device(), buffer, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (vkAllocateMemory(dev->get_device(), &malloc_info, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate HDR memory!\n");
+	vkBindBufferMemory(dev->get_device(), buffer, memory, 0);
+}
+
+uint32_t Hdr_processor::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties mem_prop = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i)
+	{
+		if (type_filter & (1 << i) &&
+			((mem_prop.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!\n");
+}
@@ -0,0 +1,108 @@
+#ifndef HDR_PROCESSOR_H
+#define HDR_PROCESSOR_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+#include "VulkanDevice.h"
+
+//Push constants of one bloom step. The source is sampled at uv_scale of its image, which is the part the
+//render scale left in use, and never past uv_max so stale texels outside it don't bleed in
+struct Bloom_constants
+{
+	glm::vec2 source_texel;
+	glm::vec2 source_uv_scale;
+	glm::vec2 source_uv_max;
+	glm::uvec2 destination_size;
+	//First level only: threshold, soft knee, then the histogram's minimum log2 luminance and inverse range
+	glm::vec4 params;
+};
+
+//Push constants of the exposure step, adaptation is the fraction of the way to the measured luminance covered this frame
+struct Exposure_constants
+{
+	float min_log;
+	float log_range;
+	float adaptation;
+	float pixel_count;
+};
+
+//Push constants of the tonemapping step, size is the rendered area of the scene in pixels
+struct Tonemap_constants
+{
+	glm::vec2 bloom_texel;
+	glm::vec2 bloom_uv_scale;
+	glm::vec2 bloom_uv_max;
+	glm::uvec2 size;
+	float bloom_intensity;
+	float exposure_scale;
+};
+
+//Brings the HDR scene to the display with compute passes only. The first bloom step halves the scene, keeps
+//what lies above the threshold and builds a luminance histogram from the same taps, later steps halve the level
+//above them. Upsampling walks the chain back, adding each level onto the larger one. The histogram is reduced to
+//an exposure that adapts over time while the bloom chain runs, and the last pass adds the bloom onto the scene,
+//applies the exposure, tonemaps, encodes to sRGB and writes the output image, the swap chain itself when it allows storage
+class Hdr_processor
+{
+	std::shared_ptr<VulkanDevice> dev;
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	VkPipeline prefilter_pipeline = VK_NULL_HANDLE;
+	VkPipeline downsample_pipeline = VK_NULL_HANDLE;
+	VkPipeline upsample_pipeline = VK_NULL_HANDLE;
+	VkPipeline exposure_pipeline = VK_NULL_HANDLE;
+	//Writes an RGBA16F image, the unformatted variant any storage format such as the swap chain's
+	VkPipeline tonemap_pipeline = VK_NULL_HANDLE;
+	VkPipeline unformatted_tonemap_pipeline = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	//256 bins of log2 luminance, cleared every frame, and the adapted luminance carried across frames
+	VkBuffer histogram = VK_NULL_HANDLE;
+	VkDeviceMemory histogram_mem = VK_NULL_HANDLE;
+	VkBuffer exposure = VK_NULL_HANDLE;
+	VkDeviceMemory exposure_mem = VK_NULL_HANDLE;
+	bool exposure_initialized = false;
+	//Half the scene extent and below, level i is sampled by level i + 1 and upsampled into level i - 1
+	VkImage bloom = VK_NULL_HANDLE;
+	VkDeviceMemory bloom_mem = VK_NULL_HANDLE;
+	std::vector<VkImageView> level_views;
+	std::vector<VkExtent2D> level_extents;
+	VkExtent2D scene_extent{};
+	VkImageView scene_view = VK_NULL_HANDLE;
+	VkDescriptorPool target_pool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> downsample_sets, upsample_sets;
+	//One set per output image, the swap chain has one per image
+	VkDescriptorPool output_pool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> output_sets;
+	bool unformatted_output = false;
+	float bloom_threshold = 1.0f;
+	float bloom_intensity = 0.05f;
+	float min_log = -8.0f;
+	float max_log = 4.0f;
+	float adaptation_rate = 1.5f;
+	float compensation = 0.0f;
+	void create_pipelines(const bool unformatted_support);
+	VkPipeline create_compute_pipeline(const std::string& path);
+	void write_set(VkDescriptorSet set, VkImageView source, VkImageLayout source_layout, VkImageView destination, VkImageView bloom_view);
+	void compute_barrier(VkCommandBuffer command_buffer) const;
+	void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+public:
+	//unformatted_support tells whether the device can write storage images without a format in the shader
+	Hdr_processor(std::shared_ptr<VulkanDevice> device, const bool unformatted_support);
+	~Hdr_processor();
+	void set_bloom(const float threshold, const float intensity);
+	//Luminance range of the histogram in log2 units, rate is how fast exposure follows the scene, per second
+	void set_exposure(const float min_log2, const float max_log2, const float rate, const float compensation_ev);
+	//The scene view is sampled in shader read only layout, levels are capped by the extent
+	void create_targets(VkImageView scene, VkExtent2D extent, const uint32_t levels);
+	//Views of the output images in general layout. Unformatted outputs need the support passed to the constructor
+	void set_output(const std::vector<VkImageView>& views, const bool unformatted);
+	void destroy_targets();
+	//Runs the whole chain over the rendered area, output picks the output image
+	void record(VkCommandBuffer command_buffer, const uint32_t output, VkExtent2D render_extent, const float delta_time);
+	void destroy();
+};
+#endif // !HDR_PROCESSOR_H
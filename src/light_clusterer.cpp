@@ -0,0 +1,285 @@
+#include "light_clusterer.h"
+#include "shader.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+Light_clusterer::Light_clusterer(std::shared_ptr<VulkanDevice> device, const uint32_t frames_in_flight, const glm::uvec3& cluster_grid,
+	const uint32_t light_limit, const uint32_t indices_per_cluster) :
+	dev(device), grid(glm::max(cluster_grid, glm::uvec3(1))), max_lights(std::max(1u, light_limit))
+{
+	uint32_t cluster_count = grid.x * grid.y * grid.z;
+	index_capacity = cluster_count * std::max(1u, indices_per_cluster);
+	const VkMemoryPropertyFlags device_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	//Two vec4 corners per cluster, then offset and count
+	create_buffer(2 * sizeof(glm::vec4) * cluster_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device_memory, clusters, clusters_mem);
+	create_buffer(2 * sizeof(uint32_t) * cluster_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device_memory, light_grid, light_grid_mem);
+	create_buffer(sizeof(uint32_t) * index_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device_memory, light_indices, light_indices_mem);
+	create_buffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, device_memory, counter, counter_mem);
+	create_pipelines();
+	create_frames(frames_in_flight);
+}
+
+Light_clusterer::~Light_clusterer()
+{
+	destroy();
+}
+
+void Light_clusterer::create_pipelines()
+{
+	VkDevice device = dev->get_device();
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings.at(i).binding = i;
+		bindings.at(i).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings.at(i).descriptorCount = 1;
+		bindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo set_layout_info{};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	set_layout_info.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &set_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light culling descriptor set layout!\n");
+
+	VkPushConstantRange push_range{};
+	push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_range.size = sizeof(Cluster_build_constants);
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &set_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_range;
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &build_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create cluster pipeline layout!\n");
+	push_range.size = sizeof(Light_cull_constants);
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &cull_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light culling pipeline layout!\n");
+	build_pipeline = create_compute_pipeline(R"(src\cluster_build.spv)", build_layout);
+	cull_pipeline = create_compute_pipeline(R"(src\light_cull.spv)", cull_layout);
+}
+
+VkPipeline Light_clusterer::create_compute_pipeline(const std::string& path, VkPipelineLayout layout)
+{
+	Shader compute_shader(path, dev->get_device());
+	VkShaderModule compute_module = compute_shader.create_shader_module();
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = compute_module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = layout;
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(dev->get_device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light culling pipeline!\n");
+	vkDestroyShaderModule(dev->get_device(), compute_module, nullptr);
+	return pipeline;
+}
+
+void Light_clusterer::create_frames(const uint32_t count)
+{
+	VkDevice device = dev->get_device();
+	frames.assign(count, Frame{});
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = 5 * count;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = count;
+	if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light culling descriptor pool!\n");
+	std::vector<VkDescriptorSetLayout> layouts(count, set_layout);
+	std::vector<VkDescriptorSet> sets(count);
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = descriptor_pool;
+	alloc_info.descriptorSetCount = count;
+	alloc_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(device, &alloc_info, sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate light culling descriptor sets!\n");
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		//Lights are written by the CPU every frame, the buffer stays mapped
+		Frame& frame = frames.at(i);
+		create_buffer(sizeof(Light_data) * max_lights, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.lights, frame.lights_mem);
+		vkMapMemory(device, frame.lights_mem, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&frame.light_data));
+		frame.descriptor_set = sets.at(i);
+		std::array<VkDescriptorBufferInfo, 5> buffer_infos{};
+		buffer_infos.at(0).buffer = clusters;
+		buffer_infos.at(1).buffer = frame.lights;
+		buffer_infos.at(2).buffer = light_grid;
+		buffer_infos.at(3).buffer = light_indices;
+		buffer_infos.at(4).buffer = counter;
+		std::array<VkWriteDescriptorSet, 5> writes{};
+		for (uint32_t w = 0; w < writes.size(); ++w)
+		{
+			buffer_infos.at(w).range = VK_WHOLE_SIZE;
+			writes.at(w).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes.at(w).dstSet = frame.descriptor_set;
+			writes.at(w).dstBinding = w;
+			writes.at(w).descriptorCount = 1;
+			writes.at(w).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes.at(w).pBufferInfo = &buffer_infos.at(w);
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void Light_clusterer::destroy_frames()
+{
+	VkDevice device = dev->get_device();
+	for (auto& frame : frames)
+	{
+		vkDestroyBuffer(device, frame.lights, nullptr);
+		vkFreeMemory(device, frame.lights_mem, nullptr);
+	}
+	frames.clear();
+	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+	descriptor_pool = VK_NULL_HANDLE;
+}
+
+void Light_clusterer::set_frames_in_flight(const uint32_t count)
+{
+	destroy_frames();
+	create_frames(count);
+}
+
+uint32_t Light_clusterer::upload(const uint32_t frame, const Light_data* lights, const size_t count)
+{
+	Frame& current = frames.at(frame);
+	current.light_count = static_cast<uint32_t>(std::min<size_t>(count, max_lights));
+	std::memcpy(current.light_data, lights, sizeof(Light_data) * current.light_count);
+	return current.light_count;
+}
+
+void Light_clusterer::record(VkCommandBuffer command_buffer, const uint32_t frame, const glm::mat4& view, const glm::mat4& projection,
+	const float near_plane, const float far_plane)
+{
+	const Frame& current = frames.at(frame);
+	if (current.light_count == 0)
+		return;
+	uint32_t cluster_count = grid.x * grid.y * grid.z;
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, build_layout, 0, 1, &current.descriptor_set, 0, nullptr);
+	//The previous frame's fragment shaders have to be done with the lists before they are rebuilt
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	//Cluster bounds only depend on the projection
+	if (projection != built_projection || near_plane != built_near || far_plane != built_far)
+	{
+		Cluster_build_constants constants{};
+		constants.inverse_projection = glm::inverse(projection);
+		constants.grid = glm::uvec4(grid, cluster_count);
+		constants.near_plane = near_plane;
+		constants.far_plane = far_plane;
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, build_pipeline);
+		vkCmdPushConstants(command_buffer, build_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(command_buffer, (cluster_count + 63) / 64, 1, 1);
+		built_projection = projection;
+		built_near = near_plane;
+		built_far = far_plane;
+	}
+	vkCmdFillBuffer(command_buffer, counter, 0, VK_WHOLE_SIZE, 0);
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	Light_cull_constants constants{};
+	constants.view = view;
+	constants.grid = glm::uvec4(grid, cluster_count);
+	constants.light_count = current.light_count;
+	constants.index_capacity = index_capacity;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+	vkCmdPushConstants(command_buffer, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer, (cluster_count + 63) / 64, 1, 1);
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+glm::vec2 Light_clusterer::get_slice_params(const float near_plane, const float far_plane) const
+{
+	float log_ratio = std::log(far_plane / near_plane);
+	return glm::vec2(grid.z / log_ratio, grid.z * std::log(near_plane) / log_ratio);
+}
+
+glm::uvec3 Light_clusterer::get_grid() const
+{
+	return grid;
+}
+
+VkBuffer Light_clusterer::get_light_buffer(const uint32_t frame) const
+{
+	return frames.at(frame).lights;
+}
+
+VkBuffer Light_clusterer::get_light_grid() const
+{
+	return light_grid;
+}
+
+VkBuffer Light_clusterer::get_light_indices() const
+{
+	return light_indices;
+}
+
+void Light_clusterer::destroy()
+{
+	if (set_layout == VK_NULL_HANDLE)
+		return;
+	VkDevice device = dev->get_device();
+	destroy_frames();
+	for (const auto& buffer : { clusters, light_grid, light_indices, counter })
+		vkDestroyBuffer(device, buffer, nullptr);
+	for (const auto& memory : { clusters_mem, light_grid_mem, light_indices_mem, counter_mem })
+		vkFreeMemory(device, memory, nullptr);
+	vkDestroyPipeline(device, build_pipeline, nullptr);
+	vkDestroyPipeline(device, cull_pipeline, nullptr);
+	vkDestroyPipelineLayout(device, build_layout, nullptr);
+	vkDestroyPipelineLayout(device, cull_layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+	set_layout = VK_NULL_HANDLE;
+}
+
+void Light_clusterer::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.usage = usage;
+	buffer_info.size = size;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(dev->get_device(), &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light culling buffer!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetBufferMemoryRequirements(dev->get_device(), buffer, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, properties);
+	if (vkAllocateMemory(dev->get_device(), &malloc_info, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate light culling memory!\n");
+	vkBindBufferMemory(dev->get_device(), buffer, memory, 0);
+}
+
+uint32_t Light_clusterer::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties mem_prop = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i)
+	{
+		if (type_filter & (1 << i) &&
+			((mem_prop.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!\n");
+}
@@ -0,0 +1,104 @@
+#ifndef LIGHT_CLUSTERER_H
+#define LIGHT_CLUSTERER_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+#include "VulkanDevice.h"
+
+//Point or spot light as read by the light culling and scene shaders, std430 layout. Point lights use a cone
+//covering every direction
+struct Light_data
+{
+	//World position and the distance the light reaches
+	glm::vec4 position_range;
+	glm::vec4 colour_intensity;
+	//Spot direction and cosine of the outer cone angle
+	glm::vec4 direction_outer;
+	//x cosine of the inner cone angle, the light fades out between the two cones
+	glm::vec4 spot;
+};
+
+//Push constants of the cluster bounds pass
+struct Cluster_build_constants
+{
+	glm::mat4 inverse_projection;
+	glm::uvec4 grid;
+	float near_plane;
+	float far_plane;
+};
+
+//Push constants of the light binning pass
+struct Light_cull_constants
+{
+	glm::mat4 view;
+	glm::uvec4 grid;
+	uint32_t light_count;
+	uint32_t index_capacity;
+};
+
+//Clustered forward shading. The view frustum is split into a froxel grid, tiles of the render area times slices
+//spaced logarithmically in view depth. A compute pass finds the view space bounds of every cluster and only runs
+//again when the projection changes, a second one bins the frame's lights into compact index lists per cluster.
+//The scene shader finds its cluster from the fragment position and depth and only walks that cluster's lights
+class Light_clusterer
+{
+	struct Frame
+	{
+		VkBuffer lights = VK_NULL_HANDLE;
+		VkDeviceMemory lights_mem = VK_NULL_HANDLE;
+		Light_data* light_data = nullptr;
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+		uint32_t light_count = 0;
+	};
+	std::shared_ptr<VulkanDevice> dev;
+	glm::uvec3 grid;
+	uint32_t max_lights;
+	uint32_t index_capacity;
+	std::vector<Frame> frames;
+	//View space bounds of every cluster, then per cluster offset and count into the shared index list
+	VkBuffer clusters = VK_NULL_HANDLE;
+	VkDeviceMemory clusters_mem = VK_NULL_HANDLE;
+	VkBuffer light_grid = VK_NULL_HANDLE;
+	VkDeviceMemory light_grid_mem = VK_NULL_HANDLE;
+	VkBuffer light_indices = VK_NULL_HANDLE;
+	VkDeviceMemory light_indices_mem = VK_NULL_HANDLE;
+	//Allocation counter of the index list, cleared before every binning pass
+	VkBuffer counter = VK_NULL_HANDLE;
+	VkDeviceMemory counter_mem = VK_NULL_HANDLE;
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+	VkPipelineLayout build_layout = VK_NULL_HANDLE;
+	VkPipeline build_pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout cull_layout = VK_NULL_HANDLE;
+	VkPipeline cull_pipeline = VK_NULL_HANDLE;
+	//Projection the cluster bounds were built for
+	glm::mat4 built_projection = glm::mat4(0.0f);
+	float built_near = 0.0f, built_far = 0.0f;
+	void create_pipelines();
+	VkPipeline create_compute_pipeline(const std::string& path, VkPipelineLayout layout);
+	void create_frames(const uint32_t count);
+	void destroy_frames();
+	void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+public:
+	Light_clusterer(std::shared_ptr<VulkanDevice> device, const uint32_t frames_in_flight, const glm::uvec3& cluster_grid,
+		const uint32_t light_limit, const uint32_t indices_per_cluster);
+	~Light_clusterer();
+	void set_frames_in_flight(const uint32_t count);
+	//Copies the lights into the frame's buffer, lights past the limit are dropped. Returns how many were kept
+	uint32_t upload(const uint32_t frame, const Light_data* lights, const size_t count);
+	//Projection is the one the scene is drawn with. Has to run before the fragment shaders read the lists
+	void record(VkCommandBuffer command_buffer, const uint32_t frame, const glm::mat4& view, const glm::mat4& projection,
+		const float near_plane, const float far_plane);
+	//Scale and bias turning the logarithm of the view depth into a slice index
+	glm::vec2 get_slice_params(const float near_plane, const float far_plane) const;
+	glm::uvec3 get_grid() const;
+	VkBuffer get_light_buffer(const uint32_t frame) const;
+	VkBuffer get_light_grid() const;
+	VkBuffer get_light_indices() const;
+	void destroy();
+};
+#endif // !LIGHT_CLUSTERER_H
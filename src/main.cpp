@@ -5,23 +5,28 @@ int main(int argc, char** argv)
 	try
 	{
 		Engine app("Franciszek Ksawery Drudzki-Lubecki", 800, 600);
+		auto main_camera = app.get_active_camera();
+		auto teapot = app.create_model(R"(src\models\teapot.obj)", R"(src\tex\tex1.jpg)", 0.4f, 1.0f, -0.3f);
+		app.scale_model(teapot, 0.5f, 0.5f, 0.5f);
+		app.switch_animated_rotation(teapot);
+		app.create_model(R"(src\models\sphere.obj)", 2.0f, 2.0f, 0.0f);
 		app.create_camera(1.0f, 0.5f, -1.0f);
 		//app.toogle_wireframe();
-		app.translate_camera(0, 1.0f, 2.0f, -0.5f);
-		app.create_box(2.0f, 3.0f, 0.5f);
-		app.change_texture(2, R"(src\tex\tex2.jpg)");
-		app.create_model(R"(src\models\chalet.obj)", R"(src\tex\chalet.jpg)", 3.0f, 0.0f, -1.0f);
-		app.create_camera();
-		app.rotate_model(3, 10.0f, 20.0f, 40.0f);
-		app.set_camera_position(2, 1.0f, 1.0f, 1.0f);
-		app.translate_model(0, 1.0f, 1.0f, 1.0f);
-		app.change_fov(0, 90.0f);
-		app.create_plane(5.0f, 5.0f, 0.0f, -4.0f, 0.0f);
-		app.create_sphere(5.0f, 13.0f, -4.0f, 0.0f);
-		app.change_texture(5, R"(src\tex\tex1.jpg)");
-		app.create_model(R"(src\models\teapot.obj)", -10.0f, 3.2f, 5.0f);
-		app.change_texture(6, R"(src\tex\chalet.jpg)");
-		app.change_texture(4, R"(src\tex\tex1.png)");
+		app.translate_camera(main_camera, 1.0f, 2.0f, -0.5f);
+		auto box = app.create_box(2.0f, 3.0f, 0.5f);
+		app.change_texture(box, R"(src\tex\tex2.jpg)");
+		auto chalet = app.create_model(R"(src\models\chalet.obj)", R"(src\tex\chalet.jpg)", 3.0f, 0.0f, -1.0f);
+		auto third_camera = app.create_camera();
+		app.rotate_model(chalet, 10.0f, 20.0f, 40.0f);
+		app.set_camera_position(third_camera, 1.0f, 1.0f, 1.0f);
+		app.translate_model(teapot, 1.0f, 1.0f, 1.0f);
+		app.change_fov(main_camera, 90.0f);
+		auto plane = app.create_plane(5.0f, 5.0f, 0.0f, -4.0f, 0.0f);
+		auto sphere = app.create_sphere(5.0f, 13.0f, -4.0f, 0.0f);
+		app.change_texture(sphere, R"(src\tex\tex1.jpg)");
+		auto second_teapot = app.create_model(R"(src\models\teapot.obj)", -10.0f, 3.2f, 5.0f);
+		app.change_texture(second_teapot, R"(src\tex\chalet.jpg)");
+		app.change_texture(plane, R"(src\tex\tex1.png)");
 		app.run();
 	}
 	catch (const std::exception& err)
@@ -0,0 +1,89 @@
+#include "mesh_cache.h"
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+
+namespace
+{
+	const uint32_t MAGIC = 0x48534d45; //"EMSH"
+	const uint32_t VERSION = 2;
+	//Streamed models are prepared on worker threads and may share a mesh, so a cache file is never read while written
+	std::mutex file_mutex;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t flags;
+		uint32_t vertex_size;
+		uint64_t source_size;
+		int64_t source_time;
+		uint64_t vertex_count;
+		uint64_t index_count;
+		uint64_t lod_count;
+		Mesh_stats stats;
+	};
+
+	bool source_stamp(const std::string& source_path, uint64_t& size, int64_t& time)
+	{
+		std::error_code error;
+		size = std::filesystem::file_size(source_path, error);
+		if (error)
+			return false;
+		time = static_cast<int64_t>(std::filesystem::last_write_time(source_path, error).time_since_epoch().count());
+		return !error;
+	}
+}
+
+namespace mesh_cache
+{
+	std::string cache_path(const std::string& source_path)
+	{
+		return source_path + ".meshcache";
+	}
+
+	bool load(const std::string& source_path, uint32_t flags, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Mesh_lod>& lods, Mesh_stats& stats)
+	{
+		uint64_t size{};
+		int64_t time{};
+		if (!source_stamp(source_path, size, time))
+			return false;
+		std::lock_guard<std::mutex> lock(file_mutex);
+		std::ifstream input(cache_path(source_path), std::ios_base::binary);
+		Header header{};
+		if (!input || !input.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return false;
+		if (header.magic != MAGIC || header.version != VERSION || header.flags != flags || header.vertex_size != sizeof(Vertex)
+			|| header.source_size != size || header.source_time != time)
+			return false;
+		vertices.resize(static_cast<size_t>(header.vertex_count));
+		indices.resize(static_cast<size_t>(header.index_count));
+		lods.resize(static_cast<size_t>(header.lod_count));
+		input.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+		input.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(uint32_t));
+		input.read(reinterpret_cast<char*>(lods.data()), lods.size() * sizeof(Mesh_lod));
+		if (!input || lods.empty())
+		{
+			vertices.clear();
+			indices.clear();
+			lods.clear();
+			return false;
+		}
+		stats = header.stats;
+		return true;
+	}
+
+	void store(const std::string& source_path, uint32_t flags, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Mesh_lod>& lods, const Mesh_stats& stats)
+	{
+		Header header{ MAGIC, VERSION, flags, sizeof(Vertex), 0, 0, vertices.size(), indices.size(), lods.size(), stats };
+		if (!source_stamp(source_path, header.source_size, header.source_time))
+			return;
+		//A cache that can't be written only costs load time, so failures are not reported
+		std::lock_guard<std::mutex> lock(file_mutex);
+		std::ofstream output(cache_path(source_path), std::ios_base::binary | std::ios_base::trunc);
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+		output.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+		output.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(Mesh_lod));
+	}
+}
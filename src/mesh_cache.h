@@ -0,0 +1,21 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "vertex_layout.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+//Binary cache of processed meshes stored next to the source file, it is rebuilt whenever the source
+//or the processing flags change
+namespace mesh_cache
+{
+	const uint32_t FLAG_OPTIMIZED = 1;
+	//Requested number of detail levels is kept in the bits above the processing flags
+	const uint32_t LOD_SHIFT = 8;
+	std::string cache_path(const std::string& source_path);
+	bool load(const std::string& source_path, uint32_t flags, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Mesh_lod>& lods, Mesh_stats& stats);
+	void store(const std::string& source_path, uint32_t flags, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Mesh_lod>& lods, const Mesh_stats& stats);
+}
+#endif // !MESH_CACHE_H
@@ -0,0 +1,268 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+	const uint32_t MIN_CLUSTER_TRIANGLES = 8;
+
+	float vertex_score(int cache_position, uint32_t remaining_triangles)
+	{
+		if (remaining_triangles == 0)
+			return -1.0f;
+		float score = 0.0f;
+		if (cache_position >= 0)
+		{
+			//The last triangle's vertices get a fixed score so the next one doesn't simply repeat them
+			if (cache_position < 3)
+				score = LAST_TRIANGLE_SCORE;
+			else
+				score = std::pow(1.0f - (cache_position - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+		//Vertices with few triangles left are finished first so they can leave the cache for good
+		return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+	}
+
+	//Simulates a FIFO cache over triangles [first, last) and returns the number of misses
+	uint32_t count_misses(const std::vector<uint32_t>& indices, size_t first, size_t last, std::vector<uint32_t>& timestamps, uint32_t& time, uint32_t cache_size)
+	{
+		uint32_t misses = 0;
+		for (size_t i = first * 3; i < last * 3; ++i)
+		{
+			uint32_t& stamp = timestamps.at(indices.at(i));
+			if (time - stamp >= cache_size)
+			{
+				stamp = time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+}
+
+namespace mesh_optimizer
+{
+	void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count)
+	{
+		size_t triangle_count = indices.size() / 3;
+		if (triangle_count == 0)
+			return;
+		std::vector<uint32_t> remaining(vertex_count, 0), adjacency_offset(vertex_count + 1, 0), adjacency(indices.size());
+		for (uint32_t index : indices)
+			++remaining.at(index);
+		std::partial_sum(remaining.begin(), remaining.end(), adjacency_offset.begin() + 1);
+		std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			adjacency.at(fill.at(indices.at(i))++) = static_cast<uint32_t>(i / 3);
+
+		std::vector<float> scores(vertex_count), triangle_scores(triangle_count, 0.0f);
+		std::vector<bool> emitted(triangle_count, false);
+		for (size_t v = 0; v < vertex_count; ++v)
+			scores.at(v) = vertex_score(-1, remaining.at(v));
+		for (size_t t = 0; t < triangle_count; ++t)
+			triangle_scores.at(t) = scores.at(indices.at(3 * t)) + scores.at(indices.at(3 * t + 1)) + scores.at(indices.at(3 * t + 2));
+
+		std::vector<uint32_t> cache, next_cache, result;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		result.reserve(indices.size());
+		size_t cursor = 0;
+		int64_t best = -1;
+		for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count)
+		{
+			//Nothing in the cache is usable, so continue with the next triangle in input order
+			if (best < 0)
+			{
+				while (emitted.at(cursor))
+					++cursor;
+				best = static_cast<int64_t>(cursor);
+			}
+			uint32_t triangle = static_cast<uint32_t>(best);
+			emitted.at(triangle) = true;
+			next_cache.clear();
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t vertex = indices.at(3 * triangle + k);
+				result.push_back(vertex);
+				next_cache.push_back(vertex);
+				--remaining.at(vertex);
+				//Move the triangle to the end of the vertex's list so the live ones stay at the front
+				uint32_t begin = adjacency_offset.at(vertex), end = begin + remaining.at(vertex) + 1;
+				std::replace(adjacency.begin() + begin, adjacency.begin() + end, triangle, adjacency.at(end - 1));
+				adjacency.at(end - 1) = triangle;
+			}
+			for (uint32_t vertex : cache)
+				if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end())
+					next_cache.push_back(vertex);
+			//Vertices pushed out of the cache lose their cache bonus
+			if (next_cache.size() > FORSYTH_CACHE_SIZE)
+			{
+				for (size_t i = FORSYTH_CACHE_SIZE; i < next_cache.size(); ++i)
+				{
+					uint32_t vertex = next_cache.at(i);
+					float new_score = vertex_score(-1, remaining.at(vertex));
+					for (uint32_t j = 0; j < remaining.at(vertex); ++j)
+						triangle_scores.at(adjacency.at(adjacency_offset.at(vertex) + j)) += new_score - scores.at(vertex);
+					scores.at(vertex) = new_score;
+				}
+				next_cache.resize(FORSYTH_CACHE_SIZE);
+			}
+			std::swap(cache, next_cache);
+
+			best = -1;
+			float best_score = -std::numeric_limits<float>::max();
+			for (size_t i = 0; i < cache.size(); ++i)
+			{
+				uint32_t vertex = cache.at(i);
+				float new_score = vertex_score(static_cast<int>(i), remaining.at(vertex));
+				for (uint32_t j = 0; j < remaining.at(vertex); ++j)
+					triangle_scores.at(adjacency.at(adjacency_offset.at(vertex) + j)) += new_score - scores.at(vertex);
+				scores.at(vertex) = new_score;
+			}
+			for (uint32_t vertex : cache)
+			{
+				for (uint32_t j = 0; j < remaining.at(vertex); ++j)
+				{
+					uint32_t candidate = adjacency.at(adjacency_offset.at(vertex) + j);
+					if (!emitted.at(candidate) && triangle_scores.at(candidate) > best_score)
+					{
+						best_score = triangle_scores.at(candidate);
+						best = candidate;
+					}
+				}
+			}
+		}
+		indices = std::move(result);
+	}
+
+	void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+	{
+		size_t triangle_count = indices.size() / 3;
+		if (triangle_count == 0)
+			return;
+		//Hard boundaries are triangles that miss the cache on all three vertices, reordering there costs nothing
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = FIFO_CACHE_SIZE + 1;
+		std::vector<size_t> hard_boundaries;
+		for (size_t t = 0; t < triangle_count; ++t)
+			if (count_misses(indices, t, t + 1, timestamps, time, FIFO_CACHE_SIZE) == 3)
+				hard_boundaries.push_back(t);
+		hard_boundaries.push_back(triangle_count);
+
+		//Soft boundaries split a hard cluster wherever the part before it stays within threshold of the cluster's ACMR
+		std::vector<size_t> clusters;
+		for (size_t c = 0; c + 1 < hard_boundaries.size(); ++c)
+		{
+			size_t first = hard_boundaries.at(c), last = hard_boundaries.at(c + 1);
+			//Advancing the clock by the cache size empties the simulated cache without touching every vertex
+			time += FIFO_CACHE_SIZE;
+			float cluster_acmr = count_misses(indices, first, last, timestamps, time, FIFO_CACHE_SIZE) / static_cast<float>(last - first);
+			time += FIFO_CACHE_SIZE;
+			size_t start = first;
+			uint32_t misses = 0;
+			clusters.push_back(first);
+			for (size_t t = first; t < last; ++t)
+			{
+				misses += count_misses(indices, t, t + 1, timestamps, time, FIFO_CACHE_SIZE);
+				size_t triangles = t + 1 - start;
+				if (triangles >= MIN_CLUSTER_TRIANGLES && t + 1 < last && misses / static_cast<float>(triangles) <= cluster_acmr * threshold)
+				{
+					start = t + 1;
+					misses = 0;
+					clusters.push_back(start);
+					time += FIFO_CACHE_SIZE;
+				}
+			}
+		}
+		clusters.push_back(triangle_count);
+
+		glm::vec3 mesh_centroid(0.0f);
+		for (const auto& vertex : vertices)
+			mesh_centroid += vertex.pos;
+		mesh_centroid /= static_cast<float>(std::max<size_t>(1, vertices.size()));
+		//Clusters facing away from the centre are likely on the silhouette and occlude the rest, so they go first
+		std::vector<float> sort_keys(clusters.size() - 1);
+		for (size_t c = 0; c + 1 < clusters.size(); ++c)
+		{
+			glm::vec3 centroid(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (size_t t = clusters.at(c); t < clusters.at(c + 1); ++t)
+			{
+				const glm::vec3& a = vertices.at(indices.at(3 * t)).pos, & b = vertices.at(indices.at(3 * t + 1)).pos, & d = vertices.at(indices.at(3 * t + 2)).pos;
+				glm::vec3 face_normal = glm::cross(b - a, d - a);
+				float face_area = glm::length(face_normal);
+				centroid += (a + b + d) * (face_area / 3.0f);
+				normal += face_normal;
+				area += face_area;
+			}
+			float normal_length = glm::length(normal);
+			if (area > 0.0f && normal_length > 0.0f)
+				sort_keys.at(c) = glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+		}
+		std::vector<size_t> order(sort_keys.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sort_keys.at(a) > sort_keys.at(b); });
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (size_t c : order)
+			result.insert(result.end(), indices.begin() + clusters.at(c) * 3, indices.begin() + clusters.at(c + 1) * 3);
+		indices = std::move(result);
+	}
+
+	void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> remap(vertices.size(), unassigned);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+		for (uint32_t& index : indices)
+		{
+			if (remap.at(index) == unassigned)
+			{
+				remap.at(index) = static_cast<uint32_t>(result.size());
+				result.push_back(vertices.at(index));
+			}
+			index = remap.at(index);
+		}
+		//Unreferenced vertices are dropped
+		vertices = std::move(result);
+	}
+
+	Vertex_cache_stats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size)
+	{
+		Vertex_cache_stats stats{};
+		if (indices.empty())
+			return stats;
+		std::vector<uint32_t> timestamps(vertex_count, 0);
+		uint32_t time = cache_size + 1;
+		uint32_t misses = count_misses(indices, 0, indices.size() / 3, timestamps, time, cache_size);
+		size_t unique = 0;
+		std::vector<bool> seen(vertex_count, false);
+		for (uint32_t index : indices)
+			if (!seen.at(index))
+			{
+				seen.at(index) = true;
+				++unique;
+			}
+		stats.acmr = misses / static_cast<float>(indices.size() / 3);
+		stats.atvr = misses / static_cast<float>(unique);
+		return stats;
+	}
+
+	Mesh_stats optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		Mesh_stats stats{};
+		stats.before = analyze_vertex_cache(indices, vertices.size(), FIFO_CACHE_SIZE);
+		optimize_vertex_cache(indices, vertices.size());
+		optimize_overdraw(indices, vertices, 1.05f);
+		optimize_vertex_fetch(vertices, indices);
+		stats.after = analyze_vertex_cache(indices, vertices.size(), FIFO_CACHE_SIZE);
+		return stats;
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+#include <vector>
+#include <cstdint>
+#include "vertex_layout.h"
+
+//ACMR is transformed vertices per triangle, ATVR transformed vertices per unique vertex (1.0 is ideal)
+struct Vertex_cache_stats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+struct Mesh_stats
+{
+	Vertex_cache_stats before;
+	Vertex_cache_stats after;
+};
+
+namespace mesh_optimizer
+{
+	const uint32_t FIFO_CACHE_SIZE = 16;
+	//Reorders triangles for the post-transform cache with Forsyth's scoring
+	void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count);
+	//Splits the cache-ordered stream into clusters and sorts them so outward facing ones draw first,
+	//threshold bounds how much ACMR may grow when a cluster is split further
+	void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold);
+	//Lays vertices out in first-use order so vertex fetch walks memory linearly
+	void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	Vertex_cache_stats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size);
+	//Runs all passes in order and returns the FIFO cache statistics before and after
+	Mesh_stats optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+}
+#endif // !MESH_OPTIMIZER_H
@@ -0,0 +1,207 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include "mesh_optimizer.h"
+
+namespace
+{
+	//Levels that remove less than this share of the previous level's triangles are not worth keeping
+	const float MIN_REDUCTION = 0.1f;
+
+	//Symmetric 4x4 matrix summing squared distances to a set of planes
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+		void add_plane(const glm::dvec3& n, double d)
+		{
+			a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+			b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+			c2 += n.z * n.z; cd += n.z * d;
+			d2 += d * d;
+		}
+		void add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+		}
+		double evaluate(const glm::dvec3& p) const
+		{
+			double result = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+				+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+				+ c2 * p.z * p.z + 2 * cd * p.z + d2;
+			return std::max(0.0, result);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	bool flips(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& triangles, uint32_t from, uint32_t to)
+	{
+		for (uint32_t triangle : triangles)
+		{
+			const uint32_t* t = &indices.at(3 * triangle);
+			if (t[0] == to || t[1] == to || t[2] == to)
+				continue;
+			glm::vec3 p[3], q[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				p[k] = vertices.at(t[k]).pos;
+				q[k] = vertices.at(t[k] == from ? to : t[k]).pos;
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			if (glm::dot(before, after) <= 0.0f)
+				return true;
+		}
+		return false;
+	}
+}
+
+namespace mesh_simplifier
+{
+	std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		size_t target_index_count, float& result_error)
+	{
+		std::vector<uint32_t> current(indices);
+		double max_cost = 0.0;
+		result_error = 0.0f;
+		//Vertices sharing a position are UV or normal seams, collapsing them would tear the surface
+		std::unordered_map<glm::vec3, uint32_t> position_ids;
+		std::vector<uint32_t> position_id(vertices.size()), position_users;
+		for (size_t v = 0; v < vertices.size(); ++v)
+		{
+			auto inserted = position_ids.emplace(vertices.at(v).pos, static_cast<uint32_t>(position_users.size()));
+			if (inserted.second)
+				position_users.push_back(0);
+			position_id.at(v) = inserted.first->second;
+			++position_users.at(inserted.first->second);
+		}
+		std::vector<bool> locked(vertices.size(), false);
+		for (size_t v = 0; v < vertices.size(); ++v)
+			locked.at(v) = position_users.at(position_id.at(v)) > 1;
+		//Edges used by a single triangle lie on an open border
+		std::unordered_map<uint64_t, uint32_t> edge_users;
+		auto edge_key = [&](uint32_t a, uint32_t b) {
+			uint64_t pa = position_id.at(a), pb = position_id.at(b);
+			return pa < pb ? (pa << 32) | pb : (pb << 32) | pa;
+		};
+		for (size_t i = 0; i < current.size(); i += 3)
+			for (int k = 0; k < 3; ++k)
+				++edge_users[edge_key(current.at(i + k), current.at(i + (k + 1) % 3))];
+		for (size_t i = 0; i < current.size(); i += 3)
+			for (int k = 0; k < 3; ++k)
+				if (edge_users[edge_key(current.at(i + k), current.at(i + (k + 1) % 3))] == 1)
+					locked.at(current.at(i + k)) = locked.at(current.at(i + (k + 1) % 3)) = true;
+
+		std::vector<Quadric> quadrics(vertices.size());
+		for (size_t i = 0; i < current.size(); i += 3)
+		{
+			glm::dvec3 a = vertices.at(current.at(i)).pos, b = vertices.at(current.at(i + 1)).pos, c = vertices.at(current.at(i + 2)).pos;
+			glm::dvec3 normal = glm::cross(b - a, c - a);
+			double length = glm::length(normal);
+			if (length == 0.0)
+				continue;
+			normal /= length;
+			for (int k = 0; k < 3; ++k)
+				quadrics.at(current.at(i + k)).add_plane(normal, -glm::dot(normal, a));
+		}
+
+		std::vector<uint32_t> remap(vertices.size()), adjacency_offset(vertices.size() + 1), adjacency;
+		std::vector<bool> touched(vertices.size());
+		std::vector<Collapse> collapses;
+		while (current.size() > target_index_count)
+		{
+			std::fill(adjacency_offset.begin(), adjacency_offset.end(), 0);
+			for (uint32_t index : current)
+				++adjacency_offset.at(index + 1);
+			for (size_t v = 0; v < vertices.size(); ++v)
+				adjacency_offset.at(v + 1) += adjacency_offset.at(v);
+			adjacency.resize(current.size());
+			std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+			for (size_t i = 0; i < current.size(); ++i)
+				adjacency.at(fill.at(current.at(i))++) = static_cast<uint32_t>(i / 3);
+
+			collapses.clear();
+			for (size_t i = 0; i < current.size(); i += 3)
+				for (int k = 0; k < 3; ++k)
+				{
+					uint32_t a = current.at(i + k), b = current.at(i + (k + 1) % 3);
+					Quadric q = quadrics.at(a);
+					q.add(quadrics.at(b));
+					glm::dvec3 pa = vertices.at(a).pos, pb = vertices.at(b).pos;
+					if (!locked.at(a))
+						collapses.push_back({ a, b, q.evaluate(pb) });
+					if (!locked.at(b))
+						collapses.push_back({ b, a, q.evaluate(pa) });
+				}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+			for (size_t v = 0; v < vertices.size(); ++v)
+				remap.at(v) = static_cast<uint32_t>(v);
+			std::fill(touched.begin(), touched.end(), false);
+			size_t triangles = current.size() / 3, target_triangles = target_index_count / 3, performed = 0;
+			for (const auto& collapse : collapses)
+			{
+				if (triangles <= target_triangles)
+					break;
+				if (touched.at(collapse.from) || touched.at(collapse.to))
+					continue;
+				std::vector<uint32_t> around(adjacency.begin() + adjacency_offset.at(collapse.from), adjacency.begin() + adjacency_offset.at(collapse.from + 1));
+				if (flips(vertices, current, around, collapse.from, collapse.to))
+					continue;
+				//The whole one-ring is frozen for this pass, so the flip test above stays valid
+				for (uint32_t triangle : around)
+				{
+					const uint32_t* t = &current.at(3 * triangle);
+					touched.at(t[0]) = touched.at(t[1]) = touched.at(t[2]) = true;
+					triangles -= t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to;
+				}
+				remap.at(collapse.from) = collapse.to;
+				quadrics.at(collapse.to).add(quadrics.at(collapse.from));
+				max_cost = std::max(max_cost, collapse.cost);
+				++performed;
+			}
+			if (performed == 0)
+				break;
+			size_t kept = 0;
+			for (size_t i = 0; i < current.size(); i += 3)
+			{
+				uint32_t a = remap.at(current.at(i)), b = remap.at(current.at(i + 1)), c = remap.at(current.at(i + 2));
+				if (a == b || b == c || a == c)
+					continue;
+				current.at(kept++) = a;
+				current.at(kept++) = b;
+				current.at(kept++) = c;
+			}
+			current.resize(kept);
+		}
+		result_error = static_cast<float>(std::sqrt(max_cost));
+		return current;
+	}
+
+	std::vector<Mesh_lod> build_lod_chain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t level_count)
+	{
+		std::vector<Mesh_lod> lods{ { 0, static_cast<uint32_t>(indices.size()), 0.0f } };
+		std::vector<uint32_t> previous(indices);
+		float error = 0.0f;
+		for (uint32_t level = 1; level < level_count; ++level)
+		{
+			float level_error;
+			std::vector<uint32_t> next = simplify(vertices, previous, previous.size() / 6 * 3, level_error);
+			if (next.empty() || next.size() > previous.size() * (1.0f - MIN_REDUCTION))
+				break;
+			mesh_optimizer::optimize_vertex_cache(next, vertices.size());
+			//Each level starts from the previous one, so deviations from the full mesh add up
+			error += level_error;
+			lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(next.size()), error });
+			indices.insert(indices.end(), next.begin(), next.end());
+			previous = std::move(next);
+		}
+		return lods;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+#include <vector>
+#include <cstdint>
+#include "vertex_layout.h"
+
+//Index range of one level of detail, error is the object space deviation from the full mesh
+struct Mesh_lod
+{
+	uint32_t first_index;
+	uint32_t index_count;
+	float error;
+};
+
+namespace mesh_simplifier
+{
+	//Quadric edge collapse that only ever moves a vertex onto one of its neighbours, so every level keeps
+	//indexing the original vertex buffer; UV seams and open borders are locked
+	std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		size_t target_index_count, float& result_error);
+	//Appends up to level_count - 1 progressively halved levels after the full resolution indices
+	std::vector<Mesh_lod> build_lod_chain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t level_count);
+}
+#endif // !MESH_SIMPLIFIER_H
@@ -0,0 +1,103 @@
+#include "meshlet_builder.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//Cones whose normals spread further than this from the axis would almost never cull
+	const float MIN_CONE_DOT = 0.1f;
+
+	void compute_bounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Meshlet& meshlet)
+	{
+		auto position = [&](uint32_t i) { return vertices.at(meshlet.vertex_offset + indices.at(i)).pos; };
+		glm::vec3 low = position(meshlet.first_index), high = low, normal_sum(0.0f);
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.index_count / 3);
+		for (uint32_t i = meshlet.first_index; i < meshlet.first_index + meshlet.index_count; i += 3)
+		{
+			glm::vec3 a = position(i), b = position(i + 1), c = position(i + 2);
+			low = glm::min(low, glm::min(a, glm::min(b, c)));
+			high = glm::max(high, glm::max(a, glm::max(b, c)));
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length == 0.0f)
+				continue;
+			normals.push_back(normal / length);
+			normal_sum += normals.back();
+		}
+		meshlet.centre = (low + high) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (uint32_t i = meshlet.first_index; i < meshlet.first_index + meshlet.index_count; ++i)
+			meshlet.radius = std::max(meshlet.radius, glm::length(position(i) - meshlet.centre));
+
+		meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.cone_cutoff = 2.0f;
+		float axis_length = glm::length(normal_sum);
+		if (axis_length == 0.0f)
+			return;
+		meshlet.cone_axis = normal_sum / axis_length;
+		float min_dot = 1.0f;
+		for (const auto& normal : normals)
+			min_dot = std::min(min_dot, glm::dot(normal, meshlet.cone_axis));
+		if (min_dot > MIN_CONE_DOT)
+			meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+	}
+}
+
+namespace meshlet_builder
+{
+	void build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t first_index,
+		uint32_t index_count, int32_t vertex_offset, std::vector<Meshlet>& meshlets)
+	{
+		std::vector<uint32_t> used;
+		used.reserve(MAX_VERTICES);
+		Meshlet meshlet{};
+		meshlet.first_index = first_index;
+		meshlet.vertex_offset = vertex_offset;
+		for (uint32_t i = first_index; i + 2 < first_index + index_count; i += 3)
+		{
+			uint32_t new_vertices = 0;
+			for (uint32_t k = i; k < i + 3; ++k)
+				new_vertices += std::find(used.begin(), used.end(), indices.at(k)) == used.end();
+			if (used.size() + new_vertices > MAX_VERTICES || meshlet.index_count == 3 * MAX_TRIANGLES)
+			{
+				compute_bounds(vertices, indices, meshlet);
+				meshlets.push_back(meshlet);
+				meshlet.first_index = i;
+				meshlet.index_count = 0;
+				used.clear();
+			}
+			for (uint32_t k = i; k < i + 3; ++k)
+				if (std::find(used.begin(), used.end(), indices.at(k)) == used.end())
+					used.push_back(indices.at(k));
+			meshlet.index_count += 3;
+		}
+		if (meshlet.index_count == 0)
+			return;
+		compute_bounds(vertices, indices, meshlet);
+		meshlets.push_back(meshlet);
+	}
+
+	Cull_view make_view(const glm::mat4& view_projection, const glm::mat4& world, const glm::vec3& camera_position)
+	{
+		//Planes of the combined matrix are already in object space, depth is in the 0 to 1 range
+		glm::mat4 m = view_projection * world;
+		auto row = [&](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+		Cull_view view{};
+		view.planes = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2) };
+		for (auto& plane : view.planes)
+			plane /= glm::length(glm::vec3(plane));
+		//Facing is preserved by affine transforms, so the cones can be tested against the camera moved into object space
+		view.camera = glm::inverse(world) * glm::vec4(camera_position, 1.0f);
+		return view;
+	}
+
+	bool is_visible(const Meshlet& meshlet, const Cull_view& view)
+	{
+		for (const auto& plane : view.planes)
+			if (glm::dot(glm::vec3(plane), meshlet.centre) + plane.w < -meshlet.radius)
+				return false;
+		glm::vec3 to_centre = meshlet.centre - glm::vec3(view.camera);
+		return glm::dot(to_centre, meshlet.cone_axis) < meshlet.cone_cutoff * glm::length(to_centre) + meshlet.radius;
+	}
+}
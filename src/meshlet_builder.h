@@ -0,0 +1,51 @@
+#ifndef MESHLET_BUILDER_H
+#define MESHLET_BUILDER_H
+#include <array>
+#include <vector>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "vertex_layout.h"
+
+//Cluster of triangles drawn with one indexed draw, bounds are in object space. The layout matches the
+//std430 struct read by meshlet_cull.comp
+struct Meshlet
+{
+	glm::vec3 centre;
+	float radius;
+	//Normal cone, cutoff is the sine of the cone's half angle or 2 when the cone is too wide to cull anything
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+	uint32_t first_index;
+	uint32_t index_count;
+	int32_t vertex_offset;
+	uint32_t padding;
+};
+
+//Normalized frustum planes and camera position in the object space of one model
+struct Cull_view
+{
+	std::array<glm::vec4, 6> planes;
+	glm::vec4 camera;
+};
+
+//Push constants of the culling compute pass
+struct Cull_constants
+{
+	Cull_view view;
+	uint32_t first_meshlet;
+	uint32_t meshlet_count;
+	uint32_t output_offset;
+};
+
+namespace meshlet_builder
+{
+	const uint32_t MAX_VERTICES = 64;
+	const uint32_t MAX_TRIANGLES = 124;
+	//Splits an index range into meshlets in triangle order, which after vertex cache optimization keeps clusters compact
+	void build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t first_index,
+		uint32_t index_count, int32_t vertex_offset, std::vector<Meshlet>& meshlets);
+	Cull_view make_view(const glm::mat4& view_projection, const glm::mat4& world, const glm::vec3& camera_position);
+	//False when the meshlet is outside the frustum or all of its triangles face away from the camera
+	bool is_visible(const Meshlet& meshlet, const Cull_view& view);
+}
+#endif // !MESHLET_BUILDER_H
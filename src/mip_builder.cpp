@@ -0,0 +1,250 @@
+#include "mip_builder.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_BUILDER_SSE
+#endif
+
+namespace
+{
+	const int KAISER_RADIUS = 3;
+	const float KAISER_ALPHA = 4.0f;
+	const uint32_t ROWS_PER_WORKER = 32;
+
+	float srgb_to_linear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float linear_to_srgb(float c)
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	const std::array<float, 256>& decode_table()
+	{
+		static const std::array<float, 256> table = [] {
+			std::array<float, 256> t{};
+			for (int i = 0; i < 256; ++i)
+				t.at(i) = srgb_to_linear(i / 255.0f);
+			return t;
+		}();
+		return table;
+	}
+
+	//Linear values are quantized to 16 bits before the lookup, which keeps the darkest sRGB steps distinct
+	const std::vector<uint8_t>& encode_table()
+	{
+		static const std::vector<uint8_t> table = [] {
+			std::vector<uint8_t> t(65536);
+			for (int i = 0; i < 65536; ++i)
+				t.at(i) = static_cast<uint8_t>(linear_to_srgb(i / 65535.0f) * 255.0f + 0.5f);
+			return t;
+		}();
+		return table;
+	}
+
+	float bessel_i0(float x)
+	{
+		float sum = 1.0f, term = 1.0f, half_x = x * 0.5f;
+		for (int k = 1; k < 16; ++k)
+		{
+			term *= (half_x / k) * (half_x / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	//Taps for a 2:1 decimation, centred between source texels 2x and 2x + 1
+	std::array<float, 2 * KAISER_RADIUS> kaiser_weights()
+	{
+		std::array<float, 2 * KAISER_RADIUS> weights{};
+		float total = 0.0f;
+		for (int i = 0; i < 2 * KAISER_RADIUS; ++i)
+		{
+			float d = i - KAISER_RADIUS + 0.5f, t = d * 0.5f;
+			float sinc = std::sin(3.14159265f * t) / (3.14159265f * t);
+			float u = d / KAISER_RADIUS;
+			float window = bessel_i0(KAISER_ALPHA * std::sqrt(std::max(0.0f, 1.0f - u * u))) / bessel_i0(KAISER_ALPHA);
+			weights.at(i) = sinc * window;
+			total += weights.at(i);
+		}
+		for (auto& weight : weights)
+			weight /= total;
+		return weights;
+	}
+}
+
+Mip_builder::Mip_builder(Mip_filter f, bool is_srgb) : Mip_builder(f, is_srgb, std::thread::hardware_concurrency())
+{
+}
+
+Mip_builder::Mip_builder(Mip_filter f, bool is_srgb, unsigned int workers) : filter(f), srgb(is_srgb), worker_count(std::max(1u, workers))
+{
+}
+
+template<typename Function>
+void Mip_builder::parallel_rows(uint32_t rows, Function function) const
+{
+	uint32_t workers = std::min(worker_count, (rows + ROWS_PER_WORKER - 1) / ROWS_PER_WORKER);
+	if (workers <= 1)
+	{
+		function(0u, rows);
+		return;
+	}
+	std::vector<std::thread> threads;
+	uint32_t chunk = (rows + workers - 1) / workers;
+	for (uint32_t first = chunk; first < rows; first += chunk)
+		threads.emplace_back(function, first, std::min(rows, first + chunk));
+	function(0u, std::min(rows, chunk));
+	for (auto& thread : threads)
+		thread.join();
+}
+
+uint32_t Mip_builder::level_count(uint32_t width, uint32_t height)
+{
+	return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+Mip_chain Mip_builder::single_level(const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+	Mip_chain chain{};
+	chain.data.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	chain.levels.push_back({ width, height, 0 });
+	return chain;
+}
+
+Mip_chain Mip_builder::build(const uint8_t* pixels, uint32_t width, uint32_t height) const
+{
+	uint32_t levels = level_count(width, height);
+	Mip_chain chain{};
+	VkDeviceSize total_size = 0;
+	for (uint32_t i = 0, w = width, h = height; i < levels; ++i)
+	{
+		chain.levels.push_back({ w, h, total_size });
+		total_size += static_cast<VkDeviceSize>(w) * h * 4;
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	chain.data.resize(static_cast<size_t>(total_size));
+	std::copy(pixels, pixels + static_cast<size_t>(width) * height * 4, chain.data.begin());
+
+	std::vector<float> src(static_cast<size_t>(width) * height * 4), dst;
+	parallel_rows(height, [&](uint32_t first, uint32_t last) {
+		decode(pixels + static_cast<size_t>(first) * width * 4, src.data() + static_cast<size_t>(first) * width * 4, (last - first) * width);
+	});
+	for (uint32_t i = 1; i < levels; ++i)
+	{
+		const Mip_level& previous = chain.levels.at(i - 1), &current = chain.levels.at(i);
+		dst.resize(static_cast<size_t>(current.width) * current.height * 4);
+		if (filter == Mip_filter::kaiser)
+			downsample_kaiser(src.data(), previous.width, previous.height, dst.data(), current.width, current.height);
+		else
+			downsample_box(src.data(), previous.width, previous.height, dst.data(), current.width, current.height);
+		uint8_t* out = chain.data.data() + current.offset;
+		parallel_rows(current.height, [&](uint32_t first, uint32_t last) {
+			size_t begin = static_cast<size_t>(first) * current.width * 4;
+			encode(dst.data() + begin, out + begin, (last - first) * current.width);
+		});
+		std::swap(src, dst);
+	}
+	return chain;
+}
+
+void Mip_builder::decode(const uint8_t* pixels, float* linear, uint32_t count) const
+{
+	const auto& table = decode_table();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+			linear[4 * i + c] = srgb ? table.at(pixels[4 * i + c]) : pixels[4 * i + c] / 255.0f;
+		linear[4 * i + 3] = pixels[4 * i + 3] / 255.0f;
+	}
+}
+
+void Mip_builder::encode(const float* linear, uint8_t* pixels, uint32_t count) const
+{
+	const auto& table = encode_table();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			float value = std::min(1.0f, std::max(0.0f, linear[4 * i + c]));
+			if (srgb && c < 3)
+				pixels[4 * i + c] = table.at(static_cast<size_t>(value * 65535.0f + 0.5f));
+			else
+				pixels[4 * i + c] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+		}
+	}
+}
+
+void Mip_builder::downsample_box(const float* src, uint32_t src_width, uint32_t src_height, float* dst, uint32_t dst_width, uint32_t dst_height) const
+{
+	parallel_rows(dst_height, [&](uint32_t first, uint32_t last) {
+		for (uint32_t y = first; y < last; ++y)
+		{
+			const float* row0 = src + static_cast<size_t>(std::min(2 * y, src_height - 1)) * src_width * 4;
+			const float* row1 = src + static_cast<size_t>(std::min(2 * y + 1, src_height - 1)) * src_width * 4;
+			float* out = dst + static_cast<size_t>(y) * dst_width * 4;
+			for (uint32_t x = 0; x < dst_width; ++x)
+			{
+				uint32_t x0 = std::min(2 * x, src_width - 1) * 4, x1 = std::min(2 * x + 1, src_width - 1) * 4;
+#ifdef MIP_BUILDER_SSE
+				__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+					_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+				_mm_storeu_ps(out + 4 * x, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+				for (int c = 0; c < 4; ++c)
+					out[4 * x + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+			}
+		}
+	});
+}
+
+void Mip_builder::downsample_kaiser(const float* src, uint32_t src_width, uint32_t src_height, float* dst, uint32_t dst_width, uint32_t dst_height) const
+{
+	static const auto weights = kaiser_weights();
+	std::vector<float> horizontal(static_cast<size_t>(dst_width) * src_height * 4);
+	auto filter_row = [&](const float* in, uint32_t in_count, size_t in_stride, float* out, uint32_t out_count, size_t out_stride) {
+		for (uint32_t x = 0; x < out_count; ++x)
+		{
+			float* texel = out + x * out_stride;
+			if (in_count == out_count)
+			{
+				std::copy(in + x * in_stride, in + x * in_stride + 4, texel);
+				continue;
+			}
+#ifdef MIP_BUILDER_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < 2 * KAISER_RADIUS; ++k)
+			{
+				int i = std::min(std::max(static_cast<int>(2 * x) - KAISER_RADIUS + 1 + k, 0), static_cast<int>(in_count) - 1);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + i * in_stride), _mm_set1_ps(weights.at(k))));
+			}
+			_mm_storeu_ps(texel, sum);
+#else
+			std::fill(texel, texel + 4, 0.0f);
+			for (int k = 0; k < 2 * KAISER_RADIUS; ++k)
+			{
+				int i = std::min(std::max(static_cast<int>(2 * x) - KAISER_RADIUS + 1 + k, 0), static_cast<int>(in_count) - 1);
+				for (int c = 0; c < 4; ++c)
+					texel[c] += in[i * in_stride + c] * weights.at(k);
+			}
+#endif
+		}
+	};
+	parallel_rows(src_height, [&](uint32_t first, uint32_t last) {
+		for (uint32_t y = first; y < last; ++y)
+			filter_row(src + static_cast<size_t>(y) * src_width * 4, src_width, 4,
+				horizontal.data() + static_cast<size_t>(y) * dst_width * 4, dst_width, 4);
+	});
+	parallel_rows(dst_width, [&](uint32_t first, uint32_t last) {
+		for (uint32_t x = first; x < last; ++x)
+			filter_row(horizontal.data() + static_cast<size_t>(x) * 4, src_height, static_cast<size_t>(dst_width) * 4,
+				dst + static_cast<size_t>(x) * 4, dst_height, static_cast<size_t>(dst_width) * 4);
+	});
+}
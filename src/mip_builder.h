@@ -0,0 +1,41 @@
+#ifndef MIP_BUILDER_H
+#define MIP_BUILDER_H
+#include <vector>
+#include <cstdint>
+#include "vulkan/vulkan.h"
+
+enum class Mip_filter { box, kaiser };
+
+struct Mip_level
+{
+	uint32_t width;
+	uint32_t height;
+	VkDeviceSize offset;
+};
+
+//All levels of an RGBA8 image packed back to back, ready for a single buffer to image copy
+struct Mip_chain
+{
+	std::vector<uint8_t> data;
+	std::vector<Mip_level> levels;
+};
+
+class Mip_builder
+{
+	Mip_filter filter;
+	bool srgb;
+	unsigned int worker_count;
+	void decode(const uint8_t* pixels, float* linear, uint32_t count) const;
+	void encode(const float* linear, uint8_t* pixels, uint32_t count) const;
+	void downsample_box(const float* src, uint32_t src_width, uint32_t src_height, float* dst, uint32_t dst_width, uint32_t dst_height) const;
+	void downsample_kaiser(const float* src, uint32_t src_width, uint32_t src_height, float* dst, uint32_t dst_width, uint32_t dst_height) const;
+	template<typename Function>
+	void parallel_rows(uint32_t rows, Function function) const;
+public:
+	Mip_builder(Mip_filter f, bool is_srgb);
+	Mip_builder(Mip_filter f, bool is_srgb, unsigned int workers);
+	Mip_chain build(const uint8_t* pixels, uint32_t width, uint32_t height) const;
+	static Mip_chain single_level(const uint8_t* pixels, uint32_t width, uint32_t height);
+	static uint32_t level_count(uint32_t width, uint32_t height);
+};
+#endif // !MIP_BUILDER_H
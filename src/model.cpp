@@ -22,12 +22,27 @@ void Model::assign_texture(const std::string& tex_path)
 {
 	texture_path = tex_path;
 	create_descriptor_pool();
-	create_texture_image();
+	create_texture_image(load_texture());
 	create_texture_image_view();
 	create_texture_sampler();
 	create_descriptor_sets();
 }
 
+void Model::assign_mesh(const std::string& path)
+{
+	mesh_path = path;
+	vertices.clear();
+	indicies.clear();
+	current_lod = 0;
+	load_model();
+	build_submeshes();
+	build_meshlets();
+	create_vertex_buffer();
+	create_index_buffer();
+	create_meshlet_buffer();
+	create_cull_resources();
+}
+
 void Model::rotate(const float x, const float y, const float z)
 {
 	model_mat = glm::rotate(model_mat, glm::radians(x), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -35,9 +50,10 @@ void Model::rotate(const float x, const float y, const float z)
 	model_mat = glm::rotate(model_mat, glm::radians(y), glm::vec3(0.0f, 0.0f, 1.0f));
 }
 
-void Model::switch_animated_rotation()
+void Model::set_mip_generation(Mip_generation generation, Mip_filter filter)
 {
-	rotate_model = !rotate_model;
+	mip_generation = generation;
+	mip_filter = filter;
 }
 
 glm::vec3 Model::get_position() const
@@ -45,16 +61,6 @@ glm::vec3 Model::get_position() const
 	return position;
 }
 
-bool Model::get_animation_state() const
-{
-	return rotate_model;
-}
-
-VkDeviceMemory Model::get_uniform_buffer_memory(uint32_t index) const
-{
-	return uniform_mem.at(index);
-}
-
 VkDeviceMemory Model::get_vertex_buffer_memory() const
 {
 	return vertex_memory;
@@ -90,14 +96,14 @@ VkBuffer Model::get_vertex_buffer() const
 	return vertex_buffer;
 }
 
-VkBuffer Model::get_index_buffer() const
+VkBuffer Model::get_position_buffer() const
 {
-	return index_buffer;
+	return position_buffer;
 }
 
-std::vector<VkBuffer> Model::get_uniform_buffers() const
+VkBuffer Model::get_index_buffer() const
 {
-	return uniform_buffers;
+	return index_buffer;
 }
 
 VkDescriptorPool Model::get_descriptor_pool() const
@@ -105,9 +111,9 @@ VkDescriptorPool Model::get_descriptor_pool() const
 	return descriptor_pool;
 }
 
-std::vector<VkDescriptorSet> Model::get_descriptor_sets() const
+VkDescriptorSet Model::get_descriptor_set() const
 {
-	return descriptor_sets;
+	return descriptor_set;
 }
 
 uint32_t Model::get_indicies_size() const
@@ -115,6 +121,150 @@ uint32_t Model::get_indicies_size() const
 	return static_cast<uint32_t>(indicies.size());
 }
 
+const std::vector<Draw_range>& Model::get_submeshes() const
+{
+	//CPU culled meshes draw the merged ranges of the meshlets that survived the last cull
+	if (has_meshlets() && !uses_gpu_culling())
+		return visible_ranges;
+	return lods.at(current_lod).ranges;
+}
+
+const std::vector<Draw_range>& Model::get_lod_ranges() const
+{
+	return lods.at(current_lod).ranges;
+}
+
+uint32_t Model::get_lod() const
+{
+	return current_lod;
+}
+
+uint32_t Model::get_lod_count() const
+{
+	return static_cast<uint32_t>(lods.size());
+}
+
+glm::vec3 Model::get_bounds_centre() const
+{
+	return bounds_centre;
+}
+
+float Model::get_bounds_radius() const
+{
+	return bounds_radius;
+}
+
+bool Model::select_lod(const glm::mat4& world, const glm::vec3& camera_position, const float pixels_per_unit, const float threshold, const float hysteresis)
+{
+	//Object space errors are scaled by the largest axis of the world matrix and projected at the nearest point of the bounds
+	float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+	glm::vec3 centre = glm::vec3(world * glm::vec4(bounds_centre, 1.0f));
+	float distance = std::max(glm::length(centre - camera_position) - bounds_radius * scale, 0.001f);
+	float error_scale = scale * pixels_per_unit / distance;
+	//Coarser levels have to beat a stricter threshold than the one that keeps the current level, so objects near
+	//the boundary don't switch back and forth every frame
+	uint32_t selected = 0;
+	for (uint32_t i = 1; i < lods.size(); ++i)
+	{
+		float limit = i > current_lod ? threshold * (1.0f - hysteresis) : threshold;
+		if (lods.at(i).error * error_scale > limit)
+			break;
+		selected = i;
+	}
+	bool changed = selected != current_lod;
+	current_lod = selected;
+	return changed;
+}
+
+void Model::set_meshlet_culling(Meshlet_culling mode, const uint32_t min_triangles, VkDescriptorSetLayout layout)
+{
+	meshlet_culling = mode;
+	meshlet_min_triangles = min_triangles;
+	cull_set_layout = layout;
+}
+
+bool Model::has_meshlets() const
+{
+	return !meshlets.empty();
+}
+
+bool Model::uses_gpu_culling() const
+{
+	return meshlet_culling == Meshlet_culling::gpu && has_meshlets();
+}
+
+void Model::cull_meshlets(const Cull_view& view)
+{
+	cull_view = view;
+	if (uses_gpu_culling())
+		return;
+	visible_ranges.clear();
+	const Lod_level& level = lods.at(current_lod);
+	for (uint32_t i = level.first_meshlet; i < level.first_meshlet + level.meshlet_count; ++i)
+	{
+		const Meshlet& meshlet = meshlets.at(i);
+		if (!meshlet_builder::is_visible(meshlet, view))
+			continue;
+		//Neighbouring meshlets are contiguous in the index buffer, so runs of visible ones collapse into a single draw
+		if (!visible_ranges.empty() && visible_ranges.back().vertex_offset == meshlet.vertex_offset
+			&& visible_ranges.back().first_index + visible_ranges.back().index_count == meshlet.first_index)
+			visible_ranges.back().index_count += meshlet.index_count;
+		else
+			visible_ranges.push_back({ meshlet.first_index, meshlet.index_count, meshlet.vertex_offset });
+	}
+}
+
+Cull_constants Model::get_cull_constants(const uint32_t frame) const
+{
+	const Lod_level& level = lods.at(current_lod);
+	return { cull_view, level.first_meshlet, level.meshlet_count, frame * static_cast<uint32_t>(meshlets.size()) + level.first_meshlet };
+}
+
+uint32_t Model::get_meshlet_count() const
+{
+	return lods.at(current_lod).meshlet_count;
+}
+
+VkDeviceSize Model::get_indirect_offset(const uint32_t frame) const
+{
+	return get_cull_constants(frame).output_offset * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+VkBuffer Model::get_meshlet_buffer() const
+{
+	return meshlet_buffer;
+}
+
+VkDeviceMemory Model::get_meshlet_memory() const
+{
+	return meshlet_mem;
+}
+
+VkBuffer Model::get_indirect_buffer() const
+{
+	return indirect_buffer;
+}
+
+VkDeviceMemory Model::get_indirect_memory() const
+{
+	return indirect_mem;
+}
+
+VkDescriptorPool Model::get_cull_descriptor_pool() const
+{
+	return cull_descriptor_pool;
+}
+
+VkDescriptorSet Model::get_cull_descriptor_set() const
+{
+	return cull_descriptor_set;
+}
+
+VkIndexType Model::get_index_type() const
+{
+	return index_type;
+}
+
 void Model::set_position(const float x, const float y, const float z)
 {
 	position = glm::vec3(x, y, z);
@@ -125,34 +275,132 @@ glm::mat4 Model::get_model_matrix() const
 	return model_mat;
 }
 
-void Model::recreate_swap_chain_elements()
+glm::mat4 Model::get_position_transform() const
 {
-	create_descriptor_pool();
-	create_uniform_buffer();
-	create_descriptor_sets();
+	return position_transform;
+}
+
+glm::vec4 Model::get_uv_transform() const
+{
+	return uv_transform;
+}
+
+glm::vec4 Model::get_constant_colour() const
+{
+	return constant_colour;
+}
+
+bool Model::has_vertex_colour() const
+{
+	return has_colour;
+}
+
+void Model::set_vertex_layout(const Vertex_layout& layout)
+{
+	vertex_layout = layout;
+}
+
+void Model::set_mesh_processing(const bool optimize, const bool use_cache, const uint32_t levels)
+{
+	optimize_mesh = optimize;
+	use_mesh_cache = use_cache;
+	lod_count = std::max(1u, levels);
+}
+
+void Model::set_resource_pool(std::shared_ptr<Resource_pool> pool)
+{
+	resource_pool = pool;
+}
+
+VkDeviceSize Model::get_memory_size() const
+{
+	if (!resource_pool)
+		return 0;
+	return resource_pool->get_buffer_size(vertex_buffer) + resource_pool->get_buffer_size(position_buffer) + resource_pool->get_buffer_size(index_buffer) + resource_pool->get_buffer_size(meshlet_buffer)
+		+ resource_pool->get_buffer_size(indirect_buffer) + resource_pool->get_image_size(texture_img);
+}
+
+Mesh_stats Model::get_mesh_stats() const
+{
+	return mesh_stats;
+}
+
+uint64_t Model::get_upload_value() const
+{
+	return upload_value;
+}
+
+void Model::recreate_frame_resources()
+{
+	create_cull_resources();
+}
+
+void Model::set_frames_in_flight(const int count)
+{
+	frames_in_flight = count;
+	recreate_frame_resources();
 }
 
 void Model::init_model()
+{
+	prepare();
+	create_resources();
+}
+
+void Model::prepare()
+{
+	//Decoding and mip building run on worker threads while the mesh is parsed
+	auto texture = std::async(std::launch::async, &Model::load_texture, this);
+	load_model();
+	build_submeshes();
+	build_meshlets();
+	texture_chain = texture.get();
+}
+
+void Model::create_resources()
 {
 	create_descriptor_pool();
-	create_texture_image();
+	create_texture_image(texture_chain);
+	texture_chain = {};
 	create_texture_image_view();
 	create_texture_sampler();
-	load_model();
 	create_vertex_buffer();
 	create_index_buffer();
-	create_uniform_buffer();
+	create_meshlet_buffer();
 	create_descriptor_sets();
+	create_cull_resources();
 }
 
-void Model::create_texture_image()
+bool Model::use_cpu_mipmaps()
+{
+	VkFormat format = TEXTURE_FORMAT;
+	if (mip_generation == Mip_generation::automatic)
+		return !(dev->get_format_properties(format).optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+	return mip_generation == Mip_generation::cpu;
+}
+
+Mip_chain Model::load_texture()
 {
 	int tex_width, tex_height, tex_channels;
 	stbi_uc* pixels = stbi_load(texture_path.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-	VkDeviceSize img_size = tex_width * tex_height * 4;
 	if (!pixels)
 		throw std::runtime_error("Failed to load texture file!\n");
-	mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex_width, tex_height)))) + 1;
+	Mip_chain chain{};
+	if (use_cpu_mipmaps())
+		chain = Mip_builder(mip_filter, true).build(pixels, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
+	else
+		chain = Mip_builder::single_level(pixels, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
+	stbi_image_free(pixels);
+	return chain;
+}
+
+void Model::create_texture_image(const Mip_chain& chain)
+{
+	uint32_t tex_width = chain.levels.front().width, tex_height = chain.levels.front().height;
+	VkFormat format = TEXTURE_FORMAT;
+	VkDeviceSize img_size = chain.data.size();
+	mip_levels = Mip_builder::level_count(tex_width, tex_height);
+	bool complete_chain = chain.levels.size() == mip_levels;
 	VkBuffer staging_buffer{};
 	VkDeviceMemory staging_memory{};
 	create_buffer(img_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -160,22 +408,38 @@ void Model::create_texture_image()
 		staging_buffer, staging_memory);
 	void* data;
 	vkMapMemory(dev->get_device(), staging_memory, 0, img_size, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(img_size));
+	memcpy(data, chain.data.data(), static_cast<size_t>(img_size));
 	vkUnmapMemory(dev->get_device(), staging_memory);
-	stbi_image_free(pixels);
-	create_image(tex_width, tex_height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		texture_img, texture_mem, mip_levels, VK_SAMPLE_COUNT_1_BIT);
-	transition_image_layout(texture_img, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
-	copy_buffer_to_img(staging_buffer, texture_img, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
-	generate_mipmaps(texture_img, VK_FORMAT_R8G8B8A8_UNORM, tex_width, tex_height, mip_levels);
-	vkDestroyBuffer(dev->get_device(), staging_buffer, nullptr);
-	vkFreeMemory(dev->get_device(), staging_memory, nullptr);
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (!complete_chain)
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	if (!complete_chain && !(dev->get_format_properties(format).optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		throw std::runtime_error("Texture image format doesn't support linear blitting!\n");
+	create_image(tex_width, tex_height, format, VK_IMAGE_TILING_OPTIMAL,
+		usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_img, texture_mem, mip_levels, VK_SAMPLE_COUNT_1_BIT);
+	auto command_buffer = begin_upload_commands();
+	VkImageMemoryBarrier barrier = texture_barrier(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	copy_buffer_to_img(command_buffer, staging_buffer, texture_img, chain.levels);
+	uint64_t upload{};
+	if (complete_chain)
+		upload = end_upload_commands(command_buffer, {}, { texture_barrier(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT) }, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	else
+	{
+		//Blits need the graphics queue, so the image is handed over before the chain is generated
+		VkImage img = texture_img;
+		uint32_t levels = mip_levels;
+		upload = end_upload_commands(command_buffer, {}, { texture_barrier(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT) }, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			[=](VkCommandBuffer graphics_commands) { generate_mipmaps(graphics_commands, img, tex_width, tex_height, levels); });
+	}
+	release_staging(upload, staging_buffer, staging_memory);
 }
 
 void Model::create_texture_image_view()
 {
-	texture_img_view = create_image_view(texture_img, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels);
+	texture_img_view = create_image_view(texture_img, TEXTURE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels);
 }
 
 void Model::create_texture_sampler()
@@ -198,12 +462,43 @@ void Model::create_texture_sampler()
 }
 
 void Model::load_model()
+{
+	uint32_t cache_flags = (optimize_mesh ? mesh_cache::FLAG_OPTIMIZED : 0) | lod_count << mesh_cache::LOD_SHIFT;
+	if (!use_mesh_cache || !mesh_cache::load(mesh_path, cache_flags, vertices, indicies, mesh_lods, mesh_stats))
+	{
+		parse_model();
+		mesh_stats.before = mesh_stats.after = mesh_optimizer::analyze_vertex_cache(indicies, vertices.size(), mesh_optimizer::FIFO_CACHE_SIZE);
+		if (optimize_mesh)
+			mesh_stats = mesh_optimizer::optimize(vertices, indicies);
+		//Coarser levels are appended to the same index buffer and reuse the vertices of the full mesh
+		mesh_lods = mesh_simplifier::build_lod_chain(vertices, indicies, lod_count);
+		if (use_mesh_cache)
+			mesh_cache::store(mesh_path, cache_flags, vertices, indicies, mesh_lods, mesh_stats);
+	}
+	compute_bounds();
+}
+
+void Model::compute_bounds()
+{
+	glm::vec3 low(std::numeric_limits<float>::max()), high(std::numeric_limits<float>::lowest());
+	for (const auto& vertex : vertices)
+	{
+		low = glm::min(low, vertex.pos);
+		high = glm::max(high, vertex.pos);
+	}
+	bounds_centre = (low + high) * 0.5f;
+	bounds_radius = 0.0f;
+	for (const auto& vertex : vertices)
+		bounds_radius = std::max(bounds_radius, glm::length(vertex.pos - bounds_centre));
+}
+
+void Model::parse_model()
 {
 	tinyobj::attrib_t attrib{};
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string warn, err;
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, mesh_path.c_str()))
 		throw std::runtime_error(warn + err);
 	std::unordered_map<Vertex, uint32_t>unique_vertices{};
 	for (const auto& shape : shapes)
@@ -234,26 +529,174 @@ void Model::load_model()
 
 void Model::create_vertex_buffer()
 {
+	Vertex_stream stream = vertex_layout.pack(vertices);
+	position_transform = stream.position_transform;
+	uv_transform = stream.uv_transform;
+	constant_colour = stream.constant_colour;
+	has_colour = stream.has_colour;
+	auto upload = [this](const std::vector<uint8_t>& source, VkBuffer& buffer, VkDeviceMemory& memory) {
+		VkDeviceSize buffer_size = source.size();
+		VkBuffer staging_buffer;
+		VkDeviceMemory staging_memory;
+		create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			staging_buffer, staging_memory);
+		void* data;
+		vkMapMemory(dev->get_device(), staging_memory, 0, buffer_size, 0, &data);
+		memcpy(data, source.data(), static_cast<size_t>(buffer_size));
+		vkUnmapMemory(dev->get_device(), staging_memory);
+		create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+		release_staging(copy_buffer(staging_buffer, buffer, buffer_size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT),
+			staging_buffer, staging_memory);
+	};
+	upload(stream.data, vertex_buffer, vertex_memory);
+	upload(stream.positions, position_buffer, position_memory);
+}
 
-	VkDeviceSize buffer_size = sizeof(vertices.at(0)) * vertices.size();
+void Model::build_submeshes()
+{
+	const uint32_t max_vertices = std::numeric_limits<uint16_t>::max() + 1;
+	lods.clear();
+	index_type = VK_INDEX_TYPE_UINT16;
+	if (vertices.size() <= max_vertices)
+	{
+		for (const auto& lod : mesh_lods)
+			lods.push_back({ { { lod.first_index, lod.index_count, 0 } }, lod.error, 0, 0 });
+		return;
+	}
+	//Triangles are assigned in order to submeshes of at most 65536 vertices each, shared border vertices get duplicated,
+	//every detail level is split on its own so coarse levels stay a single draw wherever possible
+	const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> remap(vertices.size(), unassigned), local_indicies;
+	std::vector<Vertex> split_vertices;
+	std::vector<uint32_t> used;
+	local_indicies.reserve(indicies.size());
+	for (const auto& lod : mesh_lods)
+	{
+		Lod_level level{ {}, lod.error, 0, 0 };
+		Draw_range range{ static_cast<uint32_t>(local_indicies.size()), 0, static_cast<int32_t>(split_vertices.size()) };
+		for (size_t i = lod.first_index; i + 2 < lod.first_index + lod.index_count; i += 3)
+		{
+			uint32_t new_vertices = 0;
+			for (size_t k = i; k < i + 3; ++k)
+				new_vertices += remap.at(indicies.at(k)) == unassigned;
+			if (used.size() + new_vertices > max_vertices)
+			{
+				level.ranges.push_back(range);
+				range = { static_cast<uint32_t>(local_indicies.size()), 0, static_cast<int32_t>(split_vertices.size()) };
+				for (uint32_t vertex : used)
+					remap.at(vertex) = unassigned;
+				used.clear();
+			}
+			for (size_t k = i; k < i + 3; ++k)
+			{
+				uint32_t& local = remap.at(indicies.at(k));
+				if (local == unassigned)
+				{
+					local = static_cast<uint32_t>(used.size());
+					used.push_back(indicies.at(k));
+					split_vertices.push_back(vertices.at(indicies.at(k)));
+				}
+				local_indicies.push_back(local);
+			}
+			range.index_count += 3;
+		}
+		level.ranges.push_back(range);
+		lods.push_back(std::move(level));
+		for (uint32_t vertex : used)
+			remap.at(vertex) = unassigned;
+		used.clear();
+	}
+	vertices = std::move(split_vertices);
+	indicies = std::move(local_indicies);
+}
+
+void Model::build_meshlets()
+{
+	meshlets.clear();
+	visible_ranges.clear();
+	if (meshlet_culling == Meshlet_culling::off || mesh_lods.front().index_count / 3 < meshlet_min_triangles)
+		return;
+	//Meshlets never cross a submesh, so each one keeps a single vertex offset
+	for (auto& level : lods)
+	{
+		level.first_meshlet = static_cast<uint32_t>(meshlets.size());
+		for (const auto& range : level.ranges)
+			meshlet_builder::build(vertices, indicies, range.first_index, range.index_count, range.vertex_offset, meshlets);
+		level.meshlet_count = static_cast<uint32_t>(meshlets.size()) - level.first_meshlet;
+	}
+}
+
+void Model::create_meshlet_buffer()
+{
+	meshlet_buffer = VK_NULL_HANDLE;
+	meshlet_mem = VK_NULL_HANDLE;
+	if (!uses_gpu_culling())
+		return;
+	VkDeviceSize buffer_size = sizeof(Meshlet) * meshlets.size();
 	VkBuffer staging_buffer;
 	VkDeviceMemory staging_memory;
 	create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 		staging_buffer, staging_memory);
 	void* data;
 	vkMapMemory(dev->get_device(), staging_memory, 0, buffer_size, 0, &data);
-	memcpy(data, vertices.data(), static_cast<size_t>(buffer_size));
+	memcpy(data, meshlets.data(), static_cast<size_t>(buffer_size));
 	vkUnmapMemory(dev->get_device(), staging_memory);
-	create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_memory);
-	copy_buffer(staging_buffer, vertex_buffer, buffer_size);
-	vkDestroyBuffer(dev->get_device(), staging_buffer, nullptr);
-	vkFreeMemory(dev->get_device(), staging_memory, nullptr);
+	create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshlet_buffer, meshlet_mem);
+	release_staging(copy_buffer(staging_buffer, meshlet_buffer, buffer_size, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT),
+		staging_buffer, staging_memory);
+}
+
+void Model::create_cull_resources()
+{
+	indirect_buffer = VK_NULL_HANDLE;
+	indirect_mem = VK_NULL_HANDLE;
+	cull_descriptor_pool = VK_NULL_HANDLE;
+	cull_descriptor_set = VK_NULL_HANDLE;
+	if (!uses_gpu_culling())
+		return;
+	create_buffer(sizeof(VkDrawIndexedIndirectCommand) * meshlets.size() * frames_in_flight,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirect_buffer, indirect_mem);
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = 2;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = 1;
+	if (vkCreateDescriptorPool(dev->get_device(), &pool_info, nullptr, &cull_descriptor_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create culling descriptor pool!\n");
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = cull_descriptor_pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &cull_set_layout;
+	if (vkAllocateDescriptorSets(dev->get_device(), &alloc_info, &cull_descriptor_set) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate culling descriptor set!\n");
+	std::array<VkDescriptorBufferInfo, 2> buffer_infos{};
+	buffer_infos.at(0).buffer = meshlet_buffer;
+	buffer_infos.at(1).buffer = indirect_buffer;
+	buffer_infos.at(0).range = buffer_infos.at(1).range = VK_WHOLE_SIZE;
+	std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
+	for (uint32_t i = 0; i < descriptor_writes.size(); ++i)
+	{
+		descriptor_writes.at(i).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_writes.at(i).dstSet = cull_descriptor_set;
+		descriptor_writes.at(i).dstBinding = i;
+		descriptor_writes.at(i).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptor_writes.at(i).descriptorCount = 1;
+		descriptor_writes.at(i).pBufferInfo = &buffer_infos.at(i);
+	}
+	vkUpdateDescriptorSets(dev->get_device(), static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
 }
 
 void Model::create_index_buffer()
 {
-	VkDeviceSize buffer_size = sizeof(indicies.at(0)) * indicies.size();
+	//Every submesh addresses at most 65536 vertices, so the indices always fit 16 bits
+	std::vector<uint16_t> short_indicies(indicies.begin(), indicies.end());
+	VkDeviceSize buffer_size = sizeof(short_indicies.at(0)) * short_indicies.size();
 	VkBuffer staging_buffer;
 	VkDeviceMemory staging_memory;
 	create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -261,40 +704,25 @@ void Model::create_index_buffer()
 		staging_buffer, staging_memory);
 	void* data{};
 	vkMapMemory(dev->get_device(), staging_memory, 0, buffer_size, 0, &data);
-	memcpy(data, indicies.data(), static_cast<size_t>(buffer_size));
+	memcpy(data, short_indicies.data(), static_cast<size_t>(buffer_size));
 	vkUnmapMemory(dev->get_device(), staging_memory);
 	create_buffer(buffer_size,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_mem);
-	copy_buffer(staging_buffer, index_buffer, buffer_size);
-	vkDestroyBuffer(dev->get_device(), staging_buffer, nullptr);
-	vkFreeMemory(dev->get_device(), staging_memory, nullptr);
-}
-
-void Model::create_uniform_buffer()
-{
-	VkDeviceSize buffer_size = sizeof(Uniform_buffer_object);
-	uniform_buffers.resize(swap_chain_images_count);
-	uniform_mem.resize(swap_chain_images_count);
-	for (int i = 0; i < swap_chain_images_count; ++i)
-	{
-		create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			uniform_buffers.at(i), uniform_mem.at(i));
-	}
+	release_staging(copy_buffer(staging_buffer, index_buffer, buffer_size, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT),
+		staging_buffer, staging_memory);
 }
 
 void Model::create_descriptor_pool()
 {
-	std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-	pool_sizes.at(0).descriptorCount = pool_sizes.at(1).descriptorCount = static_cast<uint32_t>(swap_chain_images_count);
-	pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	VkDescriptorPoolSize pool_size{};
+	pool_size.descriptorCount = 1;
+	pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	VkDescriptorPoolCreateInfo pool_info{};
 	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
-	pool_info.pPoolSizes = pool_sizes.data();
-	pool_info.maxSets = static_cast<uint32_t>(swap_chain_images_count);
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = 1;
 	if (vkCreateDescriptorPool(dev->get_device(), &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create descriptor pool!\n");
 
@@ -303,41 +731,27 @@ void Model::create_descriptor_pool()
 
 void Model::create_descriptor_sets()
 {
-	std::vector<VkDescriptorSetLayout> layouts(swap_chain_images_count, descriptor_set_layout);
 	VkDescriptorSetAllocateInfo alloc_info{};
 	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	alloc_info.descriptorPool = descriptor_pool;
-	alloc_info.descriptorSetCount = static_cast<uint32_t>(swap_chain_images_count);
-	alloc_info.pSetLayouts = layouts.data();
-
-	descriptor_sets.resize(swap_chain_images_count);
-	if (vkAllocateDescriptorSets(dev->get_device(), &alloc_info, descriptor_sets.data()) != VK_SUCCESS)
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &descriptor_set_layout;
+	if (vkAllocateDescriptorSets(dev->get_device(), &alloc_info, &descriptor_set) != VK_SUCCESS)
 		throw std::runtime_error("Failed to allocate descriptor sets!\n");
-	for (int i = 0; i < swap_chain_images_count; ++i)
-	{
-		VkDescriptorBufferInfo buffer_info{};
-		buffer_info.offset = 0;
-		buffer_info.buffer = uniform_buffers.at(i);
-		buffer_info.range = sizeof(Uniform_buffer_object);
-		VkDescriptorImageInfo img_info{};
-		img_info.sampler = texture_sampler;
-		img_info.imageView = texture_img_view;
-		img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
-		descriptor_writes.at(0).sType = descriptor_writes.at(1).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_writes.at(0).descriptorCount = descriptor_writes.at(1).descriptorCount = 1;
-		descriptor_writes.at(0).dstSet = descriptor_writes.at(1).dstSet = descriptor_sets.at(i);
-		descriptor_writes.at(0).dstArrayElement = descriptor_writes.at(1).dstArrayElement = 0;
-		descriptor_writes.at(0).dstBinding = 0;
-		descriptor_writes.at(1).dstBinding = 1;
-		descriptor_writes.at(0).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptor_writes.at(1).descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptor_writes.at(0).pBufferInfo = &buffer_info;
-		descriptor_writes.at(1).pImageInfo = &img_info;
-
-		vkUpdateDescriptorSets(dev->get_device(), static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
-	}
+	VkDescriptorImageInfo img_info{};
+	img_info.sampler = texture_sampler;
+	img_info.imageView = texture_img_view;
+	img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet descriptor_write{};
+	descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptor_write.descriptorCount = 1;
+	descriptor_write.dstSet = descriptor_set;
+	descriptor_write.dstArrayElement = 0;
+	descriptor_write.dstBinding = 0;
+	descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptor_write.pImageInfo = &img_info;
+	vkUpdateDescriptorSets(dev->get_device(), 1, &descriptor_write, 0, nullptr);
 }
 void Model::create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags flags, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem, uint32_t mip_levels, VkSampleCountFlagBits num_samples)
 {
@@ -354,6 +768,11 @@ void Model::create_image(uint32_t width, uint32_t height, VkFormat format, VkIma
 	img_info.usage = flags;
 	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	img_info.samples = num_samples;
+	if (resource_pool)
+	{
+		resource_pool->create_image(img_info, properties, img, mem);
+		return;
+	}
 	if (vkCreateImage(dev->get_device(), &img_info, nullptr, &img) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create texture image!\n");
 	VkMemoryRequirements mem_req{};
@@ -384,12 +803,12 @@ VkImageView Model::create_image_view(VkImage image, VkFormat format, VkImageAspe
 	return img_view;
 }
 
-VkCommandBuffer Model::begin_single_time_commands()
+VkCommandBuffer Model::begin_upload_commands()
 {
 	VkCommandBufferAllocateInfo alloc_info{};
 	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	alloc_info.commandBufferCount = 1;
-	alloc_info.commandPool = command_pool;
+	alloc_info.commandPool = dev->has_transfer_queue() ? dev->get_transfer_command_pool() : command_pool;
 	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
 	VkCommandBuffer command_buffer;
@@ -402,79 +821,86 @@ VkCommandBuffer Model::begin_single_time_commands()
 	return command_buffer;
 }
 
-void Model::end_single_time_commands(VkCommandBuffer command_buffer)
+uint64_t Model::end_upload_commands(VkCommandBuffer command_buffer, std::vector<VkBufferMemoryBarrier> buffer_barriers,
+	std::vector<VkImageMemoryBarrier> image_barriers, VkPipelineStageFlags dst_stage, std::function<void(VkCommandBuffer)> after)
 {
+	//Nothing here waits on the CPU, the returned value of the upload timeline tells when the data can be used
+	if (!dev->has_transfer_queue())
+	{
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr,
+			static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(), static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+		if (after)
+			after(command_buffer);
+		vkEndCommandBuffer(command_buffer);
+		upload_value = dev->submit_upload(graphics_queue, command_buffer, command_pool);
+		return upload_value;
+	}
+	//Release half of the queue family ownership transfer, recorded on the transfer queue
+	for (auto& barrier : buffer_barriers)
+	{
+		barrier.srcQueueFamilyIndex = dev->get_transfer_family();
+		barrier.dstQueueFamilyIndex = dev->get_graphics_family();
+	}
+	for (auto& barrier : image_barriers)
+	{
+		barrier.srcQueueFamilyIndex = dev->get_transfer_family();
+		barrier.dstQueueFamilyIndex = dev->get_graphics_family();
+	}
+	std::vector<VkBufferMemoryBarrier> release_buffers = buffer_barriers;
+	std::vector<VkImageMemoryBarrier> release_images = image_barriers;
+	for (auto& barrier : release_buffers)
+		barrier.dstAccessMask = 0;
+	for (auto& barrier : release_images)
+		barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+		static_cast<uint32_t>(release_buffers.size()), release_buffers.data(), static_cast<uint32_t>(release_images.size()), release_images.data());
 	vkEndCommandBuffer(command_buffer);
-	VkSubmitInfo submit_info{};
-	submit_info.commandBufferCount = 1;
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pCommandBuffers = &command_buffer;
-	vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-	vkDeviceWaitIdle(dev->get_device());
-	vkFreeCommandBuffers(dev->get_device(), command_pool, 1, &command_buffer);
+	upload_value = dev->submit_upload(dev->get_transfer_queue(), command_buffer, dev->get_transfer_command_pool());
+
+	//Acquire half, the engine records it into the first frame that starts after the copy has completed
+	for (auto& barrier : buffer_barriers)
+		barrier.srcAccessMask = 0;
+	for (auto& barrier : image_barriers)
+		barrier.srcAccessMask = 0;
+	dev->queue_acquire({ upload_value, std::move(buffer_barriers), std::move(image_barriers), dst_stage, std::move(after) });
+	return upload_value;
 }
 
-void Model::transition_image_layout(VkImage img, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels)
+void Model::release_staging(const uint64_t upload, VkBuffer buffer, VkDeviceMemory memory)
 {
-	auto command_buffer = begin_single_time_commands();
+	//The copy may still be running, the staging buffer goes once the upload timeline passes it
+	VkDevice device = dev->get_device();
+	dev->retire_upload(upload, [=]() {
+		vkDestroyBuffer(device, buffer, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+	});
+}
 
+VkImageMemoryBarrier Model::texture_barrier(VkImageLayout old_layout, VkImageLayout new_layout, VkAccessFlags src_access, VkAccessFlags dst_access)
+{
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = img;
+	barrier.image = texture_img;
 	barrier.oldLayout = old_layout;
 	barrier.newLayout = new_layout;
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
 	barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		if (has_stencil_component(format))
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-	}
-	else
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.levelCount = mip_levels;
-	barrier.subresourceRange.baseArrayLayer = barrier.subresourceRange.baseMipLevel = 0;
-	VkPipelineStageFlags source_stage{}, destination_stage{};
-	if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
-		source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	}
-	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destination_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	}
-	else
-		throw std::runtime_error("Unsupported layout transition!\n");
-
-	vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-
-	end_single_time_commands(command_buffer);
+	barrier.subresourceRange.layerCount = 1;
+	return barrier;
 }
 
 void Model::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
 {
+	//Staging buffers are host visible and stay outside the pool
+	if (resource_pool && properties == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+	{
+		resource_pool->create_buffer(size, usage, properties, buffer, memory);
+		return;
+	}
 	VkBufferCreateInfo buffer_info{};
 	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	buffer_info.usage = usage;
@@ -493,36 +919,44 @@ void Model::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
 	vkBindBufferMemory(dev->get_device(), buffer, memory, 0);
 }
 
-void Model::copy_buffer_to_img(VkBuffer buffer, VkImage img, uint32_t width, uint32_t height)
+void Model::copy_buffer_to_img(VkCommandBuffer command_buffer, VkBuffer buffer, VkImage img, const std::vector<Mip_level>& levels)
 {
-	auto command_buffer = begin_single_time_commands();
-
-	VkBufferImageCopy img_cpy{};
-	img_cpy.bufferOffset = img_cpy.bufferRowLength = img_cpy.bufferImageHeight = 0;
-	img_cpy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	img_cpy.imageSubresource.layerCount = 1;
-	img_cpy.imageSubresource.baseArrayLayer = img_cpy.imageSubresource.mipLevel = 0;
-	img_cpy.imageOffset = { 0, 0, 0 };
-	img_cpy.imageExtent = { width, height, 1 };
-	vkCmdCopyBufferToImage(command_buffer, buffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &img_cpy);
-	end_single_time_commands(command_buffer);
+	std::vector<VkBufferImageCopy> regions(levels.size());
+	for (uint32_t i = 0; i < levels.size(); ++i)
+	{
+		VkBufferImageCopy& img_cpy = regions.at(i);
+		img_cpy.bufferOffset = levels.at(i).offset;
+		img_cpy.bufferRowLength = img_cpy.bufferImageHeight = 0;
+		img_cpy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		img_cpy.imageSubresource.layerCount = 1;
+		img_cpy.imageSubresource.baseArrayLayer = 0;
+		img_cpy.imageSubresource.mipLevel = i;
+		img_cpy.imageOffset = { 0, 0, 0 };
+		img_cpy.imageExtent = { levels.at(i).width, levels.at(i).height, 1 };
+	}
+	vkCmdCopyBufferToImage(command_buffer, buffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
 }
 
-void Model::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+uint64_t Model::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage)
 {
-	auto command_buffer = begin_single_time_commands();
+	auto command_buffer = begin_upload_commands();
 	VkBufferCopy buffer_region{};
 	buffer_region.size = size;
 	buffer_region.srcOffset = buffer_region.dstOffset = 0;
 	vkCmdCopyBuffer(command_buffer, src, dst, 1, &buffer_region);
-	end_single_time_commands(command_buffer);
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dst_access;
+	barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dst;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	return end_upload_commands(command_buffer, { barrier }, {}, dst_stage);
 }
 
-void Model::generate_mipmaps(VkImage img, VkFormat format, int32_t width, int32_t height, uint32_t mip_levels)
+void Model::generate_mipmaps(VkCommandBuffer command_buffer, VkImage img, int32_t width, int32_t height, uint32_t mip_levels)
 {
-	if (!(dev->get_format_properties(format).optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
-		throw std::runtime_error("Texture image format doesn't support linear blitting!\n");
-	VkCommandBuffer command_buffer = begin_single_time_commands();
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.image = img;
@@ -562,7 +996,7 @@ void Model::generate_mipmaps(VkImage img, VkFormat format, int32_t width, int32_
 		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 		if (mip_width > 1) { mip_width /= 2; }
-		if (mip_height > 2) { mip_height /= 2; }
+		if (mip_height > 1) { mip_height /= 2; }
 	}
 	barrier.subresourceRange.baseMipLevel = mip_levels - 1;
 	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -571,8 +1005,6 @@ void Model::generate_mipmaps(VkImage img, VkFormat format, int32_t width, int32_
 	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	end_single_time_commands(command_buffer);
 }
 
 uint32_t Model::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags prop)
@@ -588,90 +1020,85 @@ uint32_t Model::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags pro
 	throw std::runtime_error("Failed to find suitable memory type!\n");
 }
 
-bool Model::has_stencil_component(VkFormat format)
-{
-	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-}
-
-Model::Model(const std::string& model_path, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) :
-	MODEL_PATH(model_path), swap_chain_images_count(swap_chain_images), command_pool(c_pool), graphics_queue(g_queue), descriptor_set_layout(d_layout), dev(vd)
+Model::Model(const std::string& model_path, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) :
+	mesh_path(model_path), frames_in_flight(frame_count), command_pool(c_pool), graphics_queue(g_queue), descriptor_set_layout(d_layout), dev(vd)
 {
 	texture_path = R"(src\tex\checker.jpg)";
 	position = glm::vec3(0.0f);
 	model_mat = glm::mat4(1.0f);
 }
 
-Model::Model(const std::string& model_path, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Model::Model(const std::string& model_path, const std::string& tex_path, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	texture_path = tex_path;
 }
 
-Model::Model(const std::string& model_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Model::Model(const std::string& model_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	position = glm::vec3(x, y, z);
 	model_mat = glm::translate(model_mat, position);
 }
 
-Model::Model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, tex_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Model::Model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(model_path, tex_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	position = glm::vec3(x, y, z);
 	model_mat = glm::translate(model_mat, position);
 }
 
-Plane::Plane(const float width, const float height, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", swap_chain_images, c_pool, g_queue, d_layout, vd)
+Plane::Plane(const float width, const float height, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, 1.0, height);
 }
 
-Plane::Plane(const float width, const float height, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", tex_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Plane::Plane(const float width, const float height, const std::string& tex_path, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", tex_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, 1.0, height);
 }
 
-Plane::Plane(const float width, const float height, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Plane::Plane(const float width, const float height, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, 1.0, height);
 }
 
-Plane::Plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", tex_path, x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Plane::Plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\plane.obj)", tex_path, x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, 1.0, height);
 }
-Box::Box(const float width, const float height, const float depth, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", swap_chain_images, c_pool, g_queue, d_layout, vd)
+Box::Box(const float width, const float height, const float depth, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, height, depth);
 }
 
-Box::Box(const float width, const float height, const float depth, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", tex_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Box::Box(const float width, const float height, const float depth, const std::string& tex_path, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", tex_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, height, depth);
 }
 
-Box::Box(const float width, const float height, const float depth, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Box::Box(const float width, const float height, const float depth, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, height, depth);
 }
 
-Box::Box(const float width, const float height, const float depth, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", tex_path, x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Box::Box(const float width, const float height, const float depth, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\box.obj)", tex_path, x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(width, height, depth);
 }
-Sphere::Sphere(const float radious, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", swap_chain_images, c_pool, g_queue, d_layout, vd)
+Sphere::Sphere(const float radious, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(radious);
 }
 
-Sphere::Sphere(const float radious, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", tex_path, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Sphere::Sphere(const float radious, const std::string& tex_path, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", tex_path, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(radious);
 }
 
-Sphere::Sphere(const float radious, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Sphere::Sphere(const float radious, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(radious);
 }
 
-Sphere::Sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", tex_path, x, y, z, swap_chain_images, c_pool, g_queue, d_layout, vd)
+Sphere::Sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool, VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd) : Model(R"(src\models\sphere.obj)", tex_path, x, y, z, frame_count, c_pool, g_queue, d_layout, vd)
 {
 	scale(radious);
 }
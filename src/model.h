@@ -8,6 +8,9 @@
 #include <unordered_map>
 #include <array>
 #include <memory>
+#include <future>
+#include <functional>
+#include <limits>
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtx/hash.hpp"
@@ -15,82 +18,98 @@
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 #include "VulkanDevice.h"
+#include "mip_builder.h"
+#include "settings.h"
+#include "vertex_layout.h"
+#include "mesh_optimizer.h"
+#include "mesh_cache.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+#include "resource_pool.h"
 
 
-struct Vertex
+//Part of the index buffer drawn with one vkCmdDrawIndexed, indices are relative to vertex_offset
+struct Draw_range
 {
-	glm::vec3 pos;
-	glm::vec3 colour;
-	glm::vec2 tex_cord;
-	static VkVertexInputBindingDescription get_binding_description()
-	{
-		VkVertexInputBindingDescription binding_description{};
-		binding_description.binding = 0;
-		binding_description.stride = sizeof(Vertex);
-		binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		return binding_description;
-	}
-	static std::array<VkVertexInputAttributeDescription, 3> get_attribute_descriptions()
-	{
-		std::array<VkVertexInputAttributeDescription, 3> attribute_descriptions{};
-		attribute_descriptions.at(0).binding = attribute_descriptions.at(0).location = attribute_descriptions.at(1).binding = attribute_descriptions.at(2).binding = 0;
-		attribute_descriptions.at(0).format = VK_FORMAT_R32G32B32_SFLOAT;
-		attribute_descriptions.at(0).offset = offsetof(Vertex, pos);
-		attribute_descriptions.at(1).location = 1;
-		attribute_descriptions.at(1).format = VK_FORMAT_R32G32B32_SFLOAT;
-		attribute_descriptions.at(1).offset = offsetof(Vertex, colour);
-		attribute_descriptions.at(2).location = 2;
-		attribute_descriptions.at(2).format = VK_FORMAT_R32G32_SFLOAT;
-		attribute_descriptions.at(2).offset = offsetof(Vertex, tex_cord);
-
-		return attribute_descriptions;
-	}
-	bool operator==(const Vertex& other) const {
-		return pos == other.pos && colour == other.colour && tex_cord == other.tex_cord;
-	}
+	uint32_t first_index;
+	uint32_t index_count;
+	int32_t vertex_offset;
 };
-namespace std 
-{
-	template<> struct hash<Vertex> {
-		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.colour) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.tex_cord) << 1);
-		}
-	};
-}
-struct Uniform_buffer_object
+
+//Draw ranges of one detail level, error is in object space units
+struct Lod_level
 {
-	alignas(16) glm::mat4 model;
-	alignas(16) glm::mat4 view;
-	alignas(16) glm::mat4 proj;
+	std::vector<Draw_range> ranges;
+	float error;
+	uint32_t first_meshlet;
+	uint32_t meshlet_count;
 };
 
-
 class Model
 {
 	//Variables
-	const std::string MODEL_PATH;
+	std::string mesh_path;
 	std::string texture_path;
 	glm::mat4 model_mat;
 	uint32_t mip_levels;
+	Mip_generation mip_generation = Mip_generation::automatic;
+	Mip_filter mip_filter = Mip_filter::box;
+	Vertex_layout vertex_layout;
+	glm::mat4 position_transform = glm::mat4(1.0f);
+	glm::vec4 uv_transform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	glm::vec4 constant_colour = glm::vec4(1.0f);
+	bool has_colour = false;
+	bool optimize_mesh = true;
+	bool use_mesh_cache = true;
+	uint32_t lod_count = 1;
+	Mesh_stats mesh_stats;
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indicies;
-	int swap_chain_images_count;
+	std::vector<Mesh_lod> mesh_lods;
+	std::vector<Lod_level> lods;
+	uint32_t current_lod = 0;
+	glm::vec3 bounds_centre = glm::vec3(0.0f);
+	float bounds_radius = 0.0f;
+	Meshlet_culling meshlet_culling = Meshlet_culling::off;
+	uint32_t meshlet_min_triangles = 0;
+	std::vector<Meshlet> meshlets;
+	std::vector<Draw_range> visible_ranges;
+	Cull_view cull_view{};
+	VkBuffer meshlet_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory meshlet_mem = VK_NULL_HANDLE;
+	//Commands for every meshlet of every level, one copy per frame in flight
+	VkBuffer indirect_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory indirect_mem = VK_NULL_HANDLE;
+	VkDescriptorPool cull_descriptor_pool = VK_NULL_HANDLE;
+	VkDescriptorSet cull_descriptor_set = VK_NULL_HANDLE;
+	VkDescriptorSetLayout cull_set_layout = VK_NULL_HANDLE;
+	VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+	//Decoded texture waiting between prepare and create_resources
+	Mip_chain texture_chain;
+	//Upload timeline value of the last copy, nothing of the model may be used before it has completed
+	uint64_t upload_value = 0;
+	int frames_in_flight;
+	//Texture files hold sRGB encoded colour, the format makes sampling return linear values
+	static constexpr VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
 	VkImage texture_img;
 	VkImageView texture_img_view;
 	VkDeviceMemory texture_mem;
 	VkBuffer vertex_buffer;
 	VkSampler texture_sampler;
 	VkDeviceMemory vertex_memory;
+	//Positions alone for the depth pre-pass, so it fetches a fraction of the vertex data
+	VkBuffer position_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory position_memory = VK_NULL_HANDLE;
 	VkBuffer index_buffer;
 	VkDeviceMemory index_mem;
-	std::vector<VkBuffer>uniform_buffers;
-	std::vector<VkDeviceMemory>uniform_mem;
-	std::vector<VkDescriptorSet> descriptor_sets;
+	//Material set, the texture only. Per-draw data is pushed, so one set serves every frame in flight
+	VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
 	//std::vector<VkCommandBuffer> command_buffers;
 	glm::vec3 position;
-	bool rotate_model = false;
 	//Pointers
 	std::shared_ptr<VulkanDevice> dev;
+	//Device local buffers and the texture come from the pool when one is set
+	std::shared_ptr<Resource_pool> resource_pool;
 	VkDescriptorPool descriptor_pool;
 	VkCommandPool command_pool;
 	VkQueue graphics_queue;
@@ -98,13 +117,20 @@ class Model
 
 	//Methods
 	//void create_device()
-	void create_texture_image();
+	Mip_chain load_texture();
+	bool use_cpu_mipmaps();
+	void create_texture_image(const Mip_chain& chain);
 	void create_texture_image_view();
 	void create_texture_sampler();
 	void load_model();
+	void parse_model();
+	void compute_bounds();
+	void build_submeshes();
+	void build_meshlets();
+	void create_meshlet_buffer();
+	void create_cull_resources();
 	void create_vertex_buffer();
 	void create_index_buffer();
-	void create_uniform_buffer();
 	void create_descriptor_pool();
 	void create_descriptor_sets();
 	void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
@@ -113,35 +139,68 @@ class Model
 	void create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
 			VkImageUsageFlags flags, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem, uint32_t mip_levels, VkSampleCountFlagBits num_samples);
 	VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels);
-	VkCommandBuffer begin_single_time_commands();
-	void end_single_time_commands(VkCommandBuffer command_buffer);
-	void transition_image_layout(VkImage img, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels);
-	void copy_buffer_to_img(VkBuffer buffer, VkImage img, uint32_t width, uint32_t height);
-	void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
-	void generate_mipmaps(VkImage img, VkFormat format, int32_t width, int32_t height, uint32_t mip_levels);
+	VkCommandBuffer begin_upload_commands();
+	//Returns the value of the upload timeline the copy signals, after runs on the graphics queue once the data is there
+	uint64_t end_upload_commands(VkCommandBuffer command_buffer, std::vector<VkBufferMemoryBarrier> buffer_barriers,
+		std::vector<VkImageMemoryBarrier> image_barriers, VkPipelineStageFlags dst_stage, std::function<void(VkCommandBuffer)> after = nullptr);
+	void release_staging(const uint64_t upload, VkBuffer buffer, VkDeviceMemory memory);
+	VkImageMemoryBarrier texture_barrier(VkImageLayout old_layout, VkImageLayout new_layout, VkAccessFlags src_access, VkAccessFlags dst_access);
+	void copy_buffer_to_img(VkCommandBuffer command_buffer, VkBuffer buffer, VkImage img, const std::vector<Mip_level>& levels);
+	uint64_t copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+	static void generate_mipmaps(VkCommandBuffer command_buffer, VkImage img, int32_t width, int32_t height, uint32_t mip_levels);
 	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags prop);
-	bool has_stencil_component(VkFormat format);
 public:
 	//Constructors and destructor
-	Model(const std::string& model_path, const int swap_chain_images, VkCommandPool c_pool, 
+	Model(const std::string& model_path, const int frame_count, VkCommandPool c_pool, 
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);	
-	Model(const std::string& model_path, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool,
+	Model(const std::string& model_path, const std::string& tex_path, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Model(const std::string& model_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Model(const std::string& model_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Model(const std::string& model_path, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
 	//Public methods
 	void translate(const float x, const float y, const float z);
 	void scale(const float amount);
 	void scale(const float scale_x, const float scale_y, const float scale_z);
 	void assign_texture(const std::string& tex_path);
+	void assign_mesh(const std::string& path);
 	void rotate(const float x, const float y, const float z);
-	void switch_animated_rotation();
+	void set_mip_generation(Mip_generation generation, Mip_filter filter);
+	void set_frames_in_flight(const int count);
+	void set_vertex_layout(const Vertex_layout& layout);
+	void set_mesh_processing(const bool optimize, const bool use_cache, const uint32_t levels);
+	void set_resource_pool(std::shared_ptr<Resource_pool> pool);
+	//Bytes of pooled device local memory held by the mesh, meshlet, indirect and texture resources
+	VkDeviceSize get_memory_size() const;
+	//Returns whether the selected level changed
+	bool select_lod(const glm::mat4& world, const glm::vec3& camera_position, const float pixels_per_unit, const float threshold, const float hysteresis);
+	glm::vec3 get_bounds_centre() const;
+	float get_bounds_radius() const;
+	uint32_t get_lod() const;
+	uint32_t get_lod_count() const;
+	void set_meshlet_culling(Meshlet_culling mode, const uint32_t min_triangles, VkDescriptorSetLayout layout);
+	bool has_meshlets() const;
+	bool uses_gpu_culling() const;
+	void cull_meshlets(const Cull_view& view);
+	Cull_constants get_cull_constants(const uint32_t frame) const;
+	uint32_t get_meshlet_count() const;
+	VkDeviceSize get_indirect_offset(const uint32_t frame) const;
+	VkBuffer get_meshlet_buffer() const;
+	VkDeviceMemory get_meshlet_memory() const;
+	VkBuffer get_indirect_buffer() const;
+	VkDeviceMemory get_indirect_memory() const;
+	VkDescriptorPool get_cull_descriptor_pool() const;
+	VkDescriptorSet get_cull_descriptor_set() const;
+	Mesh_stats get_mesh_stats() const;
+	uint64_t get_upload_value() const;
+	//prepare followed by create_resources
 	void init_model();
+	//Loads and processes the mesh and texture on the CPU only, so it may run on a worker thread
+	void prepare();
+	//Creates the Vulkan resources and records their uploads, on the thread that owns the device
+	void create_resources();
 	glm::vec3 get_position() const;
-	bool get_animation_state() const;
-	VkDeviceMemory get_uniform_buffer_memory(uint32_t index) const;
 	VkDeviceMemory get_vertex_buffer_memory() const;
 	VkDeviceMemory get_index_buffer_memory() const;
 	VkDeviceMemory get_texture_memory() const;
@@ -149,49 +208,57 @@ public:
 	VkImageView get_texture_img_view() const;
 	VkSampler get_texture_sampler() const;
 	VkBuffer get_vertex_buffer() const;
+	VkBuffer get_position_buffer() const;
 	VkBuffer get_index_buffer() const;
-	std::vector<VkBuffer> get_uniform_buffers() const;
 	VkDescriptorPool get_descriptor_pool() const;
-	std::vector<VkDescriptorSet> get_descriptor_sets() const;
+	VkDescriptorSet get_descriptor_set() const;
 	uint32_t get_indicies_size() const;
+	const std::vector<Draw_range>& get_submeshes() const;
+	//Whole selected level, meshlet culling against the camera doesn't apply to other views such as the light's
+	const std::vector<Draw_range>& get_lod_ranges() const;
+	VkIndexType get_index_type() const;
 	void set_position(const float x, const float y, const float z);
 	glm::mat4 get_model_matrix() const;
-	void recreate_swap_chain_elements();
+	glm::mat4 get_position_transform() const;
+	glm::vec4 get_uv_transform() const;
+	glm::vec4 get_constant_colour() const;
+	bool has_vertex_colour() const;
+	void recreate_frame_resources();
 };
 class Plane : public Model
 {
 public:
-	Plane(const float width, const float height, const int swap_chain_images, VkCommandPool c_pool,
+	Plane(const float width, const float height, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Plane(const float width, const float height, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool,
+	Plane(const float width, const float height, const std::string& tex_path, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Plane(const float width, const float height, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Plane(const float width, const float height, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Plane(const float width, const float height, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
 };
 class Box : public Model
 {
 public:
-	Box(const float width, const float height, const float depth, const int swap_chain_images, VkCommandPool c_pool,
+	Box(const float width, const float height, const float depth, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Box(const float width, const float height, const float depth, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool,
+	Box(const float width, const float height, const float depth, const std::string& tex_path, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Box(const float width, const float height, const float depth, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Box(const float width, const float height, const float depth, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Box(const float width, const float height, const float depth, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Box(const float width, const float height, const float depth, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
 };
 class Sphere : public Model
 {
 public:
-	Sphere(const float radious, const int swap_chain_images, VkCommandPool c_pool,
+	Sphere(const float radious, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Sphere(const float radious, const std::string& tex_path, const int swap_chain_images, VkCommandPool c_pool,
+	Sphere(const float radious, const std::string& tex_path, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Sphere(const float radious, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Sphere(const float radious, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
-	Sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z, const int swap_chain_images, VkCommandPool c_pool,
+	Sphere(const float radious, const std::string& tex_path, const float x, const float y, const float z, const int frame_count, VkCommandPool c_pool,
 		VkQueue g_queue, VkDescriptorSetLayout d_layout, std::shared_ptr<VulkanDevice> vd);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,509 @@
+#include "occlusion_culler.h"
+#include "shader.h"
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+Occlusion_culler::Occlusion_culler(std::shared_ptr<VulkanDevice> device, const uint32_t frames_in_flight) : dev(device)
+{
+	create_pipelines();
+	create_frames(frames_in_flight);
+}
+
+Occlusion_culler::~Occlusion_culler()
+{
+	destroy();
+}
+
+void Occlusion_culler::create_pipelines()
+{
+	VkDevice device = dev->get_device();
+	std::array<VkDescriptorSetLayoutBinding, 4> test_bindings{};
+	for (uint32_t i = 0; i < test_bindings.size(); ++i)
+	{
+		test_bindings.at(i).binding = i;
+		test_bindings.at(i).descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		test_bindings.at(i).descriptorCount = 1;
+		test_bindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo set_layout_info{};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = static_cast<uint32_t>(test_bindings.size());
+	set_layout_info.pBindings = test_bindings.data();
+	if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &test_set_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create occlusion descriptor set layout!\n");
+
+	std::array<VkDescriptorSetLayoutBinding, 2> pyramid_bindings{};
+	for (uint32_t i = 0; i < pyramid_bindings.size(); ++i)
+	{
+		pyramid_bindings.at(i).binding = i;
+		pyramid_bindings.at(i).descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		pyramid_bindings.at(i).descriptorCount = 1;
+		pyramid_bindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	set_layout_info.bindingCount = static_cast<uint32_t>(pyramid_bindings.size());
+	set_layout_info.pBindings = pyramid_bindings.data();
+	if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &pyramid_set_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!\n");
+
+	VkPushConstantRange push_range{};
+	push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_range.size = sizeof(Occlusion_constants);
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &test_set_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_range;
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &test_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create occlusion pipeline layout!\n");
+	push_range.size = sizeof(Pyramid_constants);
+	layout_info.pSetLayouts = &pyramid_set_layout;
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &pyramid_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout!\n");
+
+	test_pipeline = create_compute_pipeline(R"(src\occlusion_cull.spv)", test_layout);
+	pyramid_pipeline = create_compute_pipeline(R"(src\hzb_build.spv)", pyramid_layout);
+	pyramid_ms_pipeline = create_compute_pipeline(R"(src\hzb_build_ms.spv)", pyramid_layout);
+
+	//Texels are fetched directly, the sampler only has to cover every level
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = sampler_info.addressModeV = sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+	if (vkCreateSampler(device, &sampler_info, nullptr, &sampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid sampler!\n");
+}
+
+VkPipeline Occlusion_culler::create_compute_pipeline(const std::string& path, VkPipelineLayout layout)
+{
+	Shader compute_shader(path, dev->get_device());
+	VkShaderModule compute_module = compute_shader.create_shader_module();
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = compute_module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = layout;
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(dev->get_device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create occlusion culling pipeline!\n");
+	vkDestroyShaderModule(dev->get_device(), compute_module, nullptr);
+	return pipeline;
+}
+
+void Occlusion_culler::create_frames(const uint32_t count)
+{
+	frames.assign(count, Frame{});
+	std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+	pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes.at(0).descriptorCount = 3 * count;
+	pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes.at(1).descriptorCount = count;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = count;
+	if (vkCreateDescriptorPool(dev->get_device(), &pool_info, nullptr, &test_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create occlusion descriptor pool!\n");
+	std::vector<VkDescriptorSetLayout> layouts(count, test_set_layout);
+	std::vector<VkDescriptorSet> sets(count);
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = test_pool;
+	alloc_info.descriptorSetCount = count;
+	alloc_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(dev->get_device(), &alloc_info, sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate occlusion descriptor sets!\n");
+	for (uint32_t i = 0; i < count; ++i)
+		frames.at(i).descriptor_set = sets.at(i);
+}
+
+void Occlusion_culler::destroy_frames()
+{
+	VkDevice device = dev->get_device();
+	for (auto& frame : frames)
+	{
+		vkDestroyBuffer(device, frame.objects, nullptr);
+		vkFreeMemory(device, frame.objects_mem, nullptr);
+		vkDestroyBuffer(device, frame.commands, nullptr);
+		vkFreeMemory(device, frame.commands_mem, nullptr);
+	}
+	frames.clear();
+	vkDestroyDescriptorPool(device, test_pool, nullptr);
+	test_pool = VK_NULL_HANDLE;
+}
+
+void Occlusion_culler::set_frames_in_flight(const uint32_t count)
+{
+	destroy_frames();
+	create_frames(count);
+}
+
+void Occlusion_culler::create_pyramid(VkImageView depth_view, VkSampleCountFlagBits samples, VkExtent2D extent)
+{
+	destroy_pyramid();
+	VkDevice device = dev->get_device();
+	depth_samples = samples;
+	VkExtent2D size = { std::max(1u, (extent.width + 1) / 2), std::max(1u, (extent.height + 1) / 2) };
+	uint32_t level_count = 1;
+	while ((std::max(size.width, size.height) >> level_count) > 0)
+		++level_count;
+
+	VkImageCreateInfo img_info{};
+	img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	img_info.imageType = VK_IMAGE_TYPE_2D;
+	img_info.format = VK_FORMAT_R32_SFLOAT;
+	img_info.extent = { size.width, size.height, 1 };
+	img_info.mipLevels = level_count;
+	img_info.arrayLayers = 1;
+	img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	img_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (vkCreateImage(device, &img_info, nullptr, &pyramid) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetImageMemoryRequirements(device, pyramid, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (vkAllocateMemory(device, &malloc_info, nullptr, &pyramid_mem) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate depth pyramid memory!\n");
+	vkBindImageMemory(device, pyramid, pyramid_mem, 0);
+
+	VkImageViewCreateInfo view_info{};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = pyramid;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = VK_FORMAT_R32_SFLOAT;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_info.subresourceRange.levelCount = level_count;
+	view_info.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(device, &view_info, nullptr, &pyramid_view) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid view!\n");
+	level_views.resize(level_count);
+	view_info.subresourceRange.levelCount = 1;
+	for (uint32_t i = 0; i < level_count; ++i)
+	{
+		view_info.subresourceRange.baseMipLevel = i;
+		if (vkCreateImageView(device, &view_info, nullptr, &level_views.at(i)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create depth pyramid view!\n");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+	pool_sizes.at(0).type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes.at(1).type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes.at(0).descriptorCount = pool_sizes.at(1).descriptorCount = level_count;
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = level_count;
+	if (vkCreateDescriptorPool(device, &pool_info, nullptr, &pyramid_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid descriptor pool!\n");
+	std::vector<VkDescriptorSetLayout> layouts(level_count, pyramid_set_layout);
+	level_sets.resize(level_count);
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = pyramid_pool;
+	alloc_info.descriptorSetCount = level_count;
+	alloc_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(device, &alloc_info, level_sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!\n");
+	//Each level reduces the one above it, the first one the depth buffer
+	for (uint32_t i = 0; i < level_count; ++i)
+	{
+		VkDescriptorImageInfo source_info{}, destination_info{};
+		source_info.sampler = sampler;
+		source_info.imageView = i == 0 ? depth_view : level_views.at(i - 1);
+		source_info.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		destination_info.imageView = level_views.at(i);
+		destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		for (uint32_t w = 0; w < writes.size(); ++w)
+		{
+			writes.at(w).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes.at(w).dstSet = level_sets.at(i);
+			writes.at(w).dstBinding = w;
+			writes.at(w).descriptorCount = 1;
+		}
+		writes.at(0).descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes.at(0).pImageInfo = &source_info;
+		writes.at(1).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes.at(1).pImageInfo = &destination_info;
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+	++generation;
+}
+
+void Occlusion_culler::destroy_pyramid()
+{
+	VkDevice device = dev->get_device();
+	vkDestroyDescriptorPool(device, pyramid_pool, nullptr);
+	for (const auto& view : level_views)
+		vkDestroyImageView(device, view, nullptr);
+	vkDestroyImageView(device, pyramid_view, nullptr);
+	vkDestroyImage(device, pyramid, nullptr);
+	vkFreeMemory(device, pyramid_mem, nullptr);
+	pyramid_pool = VK_NULL_HANDLE;
+	level_views.clear();
+	level_sets.clear();
+	pyramid_view = VK_NULL_HANDLE;
+	pyramid = VK_NULL_HANDLE;
+	pyramid_mem = VK_NULL_HANDLE;
+}
+
+void Occlusion_culler::reserve_slots(const uint32_t count, Deletion_queue& deletion_queue, const uint64_t frame)
+{
+	if (count <= visibility_capacity)
+		return;
+	VkDevice device = dev->get_device();
+	VkBuffer old_buffer = visibility;
+	VkDeviceMemory old_memory = visibility_mem;
+	deletion_queue.push(frame, [=]() {
+		vkDestroyBuffer(device, old_buffer, nullptr);
+		vkFreeMemory(device, old_memory, nullptr);
+	});
+	visibility_capacity = std::max(count, 2 * visibility_capacity);
+	create_buffer(sizeof(uint32_t) * visibility_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibility, visibility_mem);
+	//Everything starts hidden, so the late test decides about all objects in the first frame
+	clear_visibility = true;
+	++generation;
+}
+
+void Occlusion_culler::begin_frame()
+{
+	pending_objects.clear();
+	pending_commands.clear();
+}
+
+uint32_t Occlusion_culler::add_object(const glm::vec3& centre, const float radius, const uint32_t slot, const std::vector<Draw_range>& ranges)
+{
+	uint32_t first_command = static_cast<uint32_t>(pending_commands.size());
+	pending_objects.push_back({ glm::vec4(centre, radius), first_command, static_cast<uint32_t>(ranges.size()), slot, 0 });
+	for (const auto& range : ranges)
+		pending_commands.push_back({ range.index_count, 0, range.first_index, range.vertex_offset, 0 });
+	return first_command;
+}
+
+void Occlusion_culler::upload(Frame& frame)
+{
+	//The slot's previous frame has completed, so its buffers can be replaced right away
+	VkDevice device = dev->get_device();
+	const VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (pending_objects.size() > frame.object_capacity)
+	{
+		vkDestroyBuffer(device, frame.objects, nullptr);
+		vkFreeMemory(device, frame.objects_mem, nullptr);
+		frame.object_capacity = std::max(static_cast<uint32_t>(pending_objects.size()), 2 * frame.object_capacity);
+		create_buffer(sizeof(Occlusion_object) * frame.object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host_memory, frame.objects, frame.objects_mem);
+		vkMapMemory(device, frame.objects_mem, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&frame.object_data));
+		frame.written_generation = UINT64_MAX;
+	}
+	if (pending_commands.size() > frame.command_capacity)
+	{
+		vkDestroyBuffer(device, frame.commands, nullptr);
+		vkFreeMemory(device, frame.commands_mem, nullptr);
+		frame.command_capacity = std::max(static_cast<uint32_t>(pending_commands.size()), 2 * frame.command_capacity);
+		create_buffer(2 * sizeof(VkDrawIndexedIndirectCommand) * frame.command_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			host_memory, frame.commands, frame.commands_mem);
+		vkMapMemory(device, frame.commands_mem, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&frame.command_data));
+		frame.written_generation = UINT64_MAX;
+	}
+	std::memcpy(frame.object_data, pending_objects.data(), sizeof(Occlusion_object) * pending_objects.size());
+	std::memcpy(frame.command_data, pending_commands.data(), sizeof(VkDrawIndexedIndirectCommand) * pending_commands.size());
+	std::memcpy(frame.command_data + pending_commands.size(), pending_commands.data(), sizeof(VkDrawIndexedIndirectCommand) * pending_commands.size());
+	frame.object_count = static_cast<uint32_t>(pending_objects.size());
+	frame.command_count = static_cast<uint32_t>(pending_commands.size());
+}
+
+void Occlusion_culler::write_descriptor_set(Frame& frame)
+{
+	std::array<VkDescriptorBufferInfo, 3> buffer_infos{};
+	buffer_infos.at(0).buffer = frame.objects;
+	buffer_infos.at(1).buffer = frame.commands;
+	buffer_infos.at(2).buffer = visibility;
+	for (auto& info : buffer_infos)
+		info.range = VK_WHOLE_SIZE;
+	VkDescriptorImageInfo pyramid_info{};
+	pyramid_info.sampler = sampler;
+	pyramid_info.imageView = pyramid_view;
+	pyramid_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	std::array<VkWriteDescriptorSet, 4> writes{};
+	for (uint32_t i = 0; i < writes.size(); ++i)
+	{
+		writes.at(i).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes.at(i).dstSet = frame.descriptor_set;
+		writes.at(i).dstBinding = i;
+		writes.at(i).descriptorCount = 1;
+		writes.at(i).descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		if (i < 3)
+			writes.at(i).pBufferInfo = &buffer_infos.at(i);
+		else
+			writes.at(i).pImageInfo = &pyramid_info;
+	}
+	vkUpdateDescriptorSets(dev->get_device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	frame.written_generation = generation;
+}
+
+void Occlusion_culler::record_early(VkCommandBuffer command_buffer, const uint32_t frame)
+{
+	Frame& current = frames.at(frame);
+	current.object_count = current.command_count = 0;
+	if (pending_objects.empty() || visibility == VK_NULL_HANDLE || pyramid == VK_NULL_HANDLE)
+		return;
+	upload(current);
+	if (current.written_generation != generation)
+		write_descriptor_set(current);
+	if (clear_visibility)
+		vkCmdFillBuffer(command_buffer, visibility, 0, VK_WHOLE_SIZE, 0);
+	clear_visibility = false;
+	//Visibility comes from the late test of the previous frame or the clear
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	Occlusion_constants constants{};
+	constants.object_count = current.object_count;
+	constants.late_offset = current.command_count;
+	constants.phase = 0;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, test_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, test_layout, 0, 1, &current.descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, test_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer, (current.object_count + 63) / 64, 1, 1);
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Occlusion_culler::record_late(VkCommandBuffer command_buffer, const uint32_t frame, const glm::mat4& view_projection, VkExtent2D render_extent)
+{
+	const Frame& current = frames.at(frame);
+	if (current.object_count == 0)
+		return;
+	//The whole pyramid is rebuilt, its old contents are dropped once the previous frame's test is done reading them
+	VkImageMemoryBarrier pyramid_barrier{};
+	pyramid_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	pyramid_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	pyramid_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramid_barrier.srcQueueFamilyIndex = pyramid_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramid_barrier.image = pyramid;
+	pyramid_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(level_views.size()), 0, 1 };
+	pyramid_barrier.srcAccessMask = 0;
+	pyramid_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &pyramid_barrier);
+
+	//Only the rendered area is reduced, so texels past it never hold stale depth
+	Pyramid_constants pyramid_constants{};
+	pyramid_constants.source_size = glm::ivec2(render_extent.width, render_extent.height);
+	pyramid_constants.samples = static_cast<int32_t>(depth_samples);
+	VkPipeline bound = VK_NULL_HANDLE;
+	for (uint32_t level = 0; level < level_views.size(); ++level)
+	{
+		pyramid_constants.destination_size = glm::max((pyramid_constants.source_size + 1) / 2, glm::ivec2(1));
+		VkPipeline pipeline = level == 0 && depth_samples != VK_SAMPLE_COUNT_1_BIT ? pyramid_ms_pipeline : pyramid_pipeline;
+		if (pipeline != bound)
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bound = pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_layout, 0, 1, &level_sets.at(level), 0, nullptr);
+		vkCmdPushConstants(command_buffer, pyramid_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pyramid_constants), &pyramid_constants);
+		vkCmdDispatch(command_buffer, (pyramid_constants.destination_size.x + 7) / 8, (pyramid_constants.destination_size.y + 7) / 8, 1);
+		pyramid_barrier.oldLayout = pyramid_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		pyramid_barrier.subresourceRange.baseMipLevel = level;
+		pyramid_barrier.subresourceRange.levelCount = 1;
+		pyramid_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		pyramid_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &pyramid_barrier);
+		pyramid_constants.source_size = pyramid_constants.destination_size;
+	}
+
+	Occlusion_constants constants{};
+	constants.view_projection = view_projection;
+	constants.viewport = glm::vec2(render_extent.width, render_extent.height);
+	constants.object_count = current.object_count;
+	constants.late_offset = current.command_count;
+	constants.level_count = static_cast<uint32_t>(level_views.size());
+	constants.phase = 1;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, test_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, test_layout, 0, 1, &current.descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, test_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer, (current.object_count + 63) / 64, 1, 1);
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkBuffer Occlusion_culler::get_command_buffer(const uint32_t frame) const
+{
+	return frames.at(frame).commands;
+}
+
+VkDeviceSize Occlusion_culler::get_command_offset(const uint32_t frame, Occlusion_phase phase, const uint32_t command) const
+{
+	uint32_t index = phase == Occlusion_phase::late ? frames.at(frame).command_count + command : command;
+	return sizeof(VkDrawIndexedIndirectCommand) * index;
+}
+
+void Occlusion_culler::destroy()
+{
+	if (test_set_layout == VK_NULL_HANDLE)
+		return;
+	VkDevice device = dev->get_device();
+	destroy_frames();
+	destroy_pyramid();
+	vkDestroyBuffer(device, visibility, nullptr);
+	vkFreeMemory(device, visibility_mem, nullptr);
+	vkDestroyPipeline(device, test_pipeline, nullptr);
+	vkDestroyPipeline(device, pyramid_pipeline, nullptr);
+	vkDestroyPipeline(device, pyramid_ms_pipeline, nullptr);
+	vkDestroyPipelineLayout(device, test_layout, nullptr);
+	vkDestroyPipelineLayout(device, pyramid_layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, test_set_layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, pyramid_set_layout, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+	test_set_layout = VK_NULL_HANDLE;
+}
+
+void Occlusion_culler::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.usage = usage;
+	buffer_info.size = size;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(dev->get_device(), &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create occlusion culling buffer!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetBufferMemoryRequirements(dev->get_device(), buffer, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, properties);
+	if (vkAllocateMemory(dev->get_device(), &malloc_info, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate occlusion culling memory!\n");
+	vkBindBufferMemory(dev->get_device(), buffer, memory, 0);
+}
+
+uint32_t Occlusion_culler::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties mem_prop = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i)
+	{
+		if (type_filter & (1 << i) &&
+			((mem_prop.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!\n");
+}
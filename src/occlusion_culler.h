@@ -0,0 +1,129 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+#include "VulkanDevice.h"
+#include "deletion_queue.h"
+#include "model.h"
+
+//all draws everything in one pass. With occlusion culling the early pass draws what was visible last frame
+//and the late pass what the depth of the early pass shows to be newly visible
+enum class Occlusion_phase { all, early, late };
+
+//Bounding sphere in world space and the draw commands of one tested object, matches the std430 struct
+//read by occlusion_cull.comp
+struct Occlusion_object
+{
+	glm::vec4 sphere;
+	uint32_t first_command;
+	uint32_t command_count;
+	//Stable across frames, indexes the visibility the late test leaves for the next frame
+	uint32_t slot;
+	uint32_t padding;
+};
+
+//Push constants of the occlusion test, viewport is the rendered area in pixels
+struct Occlusion_constants
+{
+	glm::mat4 view_projection;
+	glm::vec2 viewport;
+	uint32_t object_count;
+	uint32_t late_offset;
+	uint32_t level_count;
+	uint32_t phase;
+};
+
+//Push constants of one reduction step of the depth pyramid
+struct Pyramid_constants
+{
+	glm::ivec2 source_size;
+	glm::ivec2 destination_size;
+	int32_t samples;
+};
+
+//Two phase occlusion culling against a hierarchical depth buffer. Every object gets two sets of indirect
+//commands: the early test enables the first set for objects visible last frame, which are drawn first. A max
+//depth pyramid is then reduced from their depth and the late test projects each object's bounds onto it, enables
+//the second set for objects that became visible and records the result for the next frame. Objects coming out
+//from behind an occluder are drawn in the same frame, so nothing pops in late
+class Occlusion_culler
+{
+	struct Frame
+	{
+		VkBuffer objects = VK_NULL_HANDLE;
+		VkDeviceMemory objects_mem = VK_NULL_HANDLE;
+		Occlusion_object* object_data = nullptr;
+		uint32_t object_capacity = 0;
+		VkBuffer commands = VK_NULL_HANDLE;
+		VkDeviceMemory commands_mem = VK_NULL_HANDLE;
+		VkDrawIndexedIndirectCommand* command_data = nullptr;
+		uint32_t command_capacity = 0;
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+		//Resources the set was last written with, a frame's own buffers growing resets it
+		uint64_t written_generation = UINT64_MAX;
+		uint32_t object_count = 0;
+		//The late commands follow the early ones
+		uint32_t command_count = 0;
+	};
+	std::shared_ptr<VulkanDevice> dev;
+	std::vector<Frame> frames;
+	//Filled on the CPU between begin_frame and record_early, then copied into the frame's buffers
+	std::vector<Occlusion_object> pending_objects;
+	std::vector<VkDrawIndexedIndirectCommand> pending_commands;
+	//One entry per slot, written by the late test and read by both tests of the next frame
+	VkBuffer visibility = VK_NULL_HANDLE;
+	VkDeviceMemory visibility_mem = VK_NULL_HANDLE;
+	uint32_t visibility_capacity = 0;
+	bool clear_visibility = false;
+	//Bumped whenever the visibility buffer or the pyramid is replaced
+	uint64_t generation = 0;
+	VkDescriptorSetLayout test_set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout test_layout = VK_NULL_HANDLE;
+	VkPipeline test_pipeline = VK_NULL_HANDLE;
+	VkDescriptorPool test_pool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout pyramid_set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout pyramid_layout = VK_NULL_HANDLE;
+	//The first level reads the depth buffer, multisampled depth needs its own variant
+	VkPipeline pyramid_pipeline = VK_NULL_HANDLE;
+	VkPipeline pyramid_ms_pipeline = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	//Pyramid, level 0 has half the size of the depth buffer
+	VkImage pyramid = VK_NULL_HANDLE;
+	VkDeviceMemory pyramid_mem = VK_NULL_HANDLE;
+	VkImageView pyramid_view = VK_NULL_HANDLE;
+	std::vector<VkImageView> level_views;
+	VkDescriptorPool pyramid_pool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> level_sets;
+	VkSampleCountFlagBits depth_samples = VK_SAMPLE_COUNT_1_BIT;
+	void create_pipelines();
+	VkPipeline create_compute_pipeline(const std::string& path, VkPipelineLayout layout);
+	void create_frames(const uint32_t count);
+	void destroy_frames();
+	void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	void upload(Frame& frame);
+	void write_descriptor_set(Frame& frame);
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+public:
+	Occlusion_culler(std::shared_ptr<VulkanDevice> device, const uint32_t frames_in_flight);
+	~Occlusion_culler();
+	void set_frames_in_flight(const uint32_t count);
+	//Rebuilt with the render graph, which owns the depth buffer
+	void create_pyramid(VkImageView depth_view, VkSampleCountFlagBits samples, VkExtent2D extent);
+	void destroy_pyramid();
+	//Slots index the visibility, the old buffer is kept until the submitted frames are done with it
+	void reserve_slots(const uint32_t count, Deletion_queue& deletion_queue, const uint64_t frame);
+	//Objects are added in draw order after begin_frame, their commands follow each other. Returns the first one
+	void begin_frame();
+	uint32_t add_object(const glm::vec3& centre, const float radius, const uint32_t slot, const std::vector<Draw_range>& ranges);
+	void record_early(VkCommandBuffer command_buffer, const uint32_t frame);
+	//Builds the pyramid from the depth of the early pass, which has to be readable by compute shaders
+	void record_late(VkCommandBuffer command_buffer, const uint32_t frame, const glm::mat4& view_projection, VkExtent2D render_extent);
+	VkBuffer get_command_buffer(const uint32_t frame) const;
+	VkDeviceSize get_command_offset(const uint32_t frame, Occlusion_phase phase, const uint32_t command) const;
+	void destroy();
+};
+#endif // !OCCLUSION_CULLER_H
@@ -0,0 +1,780 @@
+#include "render_graph.h"
+
+namespace
+{
+	bool is_attachment(Graph_access access)
+	{
+		return access == Graph_access::colour_attachment || access == Graph_access::resolve_attachment || access == Graph_access::depth_attachment
+			|| access == Graph_access::depth_read || access == Graph_access::input_attachment;
+	}
+	//Attachments that aren't cleared load what earlier passes wrote, resolves overwrite every pixel
+	bool reads_contents(const Render_graph::Use& use)
+	{
+		if (use.access == Graph_access::colour_attachment || use.access == Graph_access::depth_attachment)
+			return !use.clear.has_value();
+		return use.access != Graph_access::resolve_attachment && use.access != Graph_access::storage_write && use.access != Graph_access::transfer_write;
+	}
+	VkImageUsageFlags get_usage(Graph_access access)
+	{
+		switch (access)
+		{
+		case Graph_access::colour_attachment:
+		case Graph_access::resolve_attachment:
+			return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case Graph_access::depth_attachment:
+		case Graph_access::depth_read:
+			return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case Graph_access::input_attachment:
+			return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		case Graph_access::sampled:
+			return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case Graph_access::transfer_read:
+			return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		case Graph_access::transfer_write:
+			return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		default:
+			return VK_IMAGE_USAGE_STORAGE_BIT;
+		}
+	}
+	bool has_stencil(VkFormat format)
+	{
+		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
+	}
+	VkImageAspectFlags get_aspect(VkFormat format)
+	{
+		if (!Render_graph::is_depth_format(format))
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		return has_stencil(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+}
+
+Render_graph::Render_graph(std::shared_ptr<VulkanDevice> device, const bool merge_subpasses) : dev(device), merge_subpasses(merge_subpasses)
+{
+}
+
+Render_graph::~Render_graph()
+{
+	destroy();
+}
+
+uint32_t Render_graph::create_image(const std::string& name, const Image_desc& desc)
+{
+	Resource resource{};
+	resource.name = name;
+	resource.desc = desc;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t Render_graph::import_image(const std::string& name, const Image_desc& desc, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+	const Resource_state& initial, std::optional<VkImageLayout> final_layout)
+{
+	if (images.empty() || images.size() != views.size())
+		throw std::runtime_error("Imported image " + name + " needs one view per image!\n");
+	Resource resource{};
+	resource.name = name;
+	resource.desc = desc;
+	resource.imported = true;
+	resource.images = images;
+	resource.views = views;
+	resource.initial = initial;
+	resource.final_layout = final_layout;
+	resource.output = final_layout.has_value();
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+void Render_graph::update_import(const uint32_t resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views)
+{
+	Resource& imported = resources.at(resource);
+	if (!imported.imported || images.empty() || images.size() != views.size())
+		throw std::runtime_error("Only imported images can be updated, with one view per image!\n");
+	imported.images = images;
+	imported.views = views;
+	for (auto& group : groups)
+		if (std::find(group.attachments.begin(), group.attachments.end(), resource) != group.attachments.end())
+		{
+			for (const auto& framebuffer : group.framebuffers)
+				vkDestroyFramebuffer(dev->get_device(), framebuffer, nullptr);
+			create_framebuffers(group);
+		}
+}
+
+void Render_graph::set_output(const uint32_t resource)
+{
+	resources.at(resource).output = true;
+}
+
+uint32_t Render_graph::add_pass(const std::string& name, Pass_type type, Execute execute)
+{
+	if (compiled)
+		throw std::runtime_error("Passes can't be added to a compiled render graph!\n");
+	Pass pass{};
+	pass.name = name;
+	pass.type = type;
+	pass.execute = std::move(execute);
+	passes.push_back(std::move(pass));
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void Render_graph::use(const uint32_t pass, const uint32_t resource, Graph_access access)
+{
+	if (resource >= resources.size())
+		throw std::runtime_error("Pass " + passes.at(pass).name + " uses an unknown image!\n");
+	if (passes.at(pass).type == Pass_type::compute && is_attachment(access))
+		throw std::runtime_error("Compute pass " + passes.at(pass).name + " can't use attachments!\n");
+	if (passes.at(pass).type == Pass_type::graphics && (access == Graph_access::transfer_read || access == Graph_access::transfer_write))
+		throw std::runtime_error("Graphics pass " + passes.at(pass).name + " can't copy inside a render pass!\n");
+	passes.at(pass).uses.push_back({ resource, access, std::nullopt });
+}
+
+void Render_graph::use(const uint32_t pass, const uint32_t resource, Graph_access access, VkClearValue clear)
+{
+	use(pass, resource, access);
+	passes.at(pass).uses.back().clear = clear;
+}
+
+void Render_graph::set_side_effects(const uint32_t pass)
+{
+	passes.at(pass).side_effects = true;
+}
+
+void Render_graph::set_render_area(const uint32_t pass, VkExtent2D extent)
+{
+	passes.at(pass).render_area = extent;
+}
+
+void Render_graph::compile()
+{
+	//Walking backwards, a pass is kept when it writes something still needed. A write that doesn't read the old
+	//contents ends the need for earlier versions of the image
+	std::vector<bool> needed(resources.size(), false);
+	for (uint32_t i = 0; i < resources.size(); ++i)
+		needed.at(i) = resources.at(i).output;
+	for (uint32_t p = static_cast<uint32_t>(passes.size()); p-- > 0;)
+	{
+		Pass& pass = passes.at(p);
+		pass.culled = !pass.side_effects && std::none_of(pass.uses.begin(), pass.uses.end(), [&](const Use& use) {
+			return is_write(use.access) && needed.at(use.resource);
+		});
+		if (pass.culled)
+			continue;
+		for (const auto& use : pass.uses)
+			if (is_write(use.access) && !reads_contents(use))
+				needed.at(use.resource) = false;
+		for (const auto& use : pass.uses)
+			if (reads_contents(use))
+				needed.at(use.resource) = true;
+	}
+
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		Pass& pass = passes.at(p);
+		if (pass.culled)
+			continue;
+		for (const auto& use : pass.uses)
+		{
+			Resource& resource = resources.at(use.resource);
+			resource.usage |= get_usage(use.access);
+			resource.first_use = std::min(resource.first_use, p);
+			resource.last_use = std::max(resource.last_use, p);
+			resource.last_state = get_state(use.access, pass.type);
+		}
+		if (pass.type == Pass_type::graphics && !groups.empty() && merge_subpasses && can_merge(groups.back(), p))
+		{
+			pass.subpass = static_cast<uint32_t>(groups.back().passes.size());
+			pass.group = static_cast<uint32_t>(groups.size() - 1);
+			groups.back().passes.push_back(p);
+		}
+		else
+		{
+			pass.group = static_cast<uint32_t>(groups.size());
+			Group group{};
+			group.passes.push_back(p);
+			groups.push_back(group);
+		}
+		if (pass.type == Pass_type::compute)
+			continue;
+		Group& group = groups.back();
+		for (const auto& use : pass.uses)
+		{
+			if (!is_attachment(use.access))
+				continue;
+			auto it = std::find(group.attachments.begin(), group.attachments.end(), use.resource);
+			if (it == group.attachments.end())
+			{
+				group.attachments.push_back(use.resource);
+				group.clear_values.push_back(use.clear.value_or(VkClearValue{}));
+			}
+			if (group.extent.width == 0)
+				group.extent = resources.at(use.resource).desc.extent;
+		}
+		if (group.extent.width == 0)
+			throw std::runtime_error("Graphics pass " + pass.name + " has no attachments!\n");
+	}
+	//Contents only have to reach memory when a later render pass or the outside world reads them
+	for (const auto& group : groups)
+		for (const auto& attachment : group.attachments)
+		{
+			Resource& resource = resources.at(attachment);
+			if (resource.imported || resource.output || resource.last_use > group.passes.back())
+				resource.stored = true;
+		}
+	plan_barriers();
+	compiled = true;
+}
+
+bool Render_graph::can_merge(const Group& group, const uint32_t pass) const
+{
+	const Pass& first = passes.at(group.passes.front());
+	const Pass& next = passes.at(pass);
+	if (first.type != Pass_type::graphics || first.render_area.has_value() != next.render_area.has_value())
+		return false;
+	if (first.render_area && (first.render_area->width != next.render_area->width || first.render_area->height != next.render_area->height))
+		return false;
+	//Images of the group can only be handed on as attachments, sampling them needs the whole image finished
+	for (const auto& use : next.uses)
+	{
+		const Image_desc& desc = resources.at(use.resource).desc;
+		if (is_attachment(use.access) && (desc.extent.width != group.extent.width || desc.extent.height != group.extent.height))
+			return false;
+		bool in_group = std::find(group.attachments.begin(), group.attachments.end(), use.resource) != group.attachments.end();
+		if (in_group && !is_attachment(use.access))
+			return false;
+		for (const auto& member : group.passes)
+			for (const auto& other : passes.at(member).uses)
+				if (other.resource == use.resource && !is_attachment(other.access))
+					return false;
+	}
+	return true;
+}
+
+void Render_graph::plan_barriers()
+{
+	//Transient images start every frame undefined, the predecessor in their memory is filled in by realize()
+	std::vector<std::optional<Resource_state>> states(resources.size());
+	for (uint32_t i = 0; i < resources.size(); ++i)
+		if (resources.at(i).imported)
+			states.at(i) = resources.at(i).initial;
+	for (auto& group : groups)
+	{
+		group.barriers.clear();
+		std::vector<uint32_t> seen;
+		for (const auto& p : group.passes)
+		{
+			const Pass& pass = passes.at(p);
+			for (const auto& use : pass.uses)
+			{
+				if (std::find(seen.begin(), seen.end(), use.resource) != seen.end())
+					continue;
+				seen.push_back(use.resource);
+				Resource_state dst = get_state(use.access, pass.type);
+				std::optional<Resource_state>& current = states.at(use.resource);
+				if (!current)
+				{
+					group.barriers.push_back({ use.resource, { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0 }, dst });
+					continue;
+				}
+				Resource_state src = *current;
+				if (!reads_contents(use))
+					src.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				bool hazard = (src.access & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT
+					| VK_ACCESS_TRANSFER_WRITE_BIT))
+					|| is_write(use.access);
+				if (src.layout != dst.layout || hazard)
+					group.barriers.push_back({ use.resource, src, dst });
+			}
+		}
+		//The state after the group is the one of the last pass in it that used the image
+		for (const auto& p : group.passes)
+			for (const auto& use : passes.at(p).uses)
+				states.at(use.resource) = get_state(use.access, passes.at(p).type);
+	}
+	final_barriers.clear();
+	for (uint32_t i = 0; i < resources.size(); ++i)
+	{
+		const Resource& resource = resources.at(i);
+		if (resource.imported && resource.final_layout && states.at(i) && resource.first_use != UINT32_MAX)
+			final_barriers.push_back({ i, *states.at(i), { *resource.final_layout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0 } });
+	}
+}
+
+std::vector<uint32_t> Render_graph::assign_memory(const std::vector<std::pair<uint32_t, uint32_t>>& lifetimes,
+	const std::vector<VkMemoryRequirements>& requirements, std::vector<Memory_block>& blocks)
+{
+	std::vector<uint32_t> order, assignment(lifetimes.size(), UINT32_MAX);
+	for (uint32_t i = 0; i < lifetimes.size(); ++i)
+		if (lifetimes.at(i).first != UINT32_MAX)
+			order.push_back(i);
+	//Largest first, so smaller images fill the gaps in lifetime of the large blocks
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requirements.at(a).size > requirements.at(b).size; });
+	for (const auto& i : order)
+	{
+		const auto& lifetime = lifetimes.at(i);
+		const VkMemoryRequirements& req = requirements.at(i);
+		uint32_t best = UINT32_MAX;
+		VkDeviceSize best_growth = 0;
+		for (uint32_t b = 0; b < blocks.size(); ++b)
+		{
+			const Memory_block& block = blocks.at(b);
+			if (!(block.type_bits & req.memoryTypeBits))
+				continue;
+			bool overlaps = std::any_of(block.lifetimes.begin(), block.lifetimes.end(), [&](const std::pair<uint32_t, uint32_t>& other) {
+				return lifetime.first <= other.second && other.first <= lifetime.second;
+			});
+			if (overlaps)
+				continue;
+			VkDeviceSize growth = req.size > block.size ? req.size - block.size : 0;
+			if (best == UINT32_MAX || growth < best_growth)
+			{
+				best = b;
+				best_growth = growth;
+			}
+		}
+		if (best == UINT32_MAX)
+		{
+			best = static_cast<uint32_t>(blocks.size());
+			blocks.emplace_back();
+		}
+		Memory_block& block = blocks.at(best);
+		block.size = std::max(block.size, req.size);
+		block.alignment = std::max(block.alignment, req.alignment);
+		block.type_bits &= req.memoryTypeBits;
+		block.lifetimes.push_back(lifetime);
+		assignment.at(i) = best;
+	}
+	return assignment;
+}
+
+void Render_graph::realize()
+{
+	if (!compiled)
+		compile();
+	VkDevice device = dev->get_device();
+	std::vector<std::pair<uint32_t, uint32_t>> lifetimes(resources.size(), { UINT32_MAX, UINT32_MAX });
+	std::vector<VkMemoryRequirements> requirements(resources.size());
+	for (uint32_t i = 0; i < resources.size(); ++i)
+	{
+		Resource& resource = resources.at(i);
+		if (resource.imported || resource.first_use == UINT32_MAX)
+			continue;
+		//Attachments that never leave the render pass may live in tile memory only
+		const VkImageUsageFlags attachment_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		if (!resource.stored && !(resource.usage & ~attachment_usage))
+			resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		VkImageCreateInfo img_info{};
+		img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		img_info.imageType = VK_IMAGE_TYPE_2D;
+		img_info.format = resource.desc.format;
+		img_info.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		img_info.mipLevels = img_info.arrayLayers = 1;
+		img_info.samples = resource.desc.samples;
+		img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		img_info.usage = resource.usage;
+		img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		resource.images.resize(1);
+		if (vkCreateImage(device, &img_info, nullptr, &resource.images.front()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create render graph image " + resource.name + "!\n");
+		vkGetImageMemoryRequirements(device, resource.images.front(), &requirements.at(i));
+		//Lifetimes count render passes, attachments of one render pass are all alive together
+		lifetimes.at(i) = { passes.at(resource.first_use).group, passes.at(resource.last_use).group };
+	}
+	std::vector<uint32_t> assignment = assign_memory(lifetimes, requirements, memory_blocks);
+	memory.resize(memory_blocks.size(), VK_NULL_HANDLE);
+	for (uint32_t b = 0; b < memory_blocks.size(); ++b)
+	{
+		bool lazy = true;
+		for (uint32_t i = 0; i < resources.size(); ++i)
+			if (assignment.at(i) == b && !(resources.at(i).usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT))
+				lazy = false;
+		uint32_t type = lazy ? find_memory_type(memory_blocks.at(b).type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) : UINT32_MAX;
+		if (type == UINT32_MAX)
+			type = find_memory_type(memory_blocks.at(b).type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (type == UINT32_MAX)
+			throw std::runtime_error("Failed to find a memory type for render graph images!\n");
+		VkMemoryAllocateInfo malloc_info{};
+		malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		malloc_info.allocationSize = memory_blocks.at(b).size;
+		malloc_info.memoryTypeIndex = type;
+		if (vkAllocateMemory(device, &malloc_info, nullptr, &memory.at(b)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate render graph memory!\n");
+	}
+	for (uint32_t i = 0; i < resources.size(); ++i)
+	{
+		Resource& resource = resources.at(i);
+		if (assignment.at(i) == UINT32_MAX)
+			continue;
+		resource.memory_block = assignment.at(i);
+		vkBindImageMemory(device, resource.images.front(), memory.at(resource.memory_block), 0);
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = resource.images.front();
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = resource.desc.format;
+		view_info.subresourceRange.aspectMask = get_aspect(resource.desc.format);
+		view_info.subresourceRange.levelCount = view_info.subresourceRange.layerCount = 1;
+		resource.views.resize(1);
+		if (vkCreateImageView(device, &view_info, nullptr, &resource.views.front()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create render graph image view " + resource.name + "!\n");
+	}
+	//First use of a transient image has to wait for the last use of the memory, by the image that had it before
+	//in this frame or, for the first one, by the last image of the previous frame
+	for (auto& group : groups)
+		for (auto& barrier : group.barriers)
+		{
+			const Resource& resource = resources.at(barrier.resource);
+			if (resource.imported || barrier.src.stages != 0)
+				continue;
+			uint32_t start = lifetimes.at(barrier.resource).first, predecessor = UINT32_MAX, last = barrier.resource;
+			for (uint32_t i = 0; i < resources.size(); ++i)
+			{
+				if (resources.at(i).memory_block != resource.memory_block)
+					continue;
+				uint32_t end = lifetimes.at(i).second;
+				if (end < start && (predecessor == UINT32_MAX || end > lifetimes.at(predecessor).second))
+					predecessor = i;
+				if (end > lifetimes.at(last).second)
+					last = i;
+			}
+			if (predecessor == UINT32_MAX)
+				predecessor = last;
+			barrier.src.stages = resources.at(predecessor).last_state.stages;
+			barrier.src.access = resources.at(predecessor).last_state.access;
+		}
+	for (auto& group : groups)
+		if (passes.at(group.passes.front()).type == Pass_type::graphics)
+		{
+			create_render_pass(group);
+			create_framebuffers(group);
+		}
+}
+
+void Render_graph::create_render_pass(Group& group)
+{
+	std::vector<VkAttachmentDescription> attachments;
+	for (const auto& index : group.attachments)
+	{
+		const Resource& resource = resources.at(index);
+		const Use* first = nullptr;
+		Resource_state last{};
+		for (const auto& p : group.passes)
+			for (const auto& use : passes.at(p).uses)
+				if (use.resource == index)
+				{
+					if (!first)
+						first = &use;
+					last = get_state(use.access, Pass_type::graphics);
+				}
+		VkAttachmentDescription attachment{};
+		attachment.format = resource.desc.format;
+		attachment.samples = resource.desc.samples;
+		//Imported images that start undefined, like acquired swap chain images, have nothing worth loading
+		bool written_before = (resource.imported && resource.initial.layout != VK_IMAGE_LAYOUT_UNDEFINED) || resource.first_use < group.passes.front();
+		if (first->clear)
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		else if (written_before && reads_contents(*first))
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		else
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		bool stored = resource.imported || resource.output || resource.last_use > group.passes.back();
+		attachment.storeOp = stored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		//Layouts outside the render pass are changed by the graph's barriers
+		attachment.initialLayout = get_state(first->access, Pass_type::graphics).layout;
+		attachment.finalLayout = last.layout;
+		attachments.push_back(attachment);
+	}
+	auto attachment_index = [&](uint32_t resource) {
+		return static_cast<uint32_t>(std::find(group.attachments.begin(), group.attachments.end(), resource) - group.attachments.begin());
+	};
+	std::vector<std::vector<VkAttachmentReference>> colour_refs(group.passes.size()), resolve_refs(group.passes.size()), input_refs(group.passes.size());
+	std::vector<VkAttachmentReference> depth_refs(group.passes.size());
+	std::vector<VkSubpassDescription> subpasses(group.passes.size());
+	for (uint32_t s = 0; s < group.passes.size(); ++s)
+	{
+		const Pass& pass = passes.at(group.passes.at(s));
+		bool has_depth = false;
+		for (const auto& use : pass.uses)
+		{
+			VkAttachmentReference ref{ attachment_index(use.resource), get_state(use.access, Pass_type::graphics).layout };
+			if (use.access == Graph_access::colour_attachment)
+				colour_refs.at(s).push_back(ref);
+			else if (use.access == Graph_access::resolve_attachment)
+				resolve_refs.at(s).push_back(ref);
+			else if (use.access == Graph_access::input_attachment)
+				input_refs.at(s).push_back(ref);
+			else if (use.access == Graph_access::depth_attachment || use.access == Graph_access::depth_read)
+			{
+				depth_refs.at(s) = ref;
+				has_depth = true;
+			}
+		}
+		if (!resolve_refs.at(s).empty() && resolve_refs.at(s).size() != colour_refs.at(s).size())
+			throw std::runtime_error("Pass " + pass.name + " needs one resolve attachment per colour attachment!\n");
+		VkSubpassDescription& subpass = subpasses.at(s);
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(colour_refs.at(s).size());
+		subpass.pColorAttachments = colour_refs.at(s).data();
+		subpass.pResolveAttachments = resolve_refs.at(s).empty() ? nullptr : resolve_refs.at(s).data();
+		subpass.inputAttachmentCount = static_cast<uint32_t>(input_refs.at(s).size());
+		subpass.pInputAttachments = input_refs.at(s).data();
+		subpass.pDepthStencilAttachment = has_depth ? &depth_refs.at(s) : nullptr;
+	}
+	//Subpasses sharing an attachment are ordered per pixel, which keeps the data in tile memory
+	std::vector<VkSubpassDependency> dependencies;
+	for (uint32_t s = 1; s < group.passes.size(); ++s)
+		for (const auto& use : passes.at(group.passes.at(s)).uses)
+			for (uint32_t earlier = s; earlier-- > 0;)
+			{
+				auto it = std::find_if(passes.at(group.passes.at(earlier)).uses.begin(), passes.at(group.passes.at(earlier)).uses.end(),
+					[&](const Use& other) { return other.resource == use.resource; });
+				if (it == passes.at(group.passes.at(earlier)).uses.end())
+					continue;
+				Resource_state src = get_state(it->access, Pass_type::graphics), dst = get_state(use.access, Pass_type::graphics);
+				auto dependency = std::find_if(dependencies.begin(), dependencies.end(), [&](const VkSubpassDependency& dep) {
+					return dep.srcSubpass == earlier && dep.dstSubpass == s;
+				});
+				if (dependency == dependencies.end())
+				{
+					VkSubpassDependency dep{};
+					dep.srcSubpass = earlier;
+					dep.dstSubpass = s;
+					dep.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+					dependencies.push_back(dep);
+					dependency = dependencies.end() - 1;
+				}
+				dependency->srcStageMask |= src.stages;
+				dependency->srcAccessMask |= src.access;
+				dependency->dstStageMask |= dst.stages;
+				dependency->dstAccessMask |= dst.access;
+				break;
+			}
+	VkRenderPassCreateInfo render_pass_info{};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	render_pass_info.pAttachments = attachments.data();
+	render_pass_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+	render_pass_info.pSubpasses = subpasses.data();
+	render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	render_pass_info.pDependencies = dependencies.data();
+	if (vkCreateRenderPass(dev->get_device(), &render_pass_info, nullptr, &group.render_pass) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create render pass for " + passes.at(group.passes.front()).name + "!\n");
+}
+
+void Render_graph::create_framebuffers(Group& group)
+{
+	size_t variants = 1;
+	for (const auto& attachment : group.attachments)
+		variants = std::max(variants, resources.at(attachment).views.size());
+	group.framebuffers.assign(variants, VK_NULL_HANDLE);
+	for (uint32_t v = 0; v < variants; ++v)
+	{
+		std::vector<VkImageView> views;
+		for (const auto& attachment : group.attachments)
+			views.push_back(get_view(attachment, v));
+		VkFramebufferCreateInfo framebuffer_info{};
+		framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebuffer_info.renderPass = group.render_pass;
+		framebuffer_info.attachmentCount = static_cast<uint32_t>(views.size());
+		framebuffer_info.pAttachments = views.data();
+		framebuffer_info.width = group.extent.width;
+		framebuffer_info.height = group.extent.height;
+		framebuffer_info.layers = 1;
+		if (vkCreateFramebuffer(dev->get_device(), &framebuffer_info, nullptr, &group.framebuffers.at(v)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create framebuffer for " + passes.at(group.passes.front()).name + "!\n");
+	}
+}
+
+void Render_graph::execute(VkCommandBuffer command_buffer, const uint32_t variant) const
+{
+	for (const auto& group : groups)
+	{
+		record_barriers(command_buffer, group.barriers, variant);
+		const Pass& first = passes.at(group.passes.front());
+		if (first.type == Pass_type::compute)
+		{
+			first.execute(command_buffer);
+			continue;
+		}
+		VkRenderPassBeginInfo render_pass_begin{};
+		render_pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_begin.renderPass = group.render_pass;
+		render_pass_begin.framebuffer = group.framebuffers.at(std::min<size_t>(variant, group.framebuffers.size() - 1));
+		render_pass_begin.renderArea.extent = first.render_area.value_or(group.extent);
+		render_pass_begin.clearValueCount = static_cast<uint32_t>(group.clear_values.size());
+		render_pass_begin.pClearValues = group.clear_values.data();
+		vkCmdBeginRenderPass(command_buffer, &render_pass_begin, VK_SUBPASS_CONTENTS_INLINE);
+		for (uint32_t s = 0; s < group.passes.size(); ++s)
+		{
+			if (s > 0)
+				vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+			passes.at(group.passes.at(s)).execute(command_buffer);
+		}
+		vkCmdEndRenderPass(command_buffer);
+	}
+	record_barriers(command_buffer, final_barriers, variant);
+}
+
+void Render_graph::record_barriers(VkCommandBuffer command_buffer, const std::vector<Image_barrier>& barriers, const uint32_t variant) const
+{
+	if (barriers.empty())
+		return;
+	std::vector<VkImageMemoryBarrier> image_barriers;
+	VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+	for (const auto& barrier : barriers)
+	{
+		VkImageMemoryBarrier image_barrier{};
+		image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_barrier.oldLayout = barrier.src.layout;
+		image_barrier.newLayout = barrier.dst.layout;
+		image_barrier.srcAccessMask = barrier.src.access;
+		image_barrier.dstAccessMask = barrier.dst.access;
+		image_barrier.srcQueueFamilyIndex = image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_barrier.image = get_image(barrier.resource, variant);
+		image_barrier.subresourceRange.aspectMask = get_aspect(resources.at(barrier.resource).desc.format);
+		image_barrier.subresourceRange.levelCount = image_barrier.subresourceRange.layerCount = 1;
+		image_barriers.push_back(image_barrier);
+		src_stages |= barrier.src.stages;
+		dst_stages |= barrier.dst.stages;
+	}
+	vkCmdPipelineBarrier(command_buffer, src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stages ? dst_stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+}
+
+void Render_graph::destroy()
+{
+	if (!dev)
+		return;
+	VkDevice device = dev->get_device();
+	for (auto& group : groups)
+	{
+		for (const auto& framebuffer : group.framebuffers)
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		vkDestroyRenderPass(device, group.render_pass, nullptr);
+	}
+	for (auto& resource : resources)
+	{
+		if (resource.imported)
+			continue;
+		for (const auto& view : resource.views)
+			vkDestroyImageView(device, view, nullptr);
+		for (const auto& image : resource.images)
+			vkDestroyImage(device, image, nullptr);
+	}
+	for (const auto& block : memory)
+		vkFreeMemory(device, block, nullptr);
+	resources.clear();
+	passes.clear();
+	groups.clear();
+	final_barriers.clear();
+	memory_blocks.clear();
+	memory.clear();
+	compiled = false;
+}
+
+bool Render_graph::is_culled(const uint32_t pass) const
+{
+	return passes.at(pass).culled;
+}
+
+uint32_t Render_graph::get_group_count() const
+{
+	return static_cast<uint32_t>(groups.size());
+}
+
+const std::vector<Render_graph::Image_barrier>& Render_graph::get_barriers(const uint32_t pass) const
+{
+	return groups.at(passes.at(pass).group).barriers;
+}
+
+VkRenderPass Render_graph::get_render_pass(const uint32_t pass) const
+{
+	if (passes.at(pass).culled)
+		throw std::runtime_error("Pass " + passes.at(pass).name + " was culled from the render graph!\n");
+	return groups.at(passes.at(pass).group).render_pass;
+}
+
+uint32_t Render_graph::get_subpass(const uint32_t pass) const
+{
+	return passes.at(pass).subpass;
+}
+
+VkImageView Render_graph::get_image_view(const uint32_t resource) const
+{
+	return get_view(resource, 0);
+}
+
+VkImage Render_graph::get_image(const uint32_t resource) const
+{
+	return get_image(resource, 0);
+}
+
+size_t Render_graph::get_memory_block_count() const
+{
+	return memory_blocks.size();
+}
+
+VkImageView Render_graph::get_view(const uint32_t resource, const uint32_t variant) const
+{
+	const auto& views = resources.at(resource).views;
+	if (views.empty())
+		throw std::runtime_error("Image " + resources.at(resource).name + " isn't used by any pass!\n");
+	return views.at(std::min<size_t>(variant, views.size() - 1));
+}
+
+VkImage Render_graph::get_image(const uint32_t resource, const uint32_t variant) const
+{
+	const auto& images = resources.at(resource).images;
+	return images.at(std::min<size_t>(variant, images.size() - 1));
+}
+
+uint32_t Render_graph::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties mem_properties = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i)
+		if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	return UINT32_MAX;
+}
+
+Resource_state Render_graph::get_state(Graph_access access, Pass_type type)
+{
+	VkPipelineStageFlags shader_stage = type == Pass_type::compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	const VkPipelineStageFlags depth_stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	switch (access)
+	{
+	case Graph_access::colour_attachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+	case Graph_access::resolve_attachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+	case Graph_access::depth_attachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depth_stages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case Graph_access::depth_read:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, depth_stages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT };
+	case Graph_access::input_attachment:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT };
+	case Graph_access::sampled:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shader_stage, VK_ACCESS_SHADER_READ_BIT };
+	case Graph_access::storage_read:
+		return { VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT };
+	case Graph_access::transfer_read:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+	case Graph_access::transfer_write:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+	default:
+		return { VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+	}
+}
+
+bool Render_graph::is_write(Graph_access access)
+{
+	return access == Graph_access::colour_attachment || access == Graph_access::resolve_attachment
+		|| access == Graph_access::depth_attachment || access == Graph_access::storage_write || access == Graph_access::transfer_write;
+}
+
+bool Render_graph::is_depth_format(VkFormat format)
+{
+	return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT || has_stencil(format);
+}
@@ -0,0 +1,163 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+
+//How a pass touches an image, reads and writes follow from it. Depth attachments are tested and written
+enum class Graph_access { colour_attachment, resolve_attachment, depth_attachment, depth_read, input_attachment, sampled, storage_read, storage_write,
+	transfer_read, transfer_write };
+//Compute passes are recorded outside render passes, which also suits copies and blits
+enum class Pass_type { graphics, compute };
+
+struct Image_desc
+{
+	VkFormat format;
+	VkExtent2D extent;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+//Layout, stages and access an image is in while a pass uses it
+struct Resource_state
+{
+	VkImageLayout layout;
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+};
+
+//Transient memory of one or more images whose lifetimes don't overlap
+struct Memory_block
+{
+	VkDeviceSize size = 0;
+	VkDeviceSize alignment = 1;
+	uint32_t type_bits = ~0u;
+	std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+};
+
+//Passes are declared in execution order together with the images they read and write. compile() drops passes
+//whose results are never used, merges neighbouring graphics passes that only hand attachments to each other into
+//subpasses of one render pass and plans the barriers between passes. realize() creates the transient images, with
+//images of disjoint lifetimes sharing memory, the render passes and the framebuffers. Imported images may have one
+//variant per swap chain image, execute() picks the variant
+class Render_graph
+{
+public:
+	using Execute = std::function<void(VkCommandBuffer)>;
+	struct Use
+	{
+		uint32_t resource;
+		Graph_access access;
+		std::optional<VkClearValue> clear;
+	};
+	struct Image_barrier
+	{
+		uint32_t resource;
+		Resource_state src;
+		Resource_state dst;
+	};
+private:
+	struct Resource
+	{
+		std::string name;
+		Image_desc desc;
+		bool imported = false;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		Resource_state initial{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0 };
+		std::optional<VkImageLayout> final_layout;
+		bool output = false;
+		//Compiled
+		VkImageUsageFlags usage = 0;
+		uint32_t first_use = UINT32_MAX;
+		uint32_t last_use = 0;
+		bool stored = false;
+		Resource_state last_state{};
+		uint32_t memory_block = UINT32_MAX;
+	};
+	struct Pass
+	{
+		std::string name;
+		Pass_type type;
+		std::vector<Use> uses;
+		Execute execute;
+		bool side_effects = false;
+		std::optional<VkExtent2D> render_area;
+		//Compiled
+		bool culled = false;
+		uint32_t group = UINT32_MAX;
+		uint32_t subpass = 0;
+	};
+	struct Group
+	{
+		std::vector<uint32_t> passes;
+		std::vector<Image_barrier> barriers;
+		//Graphics groups only
+		std::vector<uint32_t> attachments;
+		std::vector<VkClearValue> clear_values;
+		VkExtent2D extent{};
+		VkRenderPass render_pass = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> framebuffers;
+	};
+	std::shared_ptr<VulkanDevice> dev;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Group> groups;
+	std::vector<Image_barrier> final_barriers;
+	std::vector<Memory_block> memory_blocks;
+	std::vector<VkDeviceMemory> memory;
+	bool merge_subpasses;
+	bool compiled = false;
+	bool can_merge(const Group& group, const uint32_t pass) const;
+	void plan_barriers();
+	void create_render_pass(Group& group);
+	void create_framebuffers(Group& group);
+	void record_barriers(VkCommandBuffer command_buffer, const std::vector<Image_barrier>& barriers, const uint32_t variant) const;
+	VkImageView get_view(const uint32_t resource, const uint32_t variant) const;
+	VkImage get_image(const uint32_t resource, const uint32_t variant) const;
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+public:
+	static constexpr uint32_t NO_PASS = UINT32_MAX;
+	Render_graph(std::shared_ptr<VulkanDevice> device, const bool merge_subpasses);
+	~Render_graph();
+	uint32_t create_image(const std::string& name, const Image_desc& desc);
+	//Images owned elsewhere, such as the swap chain. Their contents are loaded on first use unless it clears,
+	//the final layout is applied after the last pass, e.g. to present them
+	uint32_t import_image(const std::string& name, const Image_desc& desc, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+		const Resource_state& initial, std::optional<VkImageLayout> final_layout);
+	//Swaps the variants of an imported image, e.g. after the swap chain was recreated with the same extent
+	void update_import(const uint32_t resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+	//Outputs and passes with side effects keep the passes they depend on alive
+	void set_output(const uint32_t resource);
+	uint32_t add_pass(const std::string& name, Pass_type type, Execute execute);
+	//Colour and resolve attachments are bound in the order they are declared, resolve i resolves colour attachment i
+	void use(const uint32_t pass, const uint32_t resource, Graph_access access);
+	void use(const uint32_t pass, const uint32_t resource, Graph_access access, VkClearValue clear);
+	void set_side_effects(const uint32_t pass);
+	//Part of the framebuffer rendered, applies to the render pass the pass was merged into
+	void set_render_area(const uint32_t pass, VkExtent2D extent);
+	void compile();
+	//Memory requirements are indexed by resource, imported ones are ignored. Returns the block of every resource
+	static std::vector<uint32_t> assign_memory(const std::vector<std::pair<uint32_t, uint32_t>>& lifetimes,
+		const std::vector<VkMemoryRequirements>& requirements, std::vector<Memory_block>& blocks);
+	void realize();
+	void execute(VkCommandBuffer command_buffer, const uint32_t variant) const;
+	void destroy();
+	bool is_culled(const uint32_t pass) const;
+	uint32_t get_group_count() const;
+	const std::vector<Image_barrier>& get_barriers(const uint32_t pass) const;
+	VkRenderPass get_render_pass(const uint32_t pass) const;
+	uint32_t get_subpass(const uint32_t pass) const;
+	VkImageView get_image_view(const uint32_t resource) const;
+	VkImage get_image(const uint32_t resource) const;
+	size_t get_memory_block_count() const;
+	static Resource_state get_state(Graph_access access, Pass_type type);
+	static bool is_write(Graph_access access);
+	static bool is_depth_format(VkFormat format);
+};
+#endif // !RENDER_GRAPH_H
@@ -0,0 +1,39 @@
+#include "resolution_controller.h"
+
+Resolution_controller::Resolution_controller(const float target_frame_ms, const float min_scale, const float max_scale) :
+	target_ms(std::max(0.1f, target_frame_ms)), min_scale(0.0f), max_scale(1.0f), scale(1.0f)
+{
+	set_limits(min_scale, max_scale);
+	scale = this->max_scale;
+}
+
+float Resolution_controller::update(const float gpu_ms)
+{
+	if (gpu_ms <= 0.0f)
+		return scale;
+	smoothed_ms = smoothed_ms > 0.0f ? smoothed_ms + (gpu_ms - smoothed_ms) * SMOOTHING : gpu_ms;
+	float ratio = target_ms / smoothed_ms;
+	if (std::abs(ratio - 1.0f) < DEAD_BAND)
+		return scale;
+	float desired = scale * std::sqrt(ratio);
+	scale = std::clamp(desired, std::max(min_scale, scale - MAX_STEP_DOWN), std::min(max_scale, scale + MAX_STEP_UP));
+	return scale = std::clamp(scale, min_scale, max_scale);
+}
+
+void Resolution_controller::set_target(const float target_frame_ms)
+{
+	target_ms = std::max(0.1f, target_frame_ms);
+}
+
+void Resolution_controller::set_limits(const float min, const float max)
+{
+	min_scale = std::clamp(min, 0.1f, 2.0f);
+	max_scale = std::clamp(max, min_scale, 2.0f);
+	scale = std::clamp(scale, min_scale, max_scale);
+}
+
+void Resolution_controller::reset()
+{
+	smoothed_ms = 0.0f;
+	scale = max_scale;
+}
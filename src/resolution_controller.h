@@ -0,0 +1,31 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+#include <algorithm>
+#include <cmath>
+
+//Picks the render scale, a fraction of the output extent per axis, from measured GPU frame times.
+//GPU cost is taken as proportional to the pixel count, so the scale moves with the square root of the time ratio.
+//It drops quickly when over budget and grows back slowly, a dead band around the target keeps it from oscillating
+class Resolution_controller
+{
+	float target_ms;
+	float min_scale;
+	float max_scale;
+	float scale;
+	float smoothed_ms = 0.0f;
+public:
+	static constexpr float SMOOTHING = 0.2f;
+	static constexpr float DEAD_BAND = 0.05f;
+	static constexpr float MAX_STEP_UP = 0.02f;
+	static constexpr float MAX_STEP_DOWN = 0.1f;
+	Resolution_controller(const float target_frame_ms, const float min_scale, const float max_scale);
+	//Feeds the GPU time of a finished frame and returns the scale of the next one
+	float update(const float gpu_ms);
+	void set_target(const float target_frame_ms);
+	void set_limits(const float min_scale, const float max_scale);
+	void reset();
+	inline float get_scale() const { return scale; };
+	inline float get_max_scale() const { return max_scale; };
+	inline float get_gpu_time() const { return smoothed_ms; };
+};
+#endif // !RESOLUTION_CONTROLLER_H
@@ -0,0 +1,190 @@
+#include "resource_pool.h"
+
+Resource_pool::Resource_pool(std::shared_ptr<VulkanDevice> device, const VkDeviceSize capacity) : dev(device), capacity(capacity)
+{
+}
+
+void Resource_pool::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	//Best fit keeps large buffers available for large requests
+	auto best = free_buffers.end();
+	for (auto it = free_buffers.begin(); it != free_buffers.end(); ++it)
+		if (it->usage == usage && it->properties == properties && it->size >= size && it->size <= 2 * size
+			&& (best == free_buffers.end() || it->size < best->size))
+			best = it;
+	Pooled_buffer pooled{};
+	if (best != free_buffers.end())
+	{
+		pooled = *best;
+		free_buffers.erase(best);
+		free_bytes -= pooled.size;
+	}
+	else
+	{
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.usage = usage;
+		buffer_info.size = size;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(dev->get_device(), &buffer_info, nullptr, &pooled.buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create pooled buffer!\n");
+		VkMemoryRequirements mem_req{};
+		vkGetBufferMemoryRequirements(dev->get_device(), pooled.buffer, &mem_req);
+		VkMemoryAllocateInfo malloc_info{};
+		malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		malloc_info.allocationSize = mem_req.size;
+		malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, properties);
+		if (vkAllocateMemory(dev->get_device(), &malloc_info, nullptr, &pooled.memory) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate memory for a pooled buffer!\n");
+		vkBindBufferMemory(dev->get_device(), pooled.buffer, pooled.memory, 0);
+		pooled.size = size;
+		pooled.usage = usage;
+		pooled.properties = properties;
+	}
+	buffer = pooled.buffer;
+	memory = pooled.memory;
+	live_bytes += pooled.size;
+	live_buffers.emplace(buffer, pooled);
+}
+
+void Resource_pool::create_image(const VkImageCreateInfo& info, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem)
+{
+	auto match = std::find_if(free_images.begin(), free_images.end(), [&](const Pooled_image& pooled) {
+		return pooled.properties == properties && pooled.info.format == info.format && pooled.info.usage == info.usage
+			&& pooled.info.tiling == info.tiling && pooled.info.samples == info.samples && pooled.info.mipLevels == info.mipLevels
+			&& pooled.info.arrayLayers == info.arrayLayers && pooled.info.imageType == info.imageType && pooled.info.extent.width == info.extent.width
+			&& pooled.info.extent.height == info.extent.height && pooled.info.extent.depth == info.extent.depth;
+	});
+	Pooled_image pooled{};
+	if (match != free_images.end())
+	{
+		pooled = *match;
+		free_images.erase(match);
+		free_bytes -= pooled.size;
+	}
+	else
+	{
+		if (vkCreateImage(dev->get_device(), &info, nullptr, &pooled.image) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create pooled image!\n");
+		VkMemoryRequirements mem_req{};
+		vkGetImageMemoryRequirements(dev->get_device(), pooled.image, &mem_req);
+		VkMemoryAllocateInfo malloc_info{};
+		malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		malloc_info.allocationSize = mem_req.size;
+		malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, properties);
+		if (vkAllocateMemory(dev->get_device(), &malloc_info, nullptr, &pooled.memory) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate memory for a pooled image!\n");
+		vkBindImageMemory(dev->get_device(), pooled.image, pooled.memory, 0);
+		pooled.size = mem_req.size;
+		pooled.info = info;
+		pooled.info.pNext = nullptr;
+		pooled.info.pQueueFamilyIndices = nullptr;
+		pooled.properties = properties;
+	}
+	img = pooled.image;
+	mem = pooled.memory;
+	live_bytes += pooled.size;
+	live_images.emplace(img, pooled);
+}
+
+void Resource_pool::release_buffer(VkBuffer buffer)
+{
+	auto it = live_buffers.find(buffer);
+	if (it == live_buffers.end())
+		return;
+	live_bytes -= it->second.size;
+	free_bytes += it->second.size;
+	free_buffers.push_back(it->second);
+	live_buffers.erase(it);
+	trim();
+}
+
+void Resource_pool::release_image(VkImage img)
+{
+	auto it = live_images.find(img);
+	if (it == live_images.end())
+		return;
+	live_bytes -= it->second.size;
+	free_bytes += it->second.size;
+	free_images.push_back(it->second);
+	live_images.erase(it);
+	trim();
+}
+
+void Resource_pool::trim()
+{
+	//Both lists are kept in release order, so the front holds the oldest entries
+	while (free_bytes > capacity && !free_buffers.empty())
+	{
+		vkDestroyBuffer(dev->get_device(), free_buffers.front().buffer, nullptr);
+		vkFreeMemory(dev->get_device(), free_buffers.front().memory, nullptr);
+		free_bytes -= free_buffers.front().size;
+		free_buffers.erase(free_buffers.begin());
+	}
+	while (free_bytes > capacity && !free_images.empty())
+	{
+		vkDestroyImage(dev->get_device(), free_images.front().image, nullptr);
+		vkFreeMemory(dev->get_device(), free_images.front().memory, nullptr);
+		free_bytes -= free_images.front().size;
+		free_images.erase(free_images.begin());
+	}
+}
+
+VkDeviceSize Resource_pool::get_buffer_size(VkBuffer buffer) const
+{
+	auto it = live_buffers.find(buffer);
+	return it == live_buffers.end() ? 0 : it->second.size;
+}
+
+VkDeviceSize Resource_pool::get_image_size(VkImage img) const
+{
+	auto it = live_images.find(img);
+	return it == live_images.end() ? 0 : it->second.size;
+}
+
+VkDeviceSize Resource_pool::get_live_bytes() const
+{
+	return live_bytes;
+}
+
+VkDeviceSize Resource_pool::get_free_bytes() const
+{
+	return free_bytes;
+}
+
+void Resource_pool::set_capacity(const VkDeviceSize bytes)
+{
+	capacity = bytes;
+	trim();
+}
+
+void Resource_pool::destroy_all()
+{
+	for (const auto& entry : live_buffers)
+	{
+		vkDestroyBuffer(dev->get_device(), entry.second.buffer, nullptr);
+		vkFreeMemory(dev->get_device(), entry.second.memory, nullptr);
+	}
+	for (const auto& entry : live_images)
+	{
+		vkDestroyImage(dev->get_device(), entry.second.image, nullptr);
+		vkFreeMemory(dev->get_device(), entry.second.memory, nullptr);
+	}
+	live_buffers.clear();
+	live_images.clear();
+	live_bytes = 0;
+	capacity = 0;
+	trim();
+}
+
+uint32_t Resource_pool::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties mem_prop = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i)
+	{
+		if (type_filter & (1 << i) &&
+			((mem_prop.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!\n");
+}
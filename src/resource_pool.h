@@ -0,0 +1,57 @@
+#ifndef RESOURCE_POOL_H
+#define RESOURCE_POOL_H
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+
+//Keeps released buffers and images alive for reuse by later uploads instead of freeing them.
+//Released resources above the capacity are destroyed, oldest first
+class Resource_pool
+{
+	struct Pooled_buffer
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		VkBufferUsageFlags usage;
+		VkMemoryPropertyFlags properties;
+	};
+	struct Pooled_image
+	{
+		VkImage image;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		VkImageCreateInfo info;
+		VkMemoryPropertyFlags properties;
+	};
+	std::shared_ptr<VulkanDevice> dev;
+	std::unordered_map<VkBuffer, Pooled_buffer> live_buffers;
+	std::unordered_map<VkImage, Pooled_image> live_images;
+	std::vector<Pooled_buffer> free_buffers;
+	std::vector<Pooled_image> free_images;
+	VkDeviceSize capacity;
+	VkDeviceSize live_bytes = 0;
+	VkDeviceSize free_bytes = 0;
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
+	void trim();
+public:
+	Resource_pool(std::shared_ptr<VulkanDevice> device, const VkDeviceSize capacity);
+	//A released buffer is reused when usage and properties match and it is at most twice the requested size
+	void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	//Images are only reused with identical creation parameters, their contents are undefined
+	void create_image(const VkImageCreateInfo& info, VkMemoryPropertyFlags properties, VkImage& img, VkDeviceMemory& mem);
+	//The GPU must be done with the resource, null handles are ignored
+	void release_buffer(VkBuffer buffer);
+	void release_image(VkImage img);
+	VkDeviceSize get_buffer_size(VkBuffer buffer) const;
+	VkDeviceSize get_image_size(VkImage img) const;
+	VkDeviceSize get_live_bytes() const;
+	VkDeviceSize get_free_bytes() const;
+	void set_capacity(const VkDeviceSize bytes);
+	void destroy_all();
+};
+#endif // !RESOURCE_POOL_H
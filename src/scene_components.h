@@ -0,0 +1,66 @@
+#ifndef SCENE_COMPONENTS_H
+#define SCENE_COMPONENTS_H
+#include <cstdint>
+#include <memory>
+#include "glm/glm.hpp"
+#include "entity_registry.h"
+#include "slot_map.h"
+
+class Model;
+using Model_handle = Handle<std::unique_ptr<Model>>;
+
+//Node in the transform hierarchy and the world matrix used for the frame, animation included
+struct Transform_component
+{
+	uint32_t node;
+	glm::mat4 world;
+};
+
+//Model holding the geometry buffers of the entity
+struct Mesh_component
+{
+	Model_handle model;
+};
+
+//Index of the graphics pipeline variant the entity is drawn with
+struct Material_component
+{
+	uint32_t pipeline;
+};
+
+//Bounding sphere of the mesh, local in object space and the world one refreshed every frame
+struct Bounds_component
+{
+	glm::vec3 local_centre;
+	float local_radius;
+	glm::vec3 centre;
+	float radius;
+};
+
+//Spin around the local y axis
+struct Animation_component
+{
+	float degrees_per_second;
+};
+
+//Per-draw data pushed with vkCmdPushConstants, 96 of the 128 bytes every device provides
+struct Draw_constants
+{
+	glm::mat4 model;
+	//xy scale and zw offset undoing the UV quantization
+	glm::vec4 uv_transform;
+	glm::vec4 colour;
+};
+
+//Entry of the per-frame draw list, sorted by state and depth
+struct Draw_item
+{
+	uint32_t pipeline;
+	Model_handle model;
+	Draw_constants constants;
+	//First indirect command of the object in the occlusion culler, set only while occlusion culling is on
+	uint32_t first_command;
+};
+
+using Scene_registry = Entity_registry<Transform_component, Mesh_component, Material_component, Bounds_component, Animation_component>;
+#endif // !SCENE_COMPONENTS_H
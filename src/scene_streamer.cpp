@@ -0,0 +1,120 @@
+#include "scene_streamer.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+Scene_streamer::Scene_streamer(const float cell_size, const float load_radius, const float unload_radius, const VkDeviceSize budget, const uint32_t loads_per_update) :
+	cell_size(cell_size), load_radius(load_radius), unload_radius(std::max(load_radius, unload_radius)), budget(budget), loads_per_update(std::max(1u, loads_per_update))
+{
+	if (cell_size <= 0.0f)
+		throw std::runtime_error("Streaming cell size has to be positive!\n");
+}
+
+void Scene_streamer::set_radii(const float load, const float unload)
+{
+	load_radius = load;
+	unload_radius = std::max(load, unload);
+}
+
+void Scene_streamer::set_budget(const VkDeviceSize bytes)
+{
+	budget = bytes;
+}
+
+Cell_key Scene_streamer::get_cell(const glm::vec3& position) const
+{
+	return { static_cast<int32_t>(std::floor(position.x / cell_size)), static_cast<int32_t>(std::floor(position.z / cell_size)) };
+}
+
+float Scene_streamer::distance(const Cell_key& key, const glm::vec3& position) const
+{
+	//Distance to the nearest point of the cell, 0 inside it
+	glm::vec2 min(key.x * cell_size, key.z * cell_size), point(position.x, position.z);
+	glm::vec2 nearest = glm::clamp(point, min, min + glm::vec2(cell_size));
+	return glm::length(point - nearest);
+}
+
+void Scene_streamer::add_object(const Stream_object& object)
+{
+	cells[get_cell(object.position)].objects.push_back(object);
+}
+
+void Scene_streamer::plan(const glm::vec3& camera_position, std::vector<Cell_key>& to_unload, std::vector<Cell_key>& to_load) const
+{
+	to_unload.clear();
+	to_load.clear();
+	std::vector<std::pair<float, Cell_key>> candidates;
+	for (const auto& key : resident_cells)
+		candidates.emplace_back(distance(key, camera_position), key);
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+	VkDeviceSize bytes = resident_bytes;
+	for (const auto& candidate : candidates)
+		if (candidate.first > unload_radius || (bytes > budget && candidate.first > load_radius))
+		{
+			to_unload.push_back(candidate.second);
+			bytes -= cells.at(candidate.second).bytes;
+		}
+	//Only cells overlapping the load radius can be wanted, so the scan is bounded by the radius instead of the world
+	candidates.clear();
+	Cell_key low = get_cell(camera_position - glm::vec3(load_radius)), high = get_cell(camera_position + glm::vec3(load_radius));
+	for (int32_t x = low.x; x <= high.x; ++x)
+		for (int32_t z = low.z; z <= high.z; ++z)
+		{
+			auto it = cells.find({ x, z });
+			if (it == cells.end() || it->second.resident)
+				continue;
+			float cell_distance = distance(it->first, camera_position);
+			if (cell_distance <= load_radius)
+				candidates.emplace_back(cell_distance, it->first);
+		}
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	for (const auto& candidate : candidates)
+	{
+		//A cell that was resident before is known to fit or not, an unseen one is tried while there is room
+		VkDeviceSize cell_bytes = cells.at(candidate.second).bytes;
+		if (to_load.size() == loads_per_update || bytes >= budget || bytes + cell_bytes > budget)
+			break;
+		to_load.push_back(candidate.second);
+		bytes += cell_bytes;
+	}
+}
+
+const std::vector<Stream_object>& Scene_streamer::get_objects(const Cell_key& key) const
+{
+	return cells.at(key).objects;
+}
+
+void Scene_streamer::mark_loaded(const Cell_key& key, const std::vector<Model_handle>& models, const VkDeviceSize bytes)
+{
+	Cell& cell = cells.at(key);
+	if (cell.resident)
+		return;
+	cell.models = models;
+	cell.bytes = bytes;
+	cell.resident = true;
+	resident_bytes += bytes;
+	resident_cells.push_back(key);
+}
+
+std::vector<Model_handle> Scene_streamer::mark_unloaded(const Cell_key& key)
+{
+	Cell& cell = cells.at(key);
+	if (!cell.resident)
+		return {};
+	cell.resident = false;
+	resident_bytes -= cell.bytes;
+	resident_cells.erase(std::find(resident_cells.begin(), resident_cells.end(), key));
+	std::vector<Model_handle> models = std::move(cell.models);
+	cell.models.clear();
+	return models;
+}
+
+VkDeviceSize Scene_streamer::get_resident_bytes() const
+{
+	return resident_bytes;
+}
+
+size_t Scene_streamer::get_resident_cell_count() const
+{
+	return resident_cells.size();
+}
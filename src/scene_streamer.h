@@ -0,0 +1,73 @@
+#ifndef SCENE_STREAMER_H
+#define SCENE_STREAMER_H
+#define GLM_FORCE_RADIANS
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "vulkan/vulkan.h"
+#include "scene_components.h"
+
+//Model placed in the streamed world, an empty texture path uses the default texture
+struct Stream_object
+{
+	std::string model_path;
+	std::string texture_path;
+	glm::vec3 position;
+};
+
+//Square cell of the streaming grid in the xz plane
+struct Cell_key
+{
+	int32_t x;
+	int32_t z;
+	bool operator==(const Cell_key& other) const { return x == other.x && z == other.z; }
+};
+
+struct Cell_key_hash
+{
+	size_t operator()(const Cell_key& key) const
+	{
+		return std::hash<uint64_t>()((static_cast<uint64_t>(static_cast<uint32_t>(key.x)) << 32) | static_cast<uint32_t>(key.z));
+	}
+};
+
+//Decides which world cells should be resident around the camera, the engine performs the loads and unloads.
+//Cells within the load radius are brought in nearest first while the memory budget allows it, cells leave once
+//they are past the unload radius or, farthest first, when the budget is exceeded and they are outside the load radius
+class Scene_streamer
+{
+	struct Cell
+	{
+		std::vector<Stream_object> objects;
+		std::vector<Model_handle> models;
+		//Measured on the last load, 0 until then
+		VkDeviceSize bytes = 0;
+		bool resident = false;
+	};
+	std::unordered_map<Cell_key, Cell, Cell_key_hash> cells;
+	std::vector<Cell_key> resident_cells;
+	float cell_size;
+	float load_radius;
+	float unload_radius;
+	VkDeviceSize budget;
+	uint32_t loads_per_update;
+	VkDeviceSize resident_bytes = 0;
+	float distance(const Cell_key& key, const glm::vec3& position) const;
+public:
+	Scene_streamer(const float cell_size, const float load_radius, const float unload_radius, const VkDeviceSize budget, const uint32_t loads_per_update);
+	void set_radii(const float load, const float unload);
+	void set_budget(const VkDeviceSize bytes);
+	Cell_key get_cell(const glm::vec3& position) const;
+	void add_object(const Stream_object& object);
+	//Unloads are returned farthest first and should be applied before the loads, which are nearest first
+	void plan(const glm::vec3& camera_position, std::vector<Cell_key>& to_unload, std::vector<Cell_key>& to_load) const;
+	const std::vector<Stream_object>& get_objects(const Cell_key& key) const;
+	void mark_loaded(const Cell_key& key, const std::vector<Model_handle>& models, const VkDeviceSize bytes);
+	//Returns the models the cell held so the caller can destroy them
+	std::vector<Model_handle> mark_unloaded(const Cell_key& key);
+	VkDeviceSize get_resident_bytes() const;
+	size_t get_resident_cell_count() const;
+};
+#endif // !SCENE_STREAMER_H
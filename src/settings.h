@@ -0,0 +1,102 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+#include "mip_builder.h"
+#include "vertex_layout.h"
+#include "glm/glm.hpp"
+
+//automatic builds the chain on the CPU only when the texture format can't be blitted with linear filtering
+enum class Mip_generation { automatic, gpu_blit, cpu };
+//gpu falls back to cpu when the graphics queue can't run compute work
+enum class Meshlet_culling { off, cpu, gpu };
+//Post-process anti-aliasing, fxaa costs one fullscreen pass instead of extra samples per pixel
+enum class Anti_aliasing { none, fxaa };
+//Filter used to bring a scaled scene up to the swap chain extent, sharpen adds a contrast-limited unsharp mask
+enum class Upscale_filter { bilinear, sharpen };
+
+struct Engine_settings
+{
+	Mip_generation mip_generation = Mip_generation::automatic;
+	Mip_filter mip_filter = Mip_filter::box;
+	Vertex_layout vertex_layout;
+	//Vertex cache, overdraw and fetch optimization of loaded meshes, results are kept in a .meshcache file
+	bool optimize_meshes = true;
+	bool use_mesh_cache = true;
+	//Simplified levels generated per mesh, including the full one, and the projected error in pixels a level may show
+	uint32_t lod_levels = 4;
+	float lod_error_threshold = 1.0f;
+	//Fraction the error has to drop below the threshold before a coarser level is picked
+	float lod_hysteresis = 0.25f;
+	//Meshes with at least this many triangles are split into meshlets culled by frustum and normal cone
+	Meshlet_culling meshlet_culling = Meshlet_culling::gpu;
+	uint32_t meshlet_min_triangles = 16384;
+	//Bytes of released mesh and texture memory kept for reuse instead of being freed
+	VkDeviceSize recycle_pool_size = 64ull << 20;
+	//Streaming grid in the xz plane, cells within the load radius are loaded while they fit the budget and
+	//dropped past the unload radius
+	float stream_cell_size = 32.0f;
+	float stream_load_radius = 64.0f;
+	float stream_unload_radius = 96.0f;
+	VkDeviceSize stream_budget = 256ull << 20;
+	//Cells loaded at once, each one is read and processed on a worker thread
+	uint32_t stream_concurrent_loads = 1;
+	//Samples per pixel, 1 turns MSAA off, lowered to the highest count the device supports
+	uint32_t msaa_samples = 4;
+	//Shades every sample instead of once per pixel, only takes effect with MSAA
+	bool sample_shading = false;
+	Anti_aliasing anti_aliasing = Anti_aliasing::none;
+	//Lays down depth with a position-only pass first, so the main pass shades each covered sample once. Pays off when
+	//fragments are expensive or overdraw is high, get_gpu_time() shows whether it does for a scene
+	bool depth_prepass = false;
+	//Objects hidden behind the depth of what was visible last frame are skipped, needs compute on the graphics queue.
+	//Meshlets culled on the GPU are always drawn and only serve as occluders
+	bool occlusion_culling = false;
+	//Cascaded shadows of one directional light over the view depth up to shadow_distance. Split lambda blends uniform (0)
+	//and logarithmic (1) splits, the margin is the fraction each cascade is enlarged by so its cached static casters
+	//survive camera movement. Ambient is the part of the colour kept in shadow
+	bool shadows = true;
+	glm::vec3 light_direction = glm::vec3(-0.4f, -1.0f, -0.3f);
+	uint32_t shadow_cascades = 4;
+	uint32_t shadow_map_size = 2048;
+	float shadow_distance = 100.0f;
+	float cascade_split_lambda = 0.75f;
+	float shadow_cache_margin = 0.25f;
+	float shadow_depth_bias = 1.25f;
+	float shadow_slope_bias = 1.75f;
+	float shadow_ambient = 0.35f;
+	//Clustered point and spot lights. The view frustum is split into tiles of the render area times logarithmic depth
+	//slices, lights are binned into per cluster lists on the GPU, needs compute on the graphics queue. Lights past
+	//max_lights are ignored, the index list holds light_indices_per_cluster entries per cluster on average
+	glm::uvec3 cluster_grid = glm::uvec3(16, 9, 24);
+	uint32_t max_lights = 1024;
+	uint32_t light_indices_per_cluster = 32;
+	//The scene is lit into a floating point target and brought to the display by compute passes: bloom over a chain of
+	//halved levels, exposure adapted to a luminance histogram and tonemapping, needs compute on the graphics queue.
+	//Bloom gathers what lies above the threshold, the histogram spans the log2 luminance range, adaptation is per
+	//second and compensation in stops
+	bool hdr = true;
+	uint32_t bloom_levels = 6;
+	float bloom_threshold = 1.0f;
+	float bloom_intensity = 0.05f;
+	float exposure_min_log = -8.0f;
+	float exposure_max_log = 4.0f;
+	float exposure_adaptation = 1.5f;
+	float exposure_compensation = 0.0f;
+	//Neighbouring render graph passes that only hand attachments on are merged into subpasses of one render pass
+	bool merge_subpasses = true;
+	//The scene is rendered at a fraction of the swap chain extent per axis, adjusted every frame so the measured
+	//GPU time stays near the target, then upscaled. Scales above 1 supersample
+	bool dynamic_resolution = false;
+	float target_gpu_time_ms = 16.0f;
+	float min_render_scale = 0.5f;
+	float max_render_scale = 1.0f;
+	Upscale_filter upscale_filter = Upscale_filter::bilinear;
+	float sharpness = 0.5f;
+	//Number of frames the CPU may record ahead of the GPU, each with its own command buffer and uniform buffers
+	uint32_t frames_in_flight = 2;
+	//Falls back to FIFO, the only mode every device has to support, when the requested one is missing
+	VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+	//0 leaves the frame rate unlimited
+	float target_fps = 0.0f;
+	bool measure_latency = false;
+};
+#endif // !SETTINGS_H
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (push_constant) uniform ShadowConstants
+{
+    mat4 transform;
+} shadow;
+
+layout(location = 0) in vec3 inPosition;
+
+void main ()
+{
+	gl_Position = shadow.transform * vec4 (inPosition, 1.0);
+}
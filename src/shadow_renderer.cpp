@@ -0,0 +1,432 @@
+#include "shadow_renderer.h"
+#include "shader.h"
+#include <cmath>
+#include <algorithm>
+#include "glm/gtc/matrix_transform.hpp"
+
+Shadow_renderer::Shadow_renderer(std::shared_ptr<VulkanDevice> device, VkFormat depth_format, const uint32_t map_size, const uint32_t cascades,
+	const Vertex_layout& layout, const float constant_bias, const float slope_bias) :
+	dev(device), format(depth_format), size(std::max(1u, map_size)), cascade_count(std::clamp(cascades, 1u, MAX_CASCADES))
+{
+	create_render_pass();
+	create_map(static_map);
+	create_map(dynamic_map);
+	create_pipeline(layout, constant_bias, slope_bias);
+	create_sampler();
+}
+
+Shadow_renderer::~Shadow_renderer()
+{
+	destroy();
+}
+
+void Shadow_renderer::create_render_pass()
+{
+	//Layers are cleared on every redraw, so their old contents never have to be loaded
+	VkAttachmentDescription attachment{};
+	attachment.format = format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	VkAttachmentReference depth_reference{};
+	depth_reference.attachment = 0;
+	depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.pDepthStencilAttachment = &depth_reference;
+	//The previous frame's scene pass has to finish sampling a layer before it is cleared, and this frame's has to
+	//wait for the new depth
+	std::array<VkSubpassDependency, 2> dependencies{};
+	dependencies.at(0).srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies.at(0).dstSubpass = 0;
+	dependencies.at(0).srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies.at(0).srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies.at(0).dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies.at(0).dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies.at(1).srcSubpass = 0;
+	dependencies.at(1).dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies.at(1).srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies.at(1).srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies.at(1).dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies.at(1).dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	VkRenderPassCreateInfo render_pass_info{};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = 1;
+	render_pass_info.pAttachments = &attachment;
+	render_pass_info.subpassCount = 1;
+	render_pass_info.pSubpasses = &subpass;
+	render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	render_pass_info.pDependencies = dependencies.data();
+	if (vkCreateRenderPass(dev->get_device(), &render_pass_info, nullptr, &render_pass) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow render pass!\n");
+}
+
+void Shadow_renderer::create_map(Shadow_map& map)
+{
+	VkDevice device = dev->get_device();
+	VkImageCreateInfo img_info{};
+	img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	img_info.imageType = VK_IMAGE_TYPE_2D;
+	img_info.format = format;
+	img_info.extent = { size, size, 1 };
+	img_info.mipLevels = 1;
+	img_info.arrayLayers = cascade_count;
+	img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	img_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (vkCreateImage(device, &img_info, nullptr, &map.image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow map!\n");
+	VkMemoryRequirements mem_req{};
+	vkGetImageMemoryRequirements(device, map.image, &mem_req);
+	VkMemoryAllocateInfo malloc_info{};
+	malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	malloc_info.allocationSize = mem_req.size;
+	malloc_info.memoryTypeIndex = find_memory_type(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (vkAllocateMemory(device, &malloc_info, nullptr, &map.memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate shadow map memory!\n");
+	vkBindImageMemory(device, map.image, map.memory, 0);
+
+	VkImageViewCreateInfo view_info{};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = map.image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	view_info.format = format;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.layerCount = cascade_count;
+	if (vkCreateImageView(device, &view_info, nullptr, &map.view) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow map view!\n");
+	map.layer_views.resize(cascade_count);
+	map.framebuffers.resize(cascade_count);
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.subresourceRange.layerCount = 1;
+	for (uint32_t i = 0; i < cascade_count; ++i)
+	{
+		view_info.subresourceRange.baseArrayLayer = i;
+		if (vkCreateImageView(device, &view_info, nullptr, &map.layer_views.at(i)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create shadow map view!\n");
+		VkFramebufferCreateInfo framebuffer_info{};
+		framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebuffer_info.renderPass = render_pass;
+		framebuffer_info.attachmentCount = 1;
+		framebuffer_info.pAttachments = &map.layer_views.at(i);
+		framebuffer_info.width = framebuffer_info.height = size;
+		framebuffer_info.layers = 1;
+		if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &map.framebuffers.at(i)) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create shadow map framebuffer!\n");
+	}
+}
+
+void Shadow_renderer::destroy_map(Shadow_map& map)
+{
+	VkDevice device = dev->get_device();
+	for (const auto& framebuffer : map.framebuffers)
+		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	for (const auto& view : map.layer_views)
+		vkDestroyImageView(device, view, nullptr);
+	vkDestroyImageView(device, map.view, nullptr);
+	vkDestroyImage(device, map.image, nullptr);
+	vkFreeMemory(device, map.memory, nullptr);
+	map = Shadow_map{};
+}
+
+void Shadow_renderer::create_pipeline(const Vertex_layout& layout, const float constant_bias, const float slope_bias)
+{
+	VkDevice device = dev->get_device();
+	VkPushConstantRange push_range{};
+	push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_range.size = sizeof(glm::mat4);
+	VkPipelineLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_range;
+	if (vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow pipeline layout!\n");
+
+	//Depth only like the pre-pass, the light's transform is pushed premultiplied with the model matrix
+	Shader vertex_shader(R"(src\shadow.spv)", device);
+	VkShaderModule vertex_module = vertex_shader.create_shader_module();
+	VkPipelineShaderStageCreateInfo pipeline_vertex_info{};
+	pipeline_vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_vertex_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	pipeline_vertex_info.module = vertex_module;
+	pipeline_vertex_info.pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+	auto binding_description = layout.get_position_binding_description();
+	auto attribute_desc = layout.get_position_attribute_description();
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.pVertexAttributeDescriptions = &attribute_desc;
+	vertex_input_info.pVertexBindingDescriptions = &binding_description;
+	vertex_input_info.vertexAttributeDescriptionCount = vertex_input_info.vertexBindingDescriptionCount = 1;
+
+	VkPipelineInputAssemblyStateCreateInfo assembly_info{};
+	assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	assembly_info.primitiveRestartEnable = VK_FALSE;
+
+	VkViewport viewport{};
+	viewport.width = viewport.height = static_cast<float>(size);
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissors{};
+	scissors.extent = { size, size };
+	VkPipelineViewportStateCreateInfo viewport_info{};
+	viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_info.viewportCount = viewport_info.scissorCount = 1;
+	viewport_info.pViewports = &viewport;
+	viewport_info.pScissors = &scissors;
+
+	//Both faces are drawn so open meshes like planes cast, the slope scaled bias keeps surfaces from shadowing themselves
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_TRUE;
+	rasterizer.depthBiasConstantFactor = constant_bias;
+	rasterizer.depthBiasSlopeFactor = slope_bias;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colour_blending{};
+	colour_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colour_blending.attachmentCount = 0;
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
+	depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil_info.depthTestEnable = depth_stencil_info.depthWriteEnable = VK_TRUE;
+	depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS;
+	depth_stencil_info.depthBoundsTestEnable = depth_stencil_info.stencilTestEnable = VK_FALSE;
+
+	VkGraphicsPipelineCreateInfo graphics_pipeline_info{};
+	graphics_pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	graphics_pipeline_info.stageCount = 1;
+	graphics_pipeline_info.pStages = &pipeline_vertex_info;
+	graphics_pipeline_info.pVertexInputState = &vertex_input_info;
+	graphics_pipeline_info.pRasterizationState = &rasterizer;
+	graphics_pipeline_info.pInputAssemblyState = &assembly_info;
+	graphics_pipeline_info.pViewportState = &viewport_info;
+	graphics_pipeline_info.pMultisampleState = &multisampling;
+	graphics_pipeline_info.pColorBlendState = &colour_blending;
+	graphics_pipeline_info.pDepthStencilState = &depth_stencil_info;
+	graphics_pipeline_info.layout = pipeline_layout;
+	graphics_pipeline_info.renderPass = render_pass;
+	graphics_pipeline_info.subpass = 0;
+	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphics_pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow pipeline!\n");
+	vkDestroyShaderModule(device, vertex_module, nullptr);
+}
+
+void Shadow_renderer::create_sampler()
+{
+	//Hardware comparison with linear filtering already blends 2x2 results, the shader adds a wider kernel on top.
+	//Points outside the map read the border and stay lit
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = sampler_info.addressModeV = sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	sampler_info.compareEnable = VK_TRUE;
+	sampler_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	if (vkCreateSampler(dev->get_device(), &sampler_info, nullptr, &sampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create shadow sampler!\n");
+}
+
+void Shadow_renderer::invalidate()
+{
+	for (auto& cascade : cascades)
+		cascade.cache_valid = false;
+}
+
+void Shadow_renderer::set_light_direction(const glm::vec3& direction)
+{
+	light_direction = glm::normalize(direction);
+	//Light space changed, every cascade is re-centred on the next update
+	for (auto& cascade : cascades)
+	{
+		cascade.radius = 0.0f;
+		cascade.cache_valid = false;
+	}
+}
+
+void Shadow_renderer::update(const glm::mat4& view, const glm::mat4& projection, const float near_plane, const float distance, const float lambda, const float margin)
+{
+	glm::mat4 inverse_view = glm::inverse(view);
+	float tan_x = 1.0f / projection[0][0], tan_y = std::abs(1.0f / projection[1][1]);
+	glm::vec3 up = std::abs(light_direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), light_direction, up);
+	float slice_start = near_plane;
+	for (uint32_t i = 0; i < cascade_count; ++i)
+	{
+		Cascade& cascade = cascades.at(i);
+		float fraction = static_cast<float>(i + 1) / cascade_count;
+		float logarithmic = near_plane * std::pow(distance / near_plane, fraction);
+		float uniform = near_plane + (distance - near_plane) * fraction;
+		cascade.split = lambda * logarithmic + (1.0f - lambda) * uniform;
+		//Bounding sphere of the slice, its size only depends on the projection, so rotating the camera keeps it
+		std::array<glm::vec3, 8> corners;
+		glm::vec3 centre(0.0f);
+		for (uint32_t c = 0; c < corners.size(); ++c)
+		{
+			float z = c < 4 ? slice_start : cascade.split;
+			glm::vec4 corner(((c & 1) ? 1.0f : -1.0f) * tan_x * z, ((c & 2) ? 1.0f : -1.0f) * tan_y * z, -z, 1.0f);
+			corners.at(c) = glm::vec3(inverse_view * corner);
+			centre += corners.at(c) / 8.0f;
+		}
+		float radius = 0.0f;
+		for (const auto& corner : corners)
+			radius = std::max(radius, glm::length(corner - centre));
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+		slice_start = cascade.split;
+
+		//The cached square is kept while the slice stays inside it, re-centring snaps to whole texels so the
+		//static casters land on the same texels and don't shimmer
+		float extent = radius * (1.0f + margin);
+		glm::vec3 light_centre = glm::vec3(light_view * glm::vec4(centre, 1.0f));
+		bool inside = cascade.radius == extent &&
+			std::abs(light_centre.x - cascade.centre.x) + radius <= extent &&
+			std::abs(light_centre.y - cascade.centre.y) + radius <= extent &&
+			std::abs(light_centre.z - cascade.depth) + radius <= extent;
+		if (!inside)
+		{
+			float texel = 2.0f * extent / size;
+			cascade.centre = glm::floor(glm::vec2(light_centre) / texel) * texel;
+			cascade.depth = light_centre.z;
+			cascade.radius = extent;
+			cascade.cache_valid = false;
+		}
+		//Casters up to the shadow distance towards the light still throw shadows into the square
+		glm::mat4 projection_matrix = glm::ortho(cascade.centre.x - extent, cascade.centre.x + extent, cascade.centre.y - extent, cascade.centre.y + extent,
+			-cascade.depth - extent - distance, -cascade.depth + extent);
+		cascade.view_projection = projection_matrix * light_view;
+		cascade.planes = meshlet_builder::make_view(cascade.view_projection, glm::mat4(1.0f), glm::vec3(0.0f));
+	}
+}
+
+void Shadow_renderer::record_layer(VkCommandBuffer command_buffer, const Shadow_map& map, const uint32_t cascade, const std::vector<Shadow_caster>& casters, const bool dynamic)
+{
+	VkClearValue clear{};
+	clear.depthStencil = { 1.0f, 0 };
+	VkRenderPassBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	begin_info.renderPass = render_pass;
+	begin_info.framebuffer = map.framebuffers.at(cascade);
+	begin_info.renderArea.extent = { size, size };
+	begin_info.clearValueCount = 1;
+	begin_info.pClearValues = &clear;
+	vkCmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	const Cascade& current = cascades.at(cascade);
+	VkBuffer bound_positions = VK_NULL_HANDLE, bound_indices = VK_NULL_HANDLE;
+	for (const auto& caster : casters)
+	{
+		if (caster.dynamic != dynamic)
+			continue;
+		bool visible = true;
+		for (const auto& plane : current.planes.planes)
+			visible = visible && glm::dot(glm::vec3(plane), caster.centre) + plane.w >= -caster.radius;
+		if (!visible)
+			continue;
+		if (caster.positions != bound_positions)
+		{
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(command_buffer, 0, 1, &caster.positions, &offset);
+			bound_positions = caster.positions;
+		}
+		if (caster.indices != bound_indices)
+			vkCmdBindIndexBuffer(command_buffer, bound_indices = caster.indices, 0, caster.index_type);
+		glm::mat4 transform = current.view_projection * caster.model;
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), &transform);
+		for (const auto& range : *caster.ranges)
+			vkCmdDrawIndexed(command_buffer, range.index_count, 1, range.first_index, range.vertex_offset, 0);
+	}
+	vkCmdEndRenderPass(command_buffer);
+}
+
+void Shadow_renderer::record(VkCommandBuffer command_buffer, const std::vector<Shadow_caster>& casters)
+{
+	bool any_dynamic = std::any_of(casters.begin(), casters.end(), [](const Shadow_caster& caster) { return caster.dynamic; });
+	for (uint32_t i = 0; i < cascade_count; ++i)
+	{
+		Cascade& cascade = cascades.at(i);
+		if (!cascade.cache_valid)
+			record_layer(command_buffer, static_map, i, casters, false);
+		cascade.cache_valid = true;
+		//An empty dynamic layer only has to be cleared once
+		if (any_dynamic || cascade.dynamic_drawn)
+			record_layer(command_buffer, dynamic_map, i, casters, true);
+		cascade.dynamic_drawn = any_dynamic;
+	}
+}
+
+uint32_t Shadow_renderer::get_cascade_count() const
+{
+	return cascade_count;
+}
+
+const Shadow_renderer::Cascade& Shadow_renderer::get_cascade(const uint32_t cascade) const
+{
+	return cascades.at(cascade);
+}
+
+glm::vec3 Shadow_renderer::get_light_direction() const
+{
+	return light_direction;
+}
+
+float Shadow_renderer::get_texel_size() const
+{
+	return 1.0f / size;
+}
+
+VkImageView Shadow_renderer::get_static_view() const
+{
+	return static_map.view;
+}
+
+VkImageView Shadow_renderer::get_dynamic_view() const
+{
+	return dynamic_map.view;
+}
+
+VkSampler Shadow_renderer::get_sampler() const
+{
+	return sampler;
+}
+
+void Shadow_renderer::destroy()
+{
+	if (render_pass == VK_NULL_HANDLE)
+		return;
+	VkDevice device = dev->get_device();
+	destroy_map(static_map);
+	destroy_map(dynamic_map);
+	vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+	vkDestroyRenderPass(device, render_pass, nullptr);
+	render_pass = VK_NULL_HANDLE;
+}
+
+uint32_t Shadow_renderer::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties mem_prop = dev->get_memory_properties();
+	for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i)
+	{
+		if (type_filter & (1 << i) &&
+			((mem_prop.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!\n");
+}
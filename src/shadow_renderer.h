@@ -0,0 +1,103 @@
+#ifndef SHADOW_RENDERER_H
+#define SHADOW_RENDERER_H
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <array>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+#include "VulkanDevice.h"
+#include "vertex_layout.h"
+#include "meshlet_builder.h"
+#include "model.h"
+
+//Geometry drawn into the shadow maps, model is the world matrix with the position dequantization folded in
+struct Shadow_caster
+{
+	glm::mat4 model;
+	glm::vec3 centre;
+	float radius;
+	VkBuffer positions;
+	VkBuffer indices;
+	VkIndexType index_type;
+	const std::vector<Draw_range>* ranges;
+	//Moving casters are redrawn every frame, static ones only when their cascade's cache is invalid
+	bool dynamic;
+};
+
+//Cascaded shadow maps of one directional light fitted to the camera frustum. Each cascade covers a slice of the
+//view depth with a square that is larger than the slice, so the camera can move inside it without the light
+//matrix changing. Static casters are rendered into a cached map that is only redrawn when the cascade has to
+//be re-centred or a static caster changed, moving casters go into a second map redrawn every frame. Both are
+//compared against with PCF by the scene shader
+class Shadow_renderer
+{
+public:
+	static constexpr uint32_t MAX_CASCADES = 4;
+	struct Cascade
+	{
+		glm::mat4 view_projection = glm::mat4(1.0f);
+		//Far end of the slice in view depth
+		float split = 0.0f;
+		//Centre in light space and half size of the covered square, snapped to whole texels
+		glm::vec2 centre = glm::vec2(0.0f);
+		float radius = 0.0f;
+		float depth = 0.0f;
+		bool cache_valid = false;
+		//Dynamic layer holds casters, it has to be cleared even when none are left
+		bool dynamic_drawn = true;
+		Cull_view planes{};
+	};
+private:
+	struct Shadow_map
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		std::vector<VkImageView> layer_views;
+		std::vector<VkFramebuffer> framebuffers;
+	};
+	std::shared_ptr<VulkanDevice> dev;
+	VkFormat format;
+	uint32_t size;
+	uint32_t cascade_count;
+	std::array<Cascade, MAX_CASCADES> cascades;
+	Shadow_map static_map, dynamic_map;
+	//Both maps start undefined, the first record clears every layer
+	bool initialized = false;
+	VkRenderPass render_pass = VK_NULL_HANDLE;
+	VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	glm::vec3 light_direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	void create_map(Shadow_map& map);
+	void destroy_map(Shadow_map& map);
+	void create_render_pass();
+	void create_pipeline(const Vertex_layout& layout, const float constant_bias, const float slope_bias);
+	void create_sampler();
+	void record_layer(VkCommandBuffer command_buffer, const Shadow_map& map, const uint32_t cascade, const std::vector<Shadow_caster>& casters, const bool dynamic);
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+public:
+	Shadow_renderer(std::shared_ptr<VulkanDevice> device, VkFormat depth_format, const uint32_t map_size, const uint32_t cascades,
+		const Vertex_layout& layout, const float constant_bias, const float slope_bias);
+	~Shadow_renderer();
+	//Drops every cached layer, for casters that were added, removed or changed outside the transform updates
+	void invalidate();
+	void set_light_direction(const glm::vec3& direction);
+	//Fits the cascades to the part of the camera frustum up to distance, lambda blends uniform and logarithmic splits.
+	//margin is the fraction a cascade is enlarged by to keep its cache while the camera moves
+	void update(const glm::mat4& view, const glm::mat4& projection, const float near_plane, const float distance, const float lambda, const float margin);
+	//Redraws the invalid static layers and the dynamic ones, leaves both maps ready to be sampled by fragment shaders
+	void record(VkCommandBuffer command_buffer, const std::vector<Shadow_caster>& casters);
+	uint32_t get_cascade_count() const;
+	const Cascade& get_cascade(const uint32_t cascade) const;
+	glm::vec3 get_light_direction() const;
+	float get_texel_size() const;
+	VkImageView get_static_view() const;
+	VkImageView get_dynamic_view() const;
+	VkSampler get_sampler() const;
+	void destroy();
+};
+#endif // !SHADOW_RENDERER_H
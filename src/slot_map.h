@@ -0,0 +1,97 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+//Reference to an object in a Slot_map, it goes stale instead of dangling once the object is removed
+template<typename T>
+struct Handle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+//Values are stored densely for iteration, slots map stable handles to dense positions.
+//Insert, remove and lookup are O(1), removal moves the last value into the freed position
+template<typename T>
+class Slot_map
+{
+	static constexpr uint32_t NONE = UINT32_MAX;
+	//While a slot is free its dense field links to the next free slot
+	struct Slot
+	{
+		uint32_t dense;
+		uint32_t generation;
+	};
+	std::vector<Slot> slots;
+	std::vector<T> values;
+	std::vector<uint32_t> dense_slots;
+	uint32_t free_head = NONE;
+public:
+	Handle<T> insert(T value)
+	{
+		uint32_t slot = free_head;
+		if (slot == NONE)
+		{
+			slot = static_cast<uint32_t>(slots.size());
+			slots.push_back({ NONE, 0 });
+		}
+		else
+			free_head = slots[slot].dense;
+		slots[slot].dense = static_cast<uint32_t>(values.size());
+		values.push_back(std::move(value));
+		dense_slots.push_back(slot);
+		return { slot, slots[slot].generation };
+	}
+	void remove(const Handle<T>& handle)
+	{
+		if (!contains(handle))
+			throw std::runtime_error("Handle doesn't refer to a live object!\n");
+		uint32_t dense = slots[handle.index].dense, last_slot = dense_slots.back();
+		values[dense] = std::move(values.back());
+		dense_slots[dense] = last_slot;
+		slots[last_slot].dense = dense;
+		values.pop_back();
+		dense_slots.pop_back();
+		++slots[handle.index].generation;
+		slots[handle.index].dense = free_head;
+		free_head = handle.index;
+	}
+	bool contains(const Handle<T>& handle) const
+	{
+		return handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].dense < values.size()
+			&& dense_slots[slots[handle.index].dense] == handle.index;
+	}
+	T& get(const Handle<T>& handle)
+	{
+		if (!contains(handle))
+			throw std::runtime_error("Handle doesn't refer to a live object!\n");
+		return values[slots[handle.index].dense];
+	}
+	const T& get(const Handle<T>& handle) const
+	{
+		if (!contains(handle))
+			throw std::runtime_error("Handle doesn't refer to a live object!\n");
+		return values[slots[handle.index].dense];
+	}
+	Handle<T> handle_at(const size_t dense) const
+	{
+		return { dense_slots.at(dense), slots[dense_slots.at(dense)].generation };
+	}
+	size_t size() const
+	{
+		return values.size();
+	}
+	bool empty() const
+	{
+		return values.empty();
+	}
+	typename std::vector<T>::iterator begin() { return values.begin(); }
+	typename std::vector<T>::iterator end() { return values.end(); }
+	typename std::vector<T>::const_iterator begin() const { return values.begin(); }
+	typename std::vector<T>::const_iterator end() const { return values.end(); }
+};
+#endif // !SLOT_MAP_H
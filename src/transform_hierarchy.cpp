@@ -0,0 +1,257 @@
+#include "transform_hierarchy.h"
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t Transform_hierarchy::add_node(const uint32_t parent, const glm::mat4& local)
+{
+	uint32_t node = add_node(parent);
+	set_local(node_slots.at(node), local);
+	return node;
+}
+
+uint32_t Transform_hierarchy::add_node(const uint32_t parent)
+{
+	if (parent != NO_PARENT && (parent >= node_slots.size() || node_slots.at(parent) == NO_PARENT))
+		throw std::runtime_error("Parent transform node doesn't exist!\n");
+	//Appending keeps the order valid, the parent already has a lower slot
+	uint32_t node = static_cast<uint32_t>(node_slots.size()), slot = static_cast<uint32_t>(slot_nodes.size());
+	if (!free_nodes.empty())
+	{
+		node = free_nodes.back();
+		free_nodes.pop_back();
+	}
+	translations.emplace_back(0.0f);
+	rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+	scales.emplace_back(1.0f);
+	parents.push_back(parent == NO_PARENT ? NO_PARENT : node_slots.at(parent));
+	world_matrices.emplace_back(1.0f);
+	dirty.push_back(1);
+	updated.push_back(0);
+	if (node == node_slots.size())
+		node_slots.push_back(slot);
+	else
+		node_slots.at(node) = slot;
+	slot_nodes.push_back(node);
+	any_dirty = true;
+	return node;
+}
+
+void Transform_hierarchy::remove_node(const uint32_t node)
+{
+	uint32_t slot = node_slots.at(node);
+	if (slot == NO_PARENT)
+		throw std::runtime_error("Transform node was already removed!\n");
+	for (uint32_t child = 0; child < parents.size(); ++child)
+		if (parents.at(child) == slot)
+		{
+			set_local(child, world_matrices.at(child));
+			parents.at(child) = NO_PARENT;
+			mark_dirty(child);
+		}
+	//Erasing keeps the remaining slots in order, parents above the hole shift down by one
+	translations.erase(translations.begin() + slot);
+	rotations.erase(rotations.begin() + slot);
+	scales.erase(scales.begin() + slot);
+	parents.erase(parents.begin() + slot);
+	world_matrices.erase(world_matrices.begin() + slot);
+	dirty.erase(dirty.begin() + slot);
+	updated.erase(updated.begin() + slot);
+	slot_nodes.erase(slot_nodes.begin() + slot);
+	for (auto& parent : parents)
+		if (parent != NO_PARENT && parent > slot)
+			--parent;
+	for (uint32_t i = slot; i < slot_nodes.size(); ++i)
+		node_slots.at(slot_nodes.at(i)) = i;
+	node_slots.at(node) = NO_PARENT;
+	free_nodes.push_back(node);
+}
+
+void Transform_hierarchy::set_local(const uint32_t slot, const glm::mat4& local)
+{
+	glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])), glm::length(glm::vec3(local[2])));
+	glm::mat3 rotation(glm::vec3(local[0]) / scale.x, glm::vec3(local[1]) / scale.y, glm::vec3(local[2]) / scale.z);
+	translations.at(slot) = glm::vec3(local[3]);
+	rotations.at(slot) = glm::normalize(glm::quat_cast(rotation));
+	scales.at(slot) = scale;
+}
+
+void Transform_hierarchy::set_parent(const uint32_t node, const uint32_t parent)
+{
+	uint32_t slot = node_slots.at(node);
+	if (parent != NO_PARENT)
+		for (uint32_t ancestor = node_slots.at(parent); ancestor != NO_PARENT; ancestor = parents.at(ancestor))
+			if (ancestor == slot)
+				throw std::runtime_error("Transform node can't be parented to its own descendant!\n");
+	parents.at(slot) = parent == NO_PARENT ? NO_PARENT : node_slots.at(parent);
+	needs_sort = needs_sort || (parent != NO_PARENT && parents.at(slot) > slot);
+	mark_dirty(slot);
+}
+
+uint32_t Transform_hierarchy::get_parent(const uint32_t node) const
+{
+	uint32_t parent = parents.at(node_slots.at(node));
+	return parent == NO_PARENT ? NO_PARENT : slot_nodes.at(parent);
+}
+
+void Transform_hierarchy::mark_dirty(const uint32_t slot)
+{
+	dirty.at(slot) = 1;
+	any_dirty = true;
+}
+
+void Transform_hierarchy::translate(const uint32_t node, const glm::vec3& offset)
+{
+	uint32_t slot = node_slots.at(node);
+	translations.at(slot) += rotations.at(slot) * (scales.at(slot) * offset);
+	mark_dirty(slot);
+}
+
+void Transform_hierarchy::rotate(const uint32_t node, const glm::quat& rotation)
+{
+	uint32_t slot = node_slots.at(node);
+	rotations.at(slot) = glm::normalize(rotations.at(slot) * rotation);
+	mark_dirty(slot);
+}
+
+void Transform_hierarchy::scale(const uint32_t node, const glm::vec3& amount)
+{
+	uint32_t slot = node_slots.at(node);
+	scales.at(slot) *= amount;
+	mark_dirty(slot);
+}
+
+void Transform_hierarchy::set_translation(const uint32_t node, const glm::vec3& translation)
+{
+	translations.at(node_slots.at(node)) = translation;
+	mark_dirty(node_slots.at(node));
+}
+
+void Transform_hierarchy::set_rotation(const uint32_t node, const glm::quat& rotation)
+{
+	rotations.at(node_slots.at(node)) = rotation;
+	mark_dirty(node_slots.at(node));
+}
+
+void Transform_hierarchy::set_scale(const uint32_t node, const glm::vec3& scale)
+{
+	scales.at(node_slots.at(node)) = scale;
+	mark_dirty(node_slots.at(node));
+}
+
+glm::vec3 Transform_hierarchy::get_translation(const uint32_t node) const
+{
+	return translations.at(node_slots.at(node));
+}
+
+glm::quat Transform_hierarchy::get_rotation(const uint32_t node) const
+{
+	return rotations.at(node_slots.at(node));
+}
+
+glm::vec3 Transform_hierarchy::get_scale(const uint32_t node) const
+{
+	return scales.at(node_slots.at(node));
+}
+
+const glm::mat4& Transform_hierarchy::get_world_matrix(const uint32_t node) const
+{
+	return world_matrices.at(node_slots.at(node));
+}
+
+bool Transform_hierarchy::was_updated(const uint32_t node) const
+{
+	return updated.at(node_slots.at(node)) != 0;
+}
+
+size_t Transform_hierarchy::size() const
+{
+	return slot_nodes.size();
+}
+
+void Transform_hierarchy::sort()
+{
+	//Depth first order keeps every subtree in one contiguous run of slots
+	size_t count = slot_nodes.size();
+	std::vector<uint32_t> child_offsets(count + 1, 0), children(count), order;
+	order.reserve(count);
+	for (uint32_t parent : parents)
+		if (parent != NO_PARENT)
+			++child_offsets.at(parent + 1);
+	for (size_t i = 0; i < count; ++i)
+		child_offsets.at(i + 1) += child_offsets.at(i);
+	std::vector<uint32_t> fill(child_offsets.begin(), child_offsets.end() - 1), stack;
+	for (uint32_t slot = 0; slot < count; ++slot)
+		if (parents.at(slot) != NO_PARENT)
+			children.at(fill.at(parents.at(slot))++) = slot;
+	for (uint32_t root = 0; root < count; ++root)
+	{
+		if (parents.at(root) != NO_PARENT)
+			continue;
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			uint32_t slot = stack.back();
+			stack.pop_back();
+			order.push_back(slot);
+			for (uint32_t i = child_offsets.at(slot + 1); i > child_offsets.at(slot); --i)
+				stack.push_back(children.at(i - 1));
+		}
+	}
+	std::vector<uint32_t> new_slots(count);
+	for (uint32_t i = 0; i < count; ++i)
+		new_slots.at(order.at(i)) = i;
+	auto permute = [&](auto& values) {
+		auto old = values;
+		for (uint32_t i = 0; i < count; ++i)
+			values.at(i) = old.at(order.at(i));
+	};
+	permute(translations);
+	permute(rotations);
+	permute(scales);
+	permute(parents);
+	permute(world_matrices);
+	permute(dirty);
+	permute(slot_nodes);
+	for (auto& parent : parents)
+		if (parent != NO_PARENT)
+			parent = new_slots.at(parent);
+	for (uint32_t i = 0; i < count; ++i)
+		node_slots.at(slot_nodes.at(i)) = i;
+	needs_sort = false;
+}
+
+void Transform_hierarchy::update()
+{
+	std::fill(updated.begin(), updated.end(), 0);
+	if (needs_sort)
+		sort();
+	if (!any_dirty)
+		return;
+	size_t count = slot_nodes.size();
+	dirty_slots.clear();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		//Parents were handled earlier in this pass, so a dirty flag reaches the whole subtree
+		if (parents[i] != NO_PARENT)
+			dirty[i] |= dirty[parents[i]];
+		if (dirty[i])
+			dirty_slots.push_back(i);
+	}
+	//Local matrices don't depend on each other and are built in batches small enough to stay in cache,
+	//the parent chain is then resolved in slot order
+	for (size_t first = 0; first < dirty_slots.size(); first += BATCH_SIZE)
+	{
+		size_t batch = std::min(BATCH_SIZE, dirty_slots.size() - first);
+		transform_kernels::compose(dirty_slots.data() + first, batch, translations.data(), rotations.data(), scales.data(), local_matrices.data());
+		for (size_t i = 0; i < batch; ++i)
+		{
+			uint32_t slot = dirty_slots[first + i], parent = parents[slot];
+			if (parent == NO_PARENT)
+				world_matrices[slot] = local_matrices[i];
+			else
+				transform_kernels::multiply(world_matrices[parent], local_matrices[i], world_matrices[slot]);
+		}
+	}
+	std::swap(dirty, updated);
+	any_dirty = false;
+}
@@ -0,0 +1,60 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+#define GLM_FORCE_RADIANS
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "transform_kernels.h"
+
+//Local TRS, parent and world matrix of every node kept in separate arrays ordered so parents precede their
+//children, one forward pass then propagates dirty flags and rebuilds only the changed subtrees.
+//Node ids stay stable, the storage slot of a node may change when the hierarchy is reordered
+class Transform_hierarchy
+{
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<uint32_t> parents;
+	std::vector<glm::mat4> world_matrices;
+	std::vector<uint8_t> dirty;
+	std::vector<uint8_t> updated;
+	std::vector<uint32_t> node_slots;
+	std::vector<uint32_t> slot_nodes;
+	std::vector<uint32_t> free_nodes;
+	//Scratch for the batched update, kept to avoid allocating every frame
+	static constexpr size_t BATCH_SIZE = 64;
+	std::vector<uint32_t> dirty_slots;
+	std::array<glm::mat4, BATCH_SIZE> local_matrices;
+	bool needs_sort = false;
+	bool any_dirty = false;
+	void mark_dirty(const uint32_t slot);
+	void set_local(const uint32_t slot, const glm::mat4& local);
+	void sort();
+public:
+	static constexpr uint32_t NO_PARENT = UINT32_MAX;
+	//The local matrix is split into translation, rotation and scale, shear is dropped
+	uint32_t add_node(const uint32_t parent, const glm::mat4& local);
+	uint32_t add_node(const uint32_t parent);
+	//Children of a removed node become roots placed at their last computed world transform, the id is reused later
+	void remove_node(const uint32_t node);
+	void set_parent(const uint32_t node, const uint32_t parent);
+	uint32_t get_parent(const uint32_t node) const;
+	//Operations are applied in the node's local frame, like post-multiplying its matrix
+	void translate(const uint32_t node, const glm::vec3& offset);
+	void rotate(const uint32_t node, const glm::quat& rotation);
+	void scale(const uint32_t node, const glm::vec3& amount);
+	void set_translation(const uint32_t node, const glm::vec3& translation);
+	void set_rotation(const uint32_t node, const glm::quat& rotation);
+	void set_scale(const uint32_t node, const glm::vec3& scale);
+	glm::vec3 get_translation(const uint32_t node) const;
+	glm::quat get_rotation(const uint32_t node) const;
+	glm::vec3 get_scale(const uint32_t node) const;
+	//Matrices are current as of the last update
+	const glm::mat4& get_world_matrix(const uint32_t node) const;
+	bool was_updated(const uint32_t node) const;
+	void update();
+	size_t size() const;
+};
+#endif // !TRANSFORM_HIERARCHY_H
@@ -0,0 +1,79 @@
+#include "transform_kernels.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_KERNELS_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	void compose_scalar(const glm::vec3& t, const glm::quat& q, const glm::vec3& s, glm::mat4& local)
+	{
+		float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+		local[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * s.x;
+		local[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * s.y;
+		local[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * s.z;
+		local[3] = glm::vec4(t, 1.0f);
+	}
+}
+
+void transform_kernels::compose(const uint32_t* slots, const size_t count, const glm::vec3* translations, const glm::quat* rotations,
+	const glm::vec3* scales, glm::mat4* locals)
+{
+	size_t i = 0;
+#ifdef TRANSFORM_KERNELS_SSE
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		const glm::quat& q0 = rotations[slots[i]], & q1 = rotations[slots[i + 1]], & q2 = rotations[slots[i + 2]], & q3 = rotations[slots[i + 3]];
+		const glm::vec3& s0 = scales[slots[i]], & s1 = scales[slots[i + 1]], & s2 = scales[slots[i + 2]], & s3 = scales[slots[i + 3]];
+		const glm::vec3& t0 = translations[slots[i]], & t1 = translations[slots[i + 1]], & t2 = translations[slots[i + 2]], & t3 = translations[slots[i + 3]];
+		__m128 x = _mm_set_ps(q3.x, q2.x, q1.x, q0.x), y = _mm_set_ps(q3.y, q2.y, q1.y, q0.y);
+		__m128 z = _mm_set_ps(q3.z, q2.z, q1.z, q0.z), w = _mm_set_ps(q3.w, q2.w, q1.w, q0.w);
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+		__m128 sx = _mm_set_ps(s3.x, s2.x, s1.x, s0.x), sy = _mm_set_ps(s3.y, s2.y, s1.y, s0.y), sz = _mm_set_ps(s3.z, s2.z, s1.z, s0.z);
+		//Every register holds one matrix element for four nodes
+		__m128 columns[4][4] = {
+			{ _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx), _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx), zero },
+			{ _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy), zero },
+			{ _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz), _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), zero },
+			{ _mm_set_ps(t3.x, t2.x, t1.x, t0.x), _mm_set_ps(t3.y, t2.y, t1.y, t0.y), _mm_set_ps(t3.z, t2.z, t1.z, t0.z), one }
+		};
+		//Transposing turns four elements of one column into that column of each of the four matrices
+		for (int c = 0; c < 4; ++c)
+		{
+			_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+			for (int n = 0; n < 4; ++n)
+				_mm_storeu_ps(&locals[i + n][c][0], columns[c][n]);
+		}
+	}
+#endif
+	for (; i < count; ++i)
+		compose_scalar(translations[slots[i]], rotations[slots[i]], scales[slots[i]], locals[i]);
+}
+
+void transform_kernels::multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#ifdef TRANSFORM_KERNELS_SSE
+	__m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+	//Columns of b are read before out is written, so out may alias b
+	__m128 result[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[c][0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[c][1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[c][2])));
+		result[c] = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[c][3])));
+	}
+	for (int c = 0; c < 4; ++c)
+		_mm_storeu_ps(&out[c][0], result[c]);
+#else
+	out = a * b;
+#endif
+}
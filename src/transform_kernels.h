@@ -0,0 +1,18 @@
+#ifndef TRANSFORM_KERNELS_H
+#define TRANSFORM_KERNELS_H
+#define GLM_FORCE_RADIANS
+#include <cstddef>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+//Batched matrix math for the transform update. SSE versions are used on x86 targets, which always have
+//SSE2 on x64, other targets get the scalar versions
+namespace transform_kernels
+{
+	//Builds translation * rotation * scale for the listed slots, four at a time with the inputs transposed to SoA
+	void compose(const uint32_t* slots, const size_t count, const glm::vec3* translations, const glm::quat* rotations,
+		const glm::vec3* scales, glm::mat4* locals);
+	void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+}
+#endif // !TRANSFORM_KERNELS_H
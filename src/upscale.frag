@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+
+layout(location = 0) out vec4 outColour;
+layout(location = 0) in vec2 fragTexCord;
+layout(binding = 0) uniform sampler2D sceneSampler;
+layout(push_constant) uniform Post_constants
+{
+	vec2 texelSize;
+	vec2 uvScale;
+	float sharpness;
+} constants;
+
+//Only the top left part scaled by uvScale holds the rendered scene, taps must not read past it
+vec4 sampleScene(vec2 uv)
+{
+	return texture(sceneSampler, clamp(uv, 0.5 * constants.texelSize, constants.uvScale - 0.5 * constants.texelSize));
+}
+
+void main()
+{
+	vec2 uv = fragTexCord * constants.uvScale;
+	vec4 centre = sampleScene(uv);
+	if (constants.sharpness <= 0.0)
+	{
+		outColour = centre;
+		return;
+	}
+	//Unsharp mask over the source texel neighbourhood, limited to its range so edges don't ring
+	vec3 north = sampleScene(uv + vec2(0.0, -constants.texelSize.y)).rgb;
+	vec3 south = sampleScene(uv + vec2(0.0, constants.texelSize.y)).rgb;
+	vec3 west = sampleScene(uv + vec2(-constants.texelSize.x, 0.0)).rgb;
+	vec3 east = sampleScene(uv + vec2(constants.texelSize.x, 0.0)).rgb;
+	vec3 lowest = min(centre.rgb, min(min(north, south), min(west, east)));
+	vec3 highest = max(centre.rgb, max(max(north, south), max(west, east)));
+	vec3 sharpened = centre.rgb + constants.sharpness * (4.0 * centre.rgb - north - south - west - east) * 0.25;
+	outColour = vec4(clamp(sharpened, lowest, highest), centre.a);
+}
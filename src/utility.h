@@ -6,6 +6,8 @@ struct Queue_family_indecies
 {
 	std::optional<uint32_t> graphics_family;
 	std::optional<uint32_t> present_family;
+	//Only set for a transfer-only family, i.e. a copy engine separate from the graphics and compute queues
+	std::optional<uint32_t> transfer_family;
 	inline bool is_complete() { return graphics_family.has_value() && present_family.has_value(); };
 };
 
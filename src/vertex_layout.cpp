@@ -0,0 +1,145 @@
+#include "vertex_layout.h"
+#include <algorithm>
+#include <cstring>
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/packing.hpp"
+
+namespace
+{
+	template<typename T>
+	void write(uint8_t*& out, const T& value)
+	{
+		std::memcpy(out, &value, sizeof(T));
+		out += sizeof(T);
+	}
+}
+
+uint32_t Vertex_layout::position_size() const
+{
+	//Three component 16 bit formats are rarely supported for vertex input, so a fourth is padded in
+	return position == Position_format::float32 ? 3 * sizeof(float) : 4 * sizeof(uint16_t);
+}
+
+uint32_t Vertex_layout::uv_size() const
+{
+	return uv == Uv_format::float32 ? 2 * sizeof(float) : 2 * sizeof(uint16_t);
+}
+
+uint32_t Vertex_layout::stride(const bool with_colour) const
+{
+	return position_size() + uv_size() + (with_colour ? 4 : 0);
+}
+
+VkVertexInputBindingDescription Vertex_layout::get_binding_description(const bool with_colour) const
+{
+	VkVertexInputBindingDescription binding_description{};
+	binding_description.binding = 0;
+	binding_description.stride = stride(with_colour);
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return binding_description;
+}
+
+std::vector<VkVertexInputAttributeDescription> Vertex_layout::get_attribute_descriptions(const bool with_colour) const
+{
+	std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
+	attribute_descriptions.push_back(get_position_attribute_description());
+	if (with_colour)
+	{
+		VkVertexInputAttributeDescription colour_attribute{};
+		colour_attribute.location = 1;
+		colour_attribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+		colour_attribute.offset = position_size() + uv_size();
+		attribute_descriptions.push_back(colour_attribute);
+	}
+	VkVertexInputAttributeDescription uv_attribute{};
+	uv_attribute.location = 2;
+	uv_attribute.offset = position_size();
+	if (uv == Uv_format::float32)
+		uv_attribute.format = VK_FORMAT_R32G32_SFLOAT;
+	else
+		uv_attribute.format = uv == Uv_format::half ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16_UNORM;
+	attribute_descriptions.push_back(uv_attribute);
+	return attribute_descriptions;
+}
+
+VkVertexInputBindingDescription Vertex_layout::get_position_binding_description() const
+{
+	VkVertexInputBindingDescription binding_description{};
+	binding_description.binding = 0;
+	binding_description.stride = position_size();
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return binding_description;
+}
+
+VkVertexInputAttributeDescription Vertex_layout::get_position_attribute_description() const
+{
+	VkVertexInputAttributeDescription position_attribute{};
+	position_attribute.location = 0;
+	position_attribute.offset = 0;
+	if (position == Position_format::float32)
+		position_attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+	else
+		position_attribute.format = position == Position_format::half ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16G16B16A16_SNORM;
+	return position_attribute;
+}
+
+Vertex_stream Vertex_layout::pack(const std::vector<Vertex>& vertices) const
+{
+	Vertex_stream stream{};
+	if (vertices.empty())
+		return stream;
+	glm::vec3 min_pos = vertices.front().pos, max_pos = min_pos;
+	glm::vec2 min_uv = vertices.front().tex_cord, max_uv = min_uv;
+	bool constant_colour = true;
+	for (const auto& vertex : vertices)
+	{
+		min_pos = glm::min(min_pos, vertex.pos);
+		max_pos = glm::max(max_pos, vertex.pos);
+		min_uv = glm::min(min_uv, vertex.tex_cord);
+		max_uv = glm::max(max_uv, vertex.tex_cord);
+		constant_colour = constant_colour && vertex.colour == vertices.front().colour;
+	}
+	stream.has_colour = colour && !constant_colour;
+	stream.constant_colour = glm::vec4(vertices.front().colour, 1.0f);
+
+	//Degenerate axes keep a non-zero extent so the division stays finite
+	glm::vec3 centre = (min_pos + max_pos) * 0.5f, extent = glm::max((max_pos - min_pos) * 0.5f, glm::vec3(1e-6f));
+	if (position != Position_format::float32)
+		stream.position_transform = glm::scale(glm::translate(glm::mat4(1.0f), centre), extent);
+	glm::vec2 uv_scale = glm::max(max_uv - min_uv, glm::vec2(1e-6f));
+	if (uv == Uv_format::unorm16)
+		stream.uv_transform = glm::vec4(uv_scale, min_uv);
+
+	uint32_t vertex_stride = stride(stream.has_colour);
+	stream.data.resize(static_cast<size_t>(vertex_stride) * vertices.size());
+	stream.positions.resize(static_cast<size_t>(position_size()) * vertices.size());
+	uint8_t* out = stream.data.data();
+	uint8_t* position_out = stream.positions.data();
+	for (const auto& vertex : vertices)
+	{
+		const uint8_t* vertex_start = out;
+		if (position == Position_format::float32)
+			write(out, vertex.pos);
+		else
+		{
+			//Half floats are densest around 0, so they also get the bounds relative range instead of object space
+			glm::vec3 p = (vertex.pos - centre) / extent;
+			for (int i = 0; i < 3; ++i)
+				write(out, position == Position_format::snorm16 ? glm::packSnorm1x16(p[i]) : glm::packHalf1x16(p[i]));
+			write(out, uint16_t(0));
+		}
+		std::memcpy(position_out, vertex_start, position_size());
+		position_out += position_size();
+		if (uv == Uv_format::float32)
+			write(out, vertex.tex_cord);
+		else
+		{
+			glm::vec2 t = uv == Uv_format::unorm16 ? (vertex.tex_cord - min_uv) / uv_scale : vertex.tex_cord;
+			for (int i = 0; i < 2; ++i)
+				write(out, uv == Uv_format::unorm16 ? glm::packUnorm1x16(t[i]) : glm::packHalf1x16(t[i]));
+		}
+		if (stream.has_colour)
+			write(out, glm::packUnorm4x8(glm::vec4(vertex.colour, 1.0f)));
+	}
+	return stream;
+}
@@ -0,0 +1,61 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_EXPERIMENTAL
+#include <vector>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "glm/gtx/hash.hpp"
+#include "vulkan/vulkan.h"
+
+//Full precision vertex used while loading and processing meshes, the GPU only sees the packed form
+struct Vertex
+{
+	glm::vec3 pos;
+	glm::vec3 colour;
+	glm::vec2 tex_cord;
+	bool operator==(const Vertex& other) const {
+		return pos == other.pos && colour == other.colour && tex_cord == other.tex_cord;
+	}
+};
+namespace std
+{
+	template<> struct hash<Vertex> {
+		size_t operator()(Vertex const& vertex) const {
+			return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.colour) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.tex_cord) << 1);
+		}
+	};
+}
+
+//16 bit positions are relative to the mesh bounds, mapped to [-1, 1] per axis, unorm16 UVs to the UV bounds
+enum class Position_format { float32, half, snorm16 };
+enum class Uv_format { float32, half, unorm16 };
+
+//Packed vertex data plus what is needed to undo the quantization on the GPU
+struct Vertex_stream
+{
+	std::vector<uint8_t> data;
+	//Copy of the positions alone, read by depth-only passes
+	std::vector<uint8_t> positions;
+	glm::mat4 position_transform = glm::mat4(1.0f);
+	glm::vec4 uv_transform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	glm::vec4 constant_colour = glm::vec4(1.0f);
+	bool has_colour = false;
+};
+
+struct Vertex_layout
+{
+	Position_format position = Position_format::snorm16;
+	Uv_format uv = Uv_format::unorm16;
+	//A colour stream is only emitted for meshes whose colour actually varies
+	bool colour = true;
+	uint32_t position_size() const;
+	uint32_t uv_size() const;
+	uint32_t stride(const bool with_colour) const;
+	VkVertexInputBindingDescription get_binding_description(const bool with_colour) const;
+	std::vector<VkVertexInputAttributeDescription> get_attribute_descriptions(const bool with_colour) const;
+	VkVertexInputBindingDescription get_position_binding_description() const;
+	VkVertexInputAttributeDescription get_position_attribute_description() const;
+	Vertex_stream pack(const std::vector<Vertex>& vertices) const;
+};
+#endif // !VERTEX_LAYOUT_H
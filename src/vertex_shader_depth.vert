@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (set = 0, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout (push_constant) uniform DrawConstants
+{
+    mat4 model;
+    vec4 uvTransform;
+    vec4 colour;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+//Computed exactly like the scene shaders so the equal depth test matches
+invariant gl_Position;
+
+void main ()
+{
+	gl_Position = frame.proj * frame.view * draw.model * vec4 (inPosition, 1.0);
+}
\ No newline at end of file
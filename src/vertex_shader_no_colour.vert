@@ -0,0 +1,31 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (set = 0, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout (push_constant) uniform DrawConstants
+{
+    mat4 model;
+    vec4 uvTransform;
+    vec4 colour;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCord;
+layout(location = 0) out vec3 fragColour;
+layout(location = 1) out vec2 fragTexCord;
+layout(location = 2) out vec3 fragPosition;
+invariant gl_Position;
+
+void main ()
+{
+	//Same expression as the depth pre-pass, the world position is computed separately
+	gl_Position = frame.proj * frame.view * draw.model * vec4 (inPosition, 1.0);
+	fragPosition = vec3(draw.model * vec4 (inPosition, 1.0));
+	fragColour = draw.colour.rgb;
+    fragTexCord = inTexCord * draw.uvTransform.xy + draw.uvTransform.zw;
+}
\ No newline at end of file